@@ -109,7 +109,13 @@ SOURCES += \
     dnnshell.cpp \
     batchdnn.cpp \
     inputtensoritem.cpp \
-    fetchdata.cpp
+    fetchdata.cpp \
+    inferencepipeline.cpp \
+    inferencebackend.cpp \
+    nativebackend.cpp \
+    classsampler.cpp \
+    inferencecache.cpp \
+    batchrecorder.cpp
 
 HEADERS += \
     batchmanager.h \
@@ -120,12 +126,30 @@ HEADERS += \
     dnnshell.h \
     batchdnn.h \
     inputtensoritem.h \
-    fetchdata.h
+    fetchdata.h \
+    batchqueue.h \
+    inferencepipeline.h \
+    inferencebackend.h \
+    tfbackend.h \
+    nativebackend.h \
+    classsampler.h \
+    inferencecache.h \
+    batchrecorder.h
 unix {
     target.path = /usr/lib
     INSTALLS += target
 }
 
+# instruction sets for the native inference engine (see config.pri)
+svd_avx2 {
+    unix: QMAKE_CXXFLAGS += -mavx2 -mfma
+    win32: QMAKE_CXXFLAGS += /arch:AVX2
+}
+svd_avx512 {
+    unix: QMAKE_CXXFLAGS += -mavx512f -mavx512bw -mavx2 -mfma
+    win32: QMAKE_CXXFLAGS += /arch:AVX512
+}
+
 # compile only when TF enabled
-contains(DEFINES, USE_TENSORFLOW): SOURCES += predictortest.cpp predtest.cpp
+contains(DEFINES, USE_TENSORFLOW): SOURCES += predictortest.cpp predtest.cpp tfbackend.cpp
 contains(DEFINES, USE_TENSORFLOW): HEADERS += predictortest.h predtest.h
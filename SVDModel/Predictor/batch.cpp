@@ -18,6 +18,8 @@
 ********************************************************************************************/
 #include "batch.h"
 #include <atomic>
+#include <algorithm>
+#include <stdexcept>
 
 #include "spdlog/spdlog.h"
 
@@ -25,15 +27,19 @@
 Batch::Batch(size_t batch_size)
 {
 
-    mCurrentSlot = 0;
     mCellsFinished = 0;
     mBatchSize = batch_size;
+    mTargetSize = batch_size;
+    mExpectedSlots = batch_size;
     mState=Fill;
+    mSealed=false;
     mError=false;
     mType = Invalid;
     mModule = nullptr;
     mPackageId=0;
     mCells.resize(mBatchSize);
+    // a new batch is idle, i.e. it needs to be opened before filling (see open())
+    mCurrentSlot = SlotLocked;
 }
 
 Batch::~Batch()
@@ -43,8 +49,11 @@ Batch::~Batch()
 Batch::BatchState Batch::changeState(Batch::BatchState newState)
 {
     if (newState==Fill) {
-        mCurrentSlot = 0;
+        // lock the slot counter first: the batch is available for filling only after open()
+        mCurrentSlot = SlotLocked;
+        std::fill(mCells.begin(), mCells.end(), nullptr);
         mCellsFinished = 0;
+        mSealed = false;
         mState = newState;
     } else {
         mState = newState;
@@ -52,33 +61,51 @@ Batch::BatchState Batch::changeState(Batch::BatchState newState)
     return mState;
 }
 
-size_t Batch::acquireSlot()
+void Batch::open(size_t target_size)
 {
-    // use an atomic operation
-    size_t slot = mCurrentSlot.fetch_add(1); // read first, than add 1
-    if (slot >= mBatchSize)
-        throw std::logic_error("Batch::acquireSlot: batch full!");
-    return slot;
+    mTargetSize = std::max(std::min(target_size, mBatchSize), size_t(1));
+    mExpectedSlots = mTargetSize;
+    mOpenTime = std::chrono::steady_clock::now();
+    // reset the slot counter last: the batch is available for filling after this line
+    mCurrentSlot = 0;
 }
 
-size_t Batch::freeSlots()
+bool Batch::close()
 {
-    size_t slot = mCurrentSlot;
-    return mBatchSize - slot;
+    size_t claimed = mCurrentSlot.fetch_add(SlotClosed);
+    if (claimed >= mTargetSize)
+        return false; // the batch is already full (or closed, or idle)
+    mExpectedSlots = claimed;
+    // cells which finish from now on see the reduced number of expected slots
+    return mCellsFinished >= claimed;
 }
 
-void Batch::finishedCellProcessing()
+size_t Batch::acquireSlot()
 {
-    ++mCellsFinished;
+    size_t n_claimed;
+    size_t slot = claimSlots(1, n_claimed);
+    if (n_claimed == 0)
+        throw std::logic_error("Batch::acquireSlot: batch full!");
+    return slot;
 }
 
-bool Batch::allCellsProcessed()
+size_t Batch::claimSlots(size_t n, size_t &n_claimed)
 {
-    // a batch is done if no free slots are available and all slots are processed
-    if (freeSlots()<=0 && mCellsFinished==usedSlots())
-        return true;
+    // one atomic operation for the whole block; the counter may overshoot the batch size
+    // (usedSlots() is clamped), threads which come too late simply get no slots.
+    size_t first = mCurrentSlot.fetch_add(n);
+    if (first >= mTargetSize) {
+        n_claimed = 0;
+        return mTargetSize;
+    }
+    n_claimed = std::min(n, mTargetSize - first);
+    return first;
+}
 
-    return false;
+bool Batch::finishedCellProcessing()
+{
+    // mCellsFinished can only reach the expected number when all slots are claimed *and* filled
+    return ++mCellsFinished == mExpectedSlots;
 }
 
 void Batch::processResults()
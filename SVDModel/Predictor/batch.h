@@ -23,6 +23,7 @@
 #include <list>
 #include <atomic>
 #include <vector>
+#include <chrono>
 
 //#include "inferencedata.h"
 
@@ -40,7 +41,7 @@ public:
     enum BatchState { Fill=0, DNNInference=1, Finished=2, FinishedDNN=3};
     enum BatchType { Invalid=0, DNN=1, Simple=2 };
     BatchType type() const { return mType; }
-    BatchState state() const { return mState; }
+    BatchState state() const { return mState.load(); }
     BatchState changeState(BatchState newState);
 
     bool hasError() const { return mError; }
@@ -54,30 +55,68 @@ public:
 
     /// get slot number in the batch (atomic access)
     size_t acquireSlot();
+    /// claim a block of up to `n` consecutive slots with a single atomic operation.
+    /// Returns the first slot of the block; `n_claimed` is the number of slots actually
+    /// available (0 if the batch is already full, closed, or not opened).
+    size_t claimSlots(size_t n, size_t &n_claimed);
     /// number of slots that are free
-    size_t freeSlots();
-    /// number of slots currently in use
-    size_t usedSlots() { return mCurrentSlot; }
+    size_t freeSlots() const { return isIdle() ? 0 : mTargetSize - usedSlots(); }
+    /// number of slots currently in use (claimed slots, including slots not yet filled)
+    size_t usedSlots() const { size_t s = mCurrentSlot; if (s >= SlotLocked) return 0;
+                               size_t e = mExpectedSlots; return s < e ? s : e; }
+    /// the number of slots that are used when the batch is full (<= batchSize())
+    size_t targetSize() const { return mTargetSize; }
+
+    /// open a released (idle) batch for filling with `target_size` slots (<= batchSize())
+    void open(size_t target_size);
+    /// returns true if the batch is released, but not opened for filling
+    bool isIdle() const { return mCurrentSlot >= SlotLocked; }
+    /// returns true if the batch was closed early (see close())
+    bool isClosed() const { size_t s = mCurrentSlot; return s >= SlotClosed && s < SlotLocked; }
+    /// close the batch for further claims (used for sending batches early).
+    /// Returns true if all claimed slots are already filled, i.e. the batch can be sent by the caller.
+    bool close();
 
     void setCell(Cell* cell, size_t slot) { mCells[slot] = cell; }
     const std::vector<Cell*> &cells() const { return mCells; }
+    /// returns true if the slot contains a cell. Slots that were claimed but
+    /// not filled (e.g. when a partially filled batch is sent at the end of the year) are empty.
+    bool isSlotFilled(size_t slot) const { return mCells[slot] != nullptr; }
+
+    /// is called when a cell is finished (increase the atomic counter).
+    /// Returns true for exactly one caller: the one that filled the last slot of the batch.
+    bool finishedCellProcessing();
 
-    /// is called when a cell is finished (decrease the atomic counter)
-    void finishedCellProcessing();
+    /// mark the batch as sent. Returns true only for the first caller, i.e.
+    /// guarantees that a batch is sent only once. The flag is reset by changeState(Fill).
+    bool seal() { return !mSealed.exchange(true); }
+    bool isSealed() const { return mSealed; }
 
-    /// returns true if the batch is full and all cells are processed
-    bool allCellsProcessed();
+    // timing
+    /// time (seconds) between opening the batch and the call to markSubmitted()
+    double fillTime() const { return std::chrono::duration<double>(mSubmitTime - mOpenTime).count(); }
+    void markSubmitted() { mSubmitTime = std::chrono::steady_clock::now(); }
+    std::chrono::steady_clock::time_point submitTime() const { return mSubmitTime; }
+    std::chrono::steady_clock::time_point openTime() const { return mOpenTime; }
 
     virtual void processResults();
 
 
 protected:
     bool mError;
-    BatchState mState;
+    std::atomic<BatchState> mState;
+    std::atomic<bool> mSealed; ///< true if the batch is sent (or about to be sent) to processing
     BatchType mType;
     std::atomic<size_t> mCurrentSlot; ///< atomic access; number of currently used slots (not the index!)
     std::atomic<size_t> mCellsFinished; ///< number of cells which already finished during the "filling"
-    size_t mBatchSize;
+    std::atomic<size_t> mExpectedSlots; ///< number of slots to fill (target size, or less if the batch is closed early)
+    size_t mBatchSize; ///< capacity of the batch
+    size_t mTargetSize; ///< number of slots used for filling (changed only by open())
+    std::chrono::steady_clock::time_point mOpenTime;
+    std::chrono::steady_clock::time_point mSubmitTime;
+    // special values for the slot counter
+    static const size_t SlotLocked = size_t(1) << 62; ///< the batch is released, and not opened for filling
+    static const size_t SlotClosed = size_t(1) << 40; ///< offset added when the batch is closed
     int mPackageId;
     /// minimal storage: the cells
     std::vector< Cell* > mCells;
@@ -23,6 +23,8 @@
 #include "model.h"
 
 #include "randomgen.h"
+#include "perfstats.h"
+#include "classsampler.h"
 
 #include "dnn.h"
 #include "fetchdata.h"
@@ -36,6 +38,8 @@ BatchDNN::BatchDNN(size_t batch_size) : Batch(batch_size)
     mType = DNN;
 
     mInferenceData.resize(mBatchSize);
+    mFetchCells.reserve(mBatchSize);
+    mFetchSlots.reserve(mBatchSize);
     // reserve memory for the topK classes for target states and residence time
     const auto &settings = Model::instance()->settings();
     settings.requiredKeys("dnn", {"topKNClasses", "restime.N", "allowStateChangeAtMaxTime", "temperatureState", "temperatureRestime"});
@@ -76,36 +80,51 @@ void BatchDNN::processResults()
 
     lg->debug("Model: received package {} [{}](from DNN). Processing data.", packageId(), static_cast<void*>(this));
 
-    // choose from the topK classes
-    selectClasses();
+    // the next state and residence time are already selected (BatchDNN::selectClass(), called by the DNN worker thread)
 
     for (size_t i=0;i<usedSlots();++i) {
-        inferenceData(i).writeResult();
+        if (isSlotFilled(i))
+            inferenceData(i).writeResult();
     }
 
     // write detailed output for every example in the batch
+    // (the lines are built without lock, and written at once; batches are processed in parallel)
     if (mSCOut) {
+        std::vector<std::string> lines;
         for (size_t i=0;i<usedSlots(); ++i) {
-            if (mSCOut->shouldWriteOutput(inferenceData(i)))
-                mSCOut->writeLine(stateChangeOutput(i));
+            if (isSlotFilled(i) && mSCOut->shouldWriteOutput(inferenceData(i)))
+                lines.push_back(stateChangeOutput(i));
         }
+        mSCOut->writeLines(lines);
     }
 
 
 }
 
-bool BatchDNN::fetchPredictors(Cell *cell, size_t slot)
+void BatchDNN::fetchBatch()
 {
-    inferenceData(slot).fetchData(cell, this, slot); // the old way
+    PerfTimer timer(PerfStats::FetchPredictors);
+    // collect the filled slots (a claimed slot may stay empty, e.g. when the run is canceled)
+    mFetchCells.clear();
+    mFetchSlots.clear();
+    for (size_t i=0;i<usedSlots();++i) {
+        if (!isSlotFilled(i))
+            continue;
+        Cell *cell = cells()[i];
+        inferenceData(i).init(cell, this, i);
+        mFetchCells.push_back(cell);
+        mFetchSlots.push_back(i);
+    }
+    if (mFetchCells.empty())
+        return;
+
     for (auto &t : DNN::tensorDefinition()) {
         try {
-        t.mFetch->fetch(cell, this, slot);
+            t.mFetch->fetchBatch(mFetchCells.data(), mFetchSlots.data(), mFetchCells.size(), this);
         } catch (const std::logic_error &e) {
             throw std::logic_error("Error fetching data for tensor: " + t.name + ": " + e.what());
         }
     }
-
-    return true;
 }
 
 void BatchDNN::setupTensors()
@@ -113,77 +132,45 @@ void BatchDNN::setupTensors()
     DNN::setupBatch(this, mTensors);
 }
 
-// Example code Francois Chollet, Deep Learning Book:
-//def sample_next(predictions, temperature=1.0):
-//    predictions = np.asarray(predictions).astype("float64")
-//    predictions = np.log(predictions) / temperature
-//    exp_preds = np.exp(predictions)
-//    predictions = exp_preds / np.sum(exp_preds)
-//    probas = np.random.multinomial(1, predictions, 1)
-//    return np.argmax(probas)
-
-// choose randomly a value in *values (length=n), return the index.
-size_t BatchDNN::chooseProbabilisticIndex(float *values, size_t n, double temperature)
-{
-    if (temperature != 1.) {
-        // include temperature parameter
-        for (size_t i=0;i<n;++i)
-            values[i] = exp( log(values[i]) / temperature );
-    }
-
-    // calculate the sum of probs
-    double p_sum = 0.;
-    for (size_t i=0;i<n;++i)
-        p_sum+= static_cast<double>(values[i]);
-
-    double p = nrandom(0., p_sum);
-
-    p_sum = 0.;
-    for (size_t i=0;i<n;++i) {
-        p_sum += static_cast<double>(values[i]);
-        if (p < p_sum)
-            return i;
-    }
-    return n-1;
-}
-
-
-void BatchDNN::selectClasses()
+void BatchDNN::selectClass(size_t i)
 {
-    // Now select for each example the result of the prediction
+    // select the result of the prediction for the example
     // choose randomly from the result
-    for (size_t i=0; i<usedSlots(); ++i) {
-        InferenceData &id = inferenceData(i);
-
-        if (id.nextState() > 0)
-            continue; // the state has already been set, e.g. by random states if DNN is not enabled in debug mode.
-
-        // residence time: at least one year, i.e. for 10 classes it will have values between [1,10]
-        restime_t rt = static_cast<restime_t>( chooseProbabilisticIndex(timeProbResult(i), mNTimeClasses, mRestimeTemperature )) + 1;
-
-        if (!mAllowStateChangeAtMaxTime) {
-            // allowing state change at max time: default = false
-            // if false: if #years = maximum -> state stays the same, else: state *has* to change
-            // if true: state and time are chosen independently
-            if (rt == static_cast<restime_t>(mNTimeClasses)) {
-                // the state will be the same for the next period (no change)
-                id.setResult(id.state(), rt);
-                continue;
-            } else {
-                // select the next state probalistically
-                // the next state is not allowed to stay the same -> set probability to 0
-                for (size_t j=0;j<mNTopK;++j) {
-                    if (stateResult(i)[j] == id.state()) {
-                        stateProbResult(i)[j] = 0.f;
-                        break;
-                    }
+    if (!isSlotFilled(i))
+        return; // slot claimed, but never filled
+    InferenceData &id = inferenceData(i);
+    // the random stream is specific for the cell (and year)
+    RandomGenerator::setStream(static_cast<uint64_t>(cells()[i]->cellIndex()), RandomGenerator::DNNSelection);
+
+    if (id.nextState() > 0)
+        return; // the state has already been set, e.g. by random states if DNN is not enabled in debug mode.
+
+    // residence time: at least one year, i.e. for 10 classes it will have values between [1,10]
+    restime_t rt = static_cast<restime_t>( ClassSampler::sample(timeProbResult(i), mNTimeClasses, mRestimeTemperature )) + 1;
+
+    if (!mAllowStateChangeAtMaxTime) {
+        // allowing state change at max time: default = false
+        // if false: if #years = maximum -> state stays the same, else: state *has* to change
+        // if true: state and time are chosen independently
+        if (rt == static_cast<restime_t>(mNTimeClasses)) {
+            // the state will be the same for the next period (no change)
+            id.setResult(id.state(), rt);
+            return;
+        } else {
+            // select the next state probalistically
+            // the next state is not allowed to stay the same -> set probability to 0
+            for (size_t j=0;j<mNTopK;++j) {
+                if (stateResult(i)[j] == id.state()) {
+                    stateProbResult(i)[j] = 0.f;
+                    break;
                 }
             }
         }
+    }
 
-        // select the next state
-        size_t index = chooseProbabilisticIndex(stateProbResult(i), mNTopK, mStateTemperature);
-        state_t stateId = stateResult(i)[index];
+    // select the next state
+    size_t index = ClassSampler::sample(stateProbResult(i), mNTopK, mStateTemperature);
+    state_t stateId = stateResult(i)[index];
 
 //        if (stateId == 0 || rt == 0) {
 //            spdlog::get("main")->error("bad data in batch {} with {} used slots. item {}: update-time: {}, update-state: {} (set state to 1)", packageId(), usedSlots(), i, inferenceData(i).nextTime(), inferenceData(i).nextState());
@@ -192,9 +179,11 @@ void BatchDNN::selectClasses()
 //            if (rt == 0)
 //                rt = 1;
 //        }
-        id.setResult(stateId, rt);
+    id.setResult(stateId, rt);
+}
 
-    }
+void BatchDNN::traceSelection()
+{
 
     auto lg = spdlog::get("dnn");
     if (lg->should_log(spdlog::level::trace)) {
@@ -40,21 +40,24 @@ public:
     InferenceData &inferenceData(size_t slot) { if (slot<mInferenceData.size()) return mInferenceData[slot];
         throw std::logic_error("Batch: invalid slot!");}
 
-    /// extract data from the model and populate the examples for DNN inference
-    bool fetchPredictors(Cell *cell, size_t slot);
+    /// extract data from the model and populate the examples for DNN inference.
+    /// The cells are collected first (setCell()), and when the batch is sealed the
+    /// tensors are filled column by column (one pass over all cells per tensor).
+    void fetchBatch();
 
     // access to the results for the examples (used to write classes from DNN to the batch)
     float *timeProbResult(size_t index) { return &mTimeProb[index * mNTimeClasses]; }
     float *stateProbResult(size_t index) { return &mStateProb[index * mNTopK]; }
     state_t *stateResult(size_t index) { return &mStates[index * mNTopK]; }
+
+    /// select from the topK classes (DNN result) the next state & time of the example in `slot`
+    /// (thread safe, the random stream is specific to the cell)
+    void selectClass(size_t slot);
+    /// write details of the selection of the first example to the log (trace level)
+    void traceSelection();
 private:
     void setupTensors();
 
-    /// select from the topK classes (DNN result) the next state & time
-    void selectClasses();
-    /// sample and return and index from a probability distribution (values) with size n. Use temperature parameter to scale probabilities.
-    size_t chooseProbabilisticIndex(float *values, size_t n, double temperature=1);
-
     // state change output specific
     /// link to detailed output
     static StateChangeOut *mSCOut;
@@ -64,6 +67,9 @@ private:
     std::vector<InferenceData> mInferenceData;
     /// a vector of tensors associated with this batch of data
     std::vector<TensorWrapper*> mTensors;
+    /// the filled slots (and their cells) of the batch (used by fetchBatch())
+    std::vector<Cell*> mFetchCells;
+    std::vector<size_t> mFetchSlots;
 
     size_t mNTopK { 10 }; ///< number of classes for each example
     size_t mNTimeClasses { 10 }; ///< number of time classes for each example
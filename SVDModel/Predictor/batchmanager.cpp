@@ -19,24 +19,39 @@
 #include "batchmanager.h"
 #include "batchdnn.h"
 #include "tensorhelper.h"
+#include "inferencecache.h"
 
 #include "model.h"
 #include "settings.h"
 #include "modules/module.h"
 #include "filereader.h"
 #include "tools.h"
+#include "perfstats.h"
+#include "tracerecorder.h"
+#include "inferencepipeline.h"
 
 #include <mutex>
-
+#include <algorithm>
+#include <thread>
 
 #include "strtools.h"
 
 BatchManager *BatchManager::mInstance = nullptr;
 
-
-
-
-
+namespace {
+/// a block of slots claimed by a single thread
+struct SlotBlock {
+    const void *lane; ///< the lane (module) of the block
+    Batch *batch; ///< the batch from which the slots are taken
+    size_t next; ///< next free slot within the block
+    size_t end; ///< end of the block (exclusive)
+    size_t epoch; ///< blocks of older epochs are invalid
+};
+/// the currently claimed blocks of the thread (one per lane)
+thread_local std::vector<SlotBlock> tl_slot_blocks;
+/// the epoch is incremented every year (and for every new batch manager) to invalidate left-over blocks
+std::atomic<size_t> slot_epoch(0);
+}
 
 
 BatchManager::BatchManager()
@@ -44,6 +59,25 @@ BatchManager::BatchManager()
     if (mInstance!=nullptr)
         throw std::logic_error("Creation of batch manager: instance ptr is not 0.");
     mInstance = this;
+    mSlotRequested = false;
+    mNLanes = 0;
+    mBlockedCount = 0;
+    mBlockedNs = 0;
+    mBlockedNsYear = 0;
+    mAdaptive = false;
+    mMinBatchSize = 1;
+    mMinQueueLength = 1;
+    mTargetBatchSize = 0;
+    mQueueLength = 0;
+    mInferenceThreads = 1;
+    mPeakBatchesInUse = 0;
+    mFillRate = 0.;
+    mDNNLatency = 0.;
+    for (size_t i=0;i<MaxLanes;++i) {
+        mLanes[i].module = nullptr;
+        mLanes[i].current = nullptr;
+    }
+    ++slot_epoch;
     if (spdlog::get("dnn"))
         spdlog::get("dnn")->debug("Batch manager created: {}", static_cast<void*>(this));
 
@@ -55,6 +89,8 @@ BatchManager::~BatchManager()
     for (auto b : mBatches)
         delete b;
 
+    ++slot_epoch;
+
     if (auto lg = spdlog::get("dnn"))
         lg->debug("Batch manager destroyed: {x}", static_cast<void*>(this));
 
@@ -71,49 +107,151 @@ void BatchManager::setup()
     Model::instance()->settings().requiredKeys("dnn", {"batchSize", "maxBatchQueue", "metadata"});
     mBatchSize = Model::instance()->settings().valueUInt("dnn.batchSize");
     mMaxQueueLength = Model::instance()->settings().valueUInt("dnn.maxBatchQueue");
-
+    mSlotBlockSize = Model::instance()->settings().valueUInt("dnn.slotBlockSize", 16);
+    mSlotBlockSize = std::max(std::min(mSlotBlockSize, mBatchSize), size_t(1));
+    lg->debug("Slots are claimed in blocks of {} slots.", mSlotBlockSize);
+
+    // adaptive batching: batchSize and maxBatchQueue are the upper limits
+    mAdaptive = Model::instance()->settings().valueBool("dnn.adaptiveBatching", "false");
+    mMinBatchSize = Model::instance()->settings().valueUInt("dnn.minBatchSize", static_cast<int>(std::max(mBatchSize / 16, size_t(1))));
+    mMinBatchSize = std::max(std::min(mMinBatchSize, mBatchSize), size_t(1));
+    mMinQueueLength = Model::instance()->settings().valueUInt("dnn.minBatchQueue", 2);
+    mMinQueueLength = std::max(std::min(mMinQueueLength, mMaxQueueLength), size_t(1));
+    mTargetBatchSize = mBatchSize;
+    mQueueLength = mMaxQueueLength;
+    mYearStart = std::chrono::steady_clock::now();
+    if (mAdaptive)
+        lg->info("Adaptive batching enabled: batch size {}-{}, queue length {}-{}.", mMinBatchSize, mBatchSize, mMinQueueLength, mMaxQueueLength);
 
 }
 
 void BatchManager::newYear()
 {
+    if (mBlockedNsYear > 0)
+        lg->debug("Waited {} s (total {} s, {} times) for free batches (queue full, dnn.maxBatchQueue={}).", mBlockedNsYear / 1e9, blockedSeconds(), mBlockedCount.load(), mMaxQueueLength);
+    adaptQueueLength();
+    if (InferenceCache::instance())
+        InferenceCache::instance()->newYear();
+    mBlockedNsYear = 0;
+    mPeakBatchesInUse = 0;
+    mYearStart = std::chrono::steady_clock::now();
     mSlotRequested = false;
+    // partially filled batches are sent at the end of the year;
+    // start the new year with fresh batches and invalidate slots still held by threads
+    for (size_t i=0;i<mNLanes;++i)
+        mLanes[i].current = nullptr;
+    ++slot_epoch;
 }
 
-static std::mutex batch_mutex;
 std::pair<Batch *, size_t> BatchManager::validSlot(Module *module)
 {
-    // serialize this function...
-    std::lock_guard<std::mutex> guard(batch_mutex);
     mSlotRequested = true;
-    std::pair<Batch *, size_t> result;
-    int sleeps = 0;
-    do {
-        result = findValidSlot(module);
-        if (!result.first) {
-            // wait
+    SlotLane *l = lane(module);
+
+    // look up the block of the current thread
+    size_t epoch = slot_epoch;
+    SlotBlock *block = nullptr;
+    for (auto &b : tl_slot_blocks)
+        if (b.lane == l) {
+            block = &b;
+            break;
+        }
+    if (!block) {
+        tl_slot_blocks.push_back(SlotBlock{l, nullptr, 0, 0, epoch});
+        block = &tl_slot_blocks.back();
+    }
+    if (block->epoch != epoch) {
+        block->batch = nullptr;
+        block->next = block->end = 0;
+        block->epoch = epoch;
+    }
 
+    // fast path: a slot from the block of the thread (no synchronization)
+    if (block->next < block->end)
+        return std::pair<Batch *, size_t>(block->batch, block->next++);
+
+    // claim a new block from the current batch of the lane
+    while (true) {
+        Batch *batch = l->current;
+        if (batch) {
+            size_t n_claimed;
+            size_t first = batch->claimSlots(mSlotBlockSize, n_claimed);
+            if (n_claimed > 0) {
+                if (first==0)
+                    lg->trace("Started to fill batch [{}] (first slot acquired)", static_cast<void*>(batch));
+                block->batch = batch;
+                block->next = first + 1;
+                block->end = first + n_claimed;
+                return std::pair<Batch *, size_t>(batch, first);
+            }
+        }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            Model::instance()->processEvents();
+        // the batch is full: get a new one
+        if (nextFillBatch(l, batch))
+            continue;
 
-            if (++sleeps % 100 == 0) // 1s
-                lg->trace("BatchManager: no batch available (queue full). Sleeping for {} s.", sleeps/100);
+        // the queue is full: wait until a batch is released
+        int result = waitForBatch(l, batch);
+        if (result==0) {
+            lg->info("Canceled.");
+            return std::pair<Batch*, int>(nullptr, 0);
+        }
+        if (result<0) {
+            lg->error("time out in batch manager - no empty slots found.");
+            return std::pair<Batch*, int>(nullptr, -1);
+        }
+    }
 
-            if (RunState::instance()->cancel() ) {
-                lg->info("Canceled.");
-                return std::pair<Batch*, int>(nullptr, 0);
+}
 
-            }
-            if ( sleeps % (30*60*100) == 0) { // wait half an hour: 30 min * 60 sek * 100 1/100s
-                lg->error("time out in batch manager - no empty slots found.");
-                return std::pair<Batch*, int>(nullptr, -1);
+void BatchManager::releaseBatch(Batch *batch)
+{
+    {
+        // changing the state under the lock avoids a lost wake up in waitForBatch()
+        std::lock_guard<std::mutex> guard(mMutex);
+        batch->changeState(Batch::Fill);
+    }
+    mBatchReleased.notify_all();
+}
 
+int BatchManager::waitForBatch(SlotLane *l, Batch *exhausted)
+{
+    // same conditions as in nextFillBatch()
+    auto is_available = [this, l, exhausted]() {
+        if (l->current != exhausted)
+            return true;
+        size_t in_use;
+        Batch *idle = findIdleBatch(l, in_use);
+        return in_use < queueLimit() && (idle || mBatches.size() < mMaxQueueLength);
+    };
+
+    auto t_start = std::chrono::steady_clock::now();
+    ++mBlockedCount;
+    int result = 1;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        int seconds = 0;
+        // wake up regularly to check for cancel/timeout
+        while (!mBatchReleased.wait_for(lock, std::chrono::seconds(1), is_available)) {
+            ++seconds;
+            lg->trace("BatchManager: no batch available (queue full). Waiting for {} s.", seconds);
+            if (RunState::instance()->cancel()) {
+                result = 0;
+                break;
+            }
+            if (seconds >= 30*60) { // wait half an hour
+                result = -1;
+                break;
             }
         }
-    } while (!result.first);
+    }
+    auto elapsed = static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_start).count());
+    mBlockedNs += elapsed;
+    mBlockedNsYear += elapsed;
+    if (PerfStats::isEnabled())
+        PerfStats::record(PerfStats::SlotWait, elapsed);
+    TraceRecorder::span("slot wait", "model", t_start, TraceRecorder::now());
     return result;
-
 }
 
 BatchDNN *BatchManager::createDNNBatch()
@@ -124,48 +262,158 @@ BatchDNN *BatchManager::createDNNBatch()
 
 }
 
-std::pair<Batch *, size_t> BatchManager::findValidSlot(Module *module)
+BatchManager::SlotLane *BatchManager::lane(Module *module)
 {
-    // this function is serialized (access via validSlot() ).
+    // lanes are never removed, therefore the lookup does not require a lock
+    size_t n = mNLanes;
+    for (size_t i=0;i<n;++i)
+        if (mLanes[i].module == module)
+            return &mLanes[i];
+
+    std::lock_guard<std::mutex> guard(mMutex);
+    n = mNLanes;
+    for (size_t i=0;i<n;++i)
+        if (mLanes[i].module == module)
+            return &mLanes[i];
+    if (n >= MaxLanes)
+        throw std::logic_error("BatchManager: too many modules that use batches.");
+    mLanes[n].module = module;
+    mLanes[n].current = nullptr;
+    mNLanes = n + 1; // publish the lane
+    return &mLanes[n];
+}
 
-    // look for a batch which is currently not in the DNN processing chain
-    Batch *batch = nullptr;
-    for (const auto &b : mBatches) {
-        if (b->module()==module && b->state()==Batch::Fill && b->freeSlots()>0) {
-            batch=b;
-            break;
-        }
-    }
-    if (!batch || batch->freeSlots()<=0) {
+bool BatchManager::nextFillBatch(SlotLane *l, Batch *exhausted)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    if (l->current != exhausted)
+        return true; // another thread was faster
+
+    // look for a batch which is currently not in the processing chain
+    size_t in_use;
+    Batch *batch = findIdleBatch(l, in_use);
+    if (in_use >= queueLimit())
+        return false;
+    if (!batch) {
         if (mBatches.size() >= mMaxQueueLength) {
             // currently we don't find a proper place for the data.
-            return std::pair<Batch*, size_t>(nullptr, 0);
+            return false;
         }
         // create a new batch; the default (forest) is a batch for DNN
-        batch = createBatch(module ? module->batchType() : Batch::DNN);
-        batch->setModule(module);
+        batch = createBatch(l->module ? l->module->batchType() : Batch::DNN);
+        batch->setModule(l->module);
         mBatches.push_back( batch );
         lg->trace("created a new batch. Now the list contains {} batch(es).", mBatches.size());
-        /*if ( lg->should_log(spdlog::level::trace) ) {
-            int idx=0;
-            for (auto b : mBatches) {
-                lg->trace("#{}: state: {}, used: {}, free: {}", idx, b->state(), b->usedSlots(), b->freeSlots());
-                ++idx;
-            }
-        }*/
     }
+    // module batches are always filled completely, the size of DNN batches is adaptive
+    batch->open(l->module ? mBatchSize : mTargetBatchSize.load());
+    mPeakBatchesInUse = std::max(mPeakBatchesInUse, in_use + 1);
+    l->current = batch;
+    return true;
+}
 
+Batch *BatchManager::findIdleBatch(const SlotLane *l, size_t &in_use) const
+{
+    Batch *batch = nullptr;
+    in_use = 0;
+    for (const auto &b : mBatches) {
+        if (b->state()==Batch::Fill && !b->isSealed() && b->isIdle()) {
+            if (!batch && b->module()==l->module)
+                batch = b;
+        } else {
+            ++in_use;
+        }
+    }
+    return batch;
+}
+
+void BatchManager::updateStatistics(size_t cells, double fill_seconds, double dnn_seconds)
+{
+    if (cells==0 || dnn_seconds <= 0.)
+        return;
+    const double alpha = 0.2; // weight of the latest batch
+    std::lock_guard<std::mutex> guard(mStatsMutex);
+    double rate = fill_seconds > 0. ? cells / fill_seconds : 0.;
+    mFillRate = mFillRate > 0. ? (1. - alpha) * mFillRate + alpha * rate : rate;
+    mDNNLatency = mDNNLatency > 0. ? (1. - alpha) * mDNNLatency + alpha * dnn_seconds : dnn_seconds;
+    if (!mAdaptive || mFillRate <= 0.)
+        return;
+
+    // a batch should be ready whenever one of the inference threads is available:
+    // if the DNN is faster than the model, smaller batches reduce the time cells wait in batches,
+    // if the DNN is the bottleneck, the batch size grows to the maximum.
+    double optimal = mFillRate * mDNNLatency / static_cast<double>(mInferenceThreads);
+    size_t target = std::max(std::min(static_cast<size_t>(optimal), mBatchSize), mMinBatchSize);
+    // dampen the changes
+    target = (mTargetBatchSize + target + 1) / 2;
+    mTargetBatchSize = std::max(std::min(target, mBatchSize), mMinBatchSize);
+}
 
-    // get a new slot in the batch
-    std::pair<Batch *, size_t> result;
-    result.first = batch;
-    result.second = batch->acquireSlot();
-    if (result.second==0) {
-        lg->trace("Started to fill batch [{}] (first slot acquired)", static_cast<void*>(batch));
+void BatchManager::flushOnIdle()
+{
+    if (!mAdaptive)
+        return;
+
+    std::vector<Batch*> to_send;
+    std::function<void(Batch*)> send;
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        if (!mSendBatch)
+            return;
+        send = mSendBatch;
+        // only DNN batches: the batches of modules do not use the DNN
+        for (size_t i=0;i<mNLanes;++i) {
+            if (mLanes[i].module != nullptr)
+                continue;
+            Batch *b = mLanes[i].current;
+            if (!b || b->state()!=Batch::Fill || b->isIdle() || b->isClosed() || b->isSealed())
+                continue;
+            if (b->freeSlots()==0 || b->usedSlots() < mMinBatchSize)
+                continue;
+            // if not all claimed slots are filled yet, the thread that fills the last slot sends the batch.
+            // The batch is counted as in flight *before* it is sealed (see flushesInFlight()).
+            if (b->close()) {
+                ++mFlushesInFlight;
+                if (b->seal())
+                    to_send.push_back(b);
+                else
+                    --mFlushesInFlight;
+            }
+        }
     }
-    return result;
+    for (auto b : to_send) {
+        lg->debug("DNN idle: sending partially filled batch [{}] with {} slots.", static_cast<void*>(b), b->usedSlots());
+        send(b);
+        // wake up the model thread, which may wait for the flush (e.g. when the batch could not be sent)
+        if (--mFlushesInFlight == 0)
+            InferencePipeline::instance()->wakeUp();
+    }
+}
 
+void BatchManager::adaptQueueLength()
+{
+    if (!mAdaptive)
+        return;
+
+    double year_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mYearStart).count();
+    size_t q = mQueueLength;
+    if (mBlockedNsYear / 1e9 > 0.01 * year_seconds) {
+        // threads were waiting for batches: increase the queue
+        q = std::min(q + std::max(q / 2, size_t(1)), mMaxQueueLength);
+    } else if (mPeakBatchesInUse > 0 && mPeakBatchesInUse + 1 < q) {
+        // more batches available than required: keep one batch in reserve
+        q = std::max(mPeakBatchesInUse + 1, mMinQueueLength);
+    }
+    mQueueLength = q;
 
+    double fill_rate, latency;
+    {
+        std::lock_guard<std::mutex> guard(mStatsMutex);
+        fill_rate = mFillRate;
+        latency = mDNNLatency;
+    }
+    lg->debug("Adaptive batching: batch size: {} (max {}), queue length: {} (max {}, peak in use: {}), fill rate: {:.0f} cells/s, DNN latency: {:.1f} ms.",
+              mTargetBatchSize.load(), mBatchSize, mQueueLength.load(), mMaxQueueLength, mPeakBatchesInUse, fill_rate, latency*1000.);
 }
 
 
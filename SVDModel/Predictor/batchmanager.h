@@ -23,6 +23,12 @@
 #include <list>
 #include <cassert>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <algorithm>
 #include "spdlog/spdlog.h"
 
 #include "batch.h"
@@ -49,25 +55,100 @@ public:
         assert(mInstance!=nullptr);
         return mInstance; }
     static bool hasInstance() { return mInstance != nullptr; }
+    /// (maximum) size of a batch (dnn.batchSize)
     size_t batchSize() const { return mBatchSize; }
+    /// maximum number of batches (dnn.maxBatchQueue)
+    size_t maxQueueLength() const { return mMaxQueueLength; }
+
+    // adaptive batching (dnn.adaptiveBatching)
+    bool isAdaptive() const { return mAdaptive; }
+    /// number of slots used for new DNN batches (<= batchSize())
+    size_t effectiveBatchSize() const { return mTargetBatchSize; }
+    /// number of batches that can be used at the same time (<= maxQueueLength())
+    size_t effectiveQueueLength() const { return mQueueLength; }
+    /// set the number of threads that run the DNN (used for calculating the batch size)
+    void setInferenceThreads(size_t n) { mInferenceThreads = std::max(n, size_t(1)); }
+    /// update the statistics with a processed batch: `cells`: number of cells, `fill_seconds`: time to fill the batch,
+    /// `dnn_seconds`: time for inference. The effective batch size is derived from these values.
+    void updateStatistics(size_t cells, double fill_seconds, double dnn_seconds);
+    /// function that is used to send batches that are flushed by flushOnIdle()
+    void setSendBatchCallback(std::function<void(Batch*)> callback) { std::lock_guard<std::mutex> guard(mMutex); mSendBatch = callback; }
+    /// called when the DNN is idle: partially filled batches (at least `dnn.minBatchSize` slots) are
+    /// closed and sent to the DNN without waiting for the remaining slots.
+    void flushOnIdle();
+    /// number of batches that are sealed by flushOnIdle() but not yet handed over to the send function
+    int flushesInFlight() const { return mFlushesInFlight; }
 
     std::shared_ptr<spdlog::logger> &log() {return lg; }
 
     /// returns a pointer to a batch (first) and a (valid)
     /// slot (=index within the batch): second
+    /// Slots are claimed in blocks (see `dnn.slotBlockSize`) with a single atomic operation
+    /// and handed out from a thread local cache; a lock is only used when a new batch is required.
     std::pair<Batch *, size_t> validSlot(Module *module);
 
-    const std::list<Batch *> batches() const { return mBatches; }
+    const std::list<Batch *> batches() const { std::lock_guard<std::mutex> guard(mMutex); return mBatches; }
 
     bool slotsRequested() const { return mSlotRequested; }
 
+    /// return a processed batch to the pool of batches (state Fill) and
+    /// wake up threads which wait for a free batch (see validSlot()).
+    void releaseBatch(Batch *batch);
+
+    // statistics for the waiting time for free batches (backpressure)
+    /// number of times a thread was blocked because the batch queue was full (total)
+    size_t blockedCount() const { return mBlockedCount; }
+    /// total time (seconds) threads were blocked because the batch queue was full
+    double blockedSeconds() const { return mBlockedNs / 1e9; }
+    /// blocked time (seconds) during the last (or current) year
+    double blockedSecondsYear() const { return mBlockedNsYear / 1e9; }
+
 private:
+    /// a "lane" holds the batch that is currently filled for a module (or the DNN, module=nullptr)
+    struct SlotLane {
+        Module *module;
+        std::atomic<Batch*> current;
+    };
+    static const size_t MaxLanes = 32;
+    SlotLane *lane(Module *module);
+    /// slow path: install a new batch for filling in the lane. Returns false if the queue is full.
+    bool nextFillBatch(SlotLane *lane, Batch *exhausted);
+    /// block until a batch is released. Returns 1 on success, 0 if canceled, -1 on timeout.
+    int waitForBatch(SlotLane *l, Batch *exhausted);
+    /// find a released batch for the lane, and count the batches currently in use (requires a lock on mMutex)
+    Batch *findIdleBatch(const SlotLane *l, size_t &in_use) const;
+    /// the maximum number of batches in use at the same time
+    size_t queueLimit() const { return std::min(std::max(mQueueLength.load(), mNLanes + 1), mMaxQueueLength); }
+    /// adapt the queue length (once a year)
+    void adaptQueueLength();
+
     size_t mBatchSize;
     size_t mMaxQueueLength;
-    bool mSlotRequested;
+    size_t mSlotBlockSize; ///< number of slots that are claimed by a thread at once
+    // adaptive batching
+    bool mAdaptive;
+    size_t mMinBatchSize; ///< lower limit of the batch size (dnn.minBatchSize)
+    size_t mMinQueueLength; ///< lower limit of the queue length (dnn.minBatchQueue)
+    std::atomic<size_t> mTargetBatchSize; ///< current size of new DNN batches
+    std::atomic<size_t> mQueueLength; ///< current number of batches that can be in use
+    size_t mInferenceThreads;
+    size_t mPeakBatchesInUse; ///< maximum number of batches in use during the year
+    std::mutex mStatsMutex; ///< protects the statistics below
+    double mFillRate; ///< cells/second (exponential moving average)
+    double mDNNLatency; ///< seconds per batch (exponential moving average)
+    std::chrono::steady_clock::time_point mYearStart;
+    std::function<void(Batch*)> mSendBatch;
+    std::atomic<int> mFlushesInFlight {0}; ///< batches currently sent by flushOnIdle()
+    std::atomic<bool> mSlotRequested;
     BatchDNN *createDNNBatch();
     Batch *createBatch(Batch::BatchType type);
-    std::pair<Batch *, size_t> findValidSlot(Module *module);
+    SlotLane mLanes[MaxLanes];
+    std::atomic<size_t> mNLanes;
+    mutable std::mutex mMutex; ///< protects the list of batches and the creation of lanes
+    std::condition_variable mBatchReleased; ///< signaled when a batch is available for filling again
+    std::atomic<size_t> mBlockedCount;
+    std::atomic<unsigned long long> mBlockedNs;
+    std::atomic<unsigned long long> mBlockedNsYear;
     std::list<Batch *> mBatches;
     static BatchManager *mInstance;
 
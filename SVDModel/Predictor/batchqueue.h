@@ -0,0 +1,113 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef BATCHQUEUE_H
+#define BATCHQUEUE_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/**
+ * @brief The BatchQueue class is a bounded, blocking multi-producer/multi-consumer queue.
+ *
+ * The queue is a fixed size ring buffer. `push()` blocks while the queue is full,
+ * `pop()` blocks while the queue is empty. After `close()` all waiting threads are released:
+ * `push()` fails, and `pop()` returns the remaining items and fails afterwards.
+ */
+template <typename T>
+class BatchQueue
+{
+public:
+    explicit BatchQueue(size_t capacity=1) { setCapacity(capacity); }
+    /// set the maximum number of items (the queue must be empty)
+    void setCapacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mItems.resize(capacity > 0 ? capacity : 1);
+        mHead = 0; mCount = 0;
+    }
+    size_t capacity() const { return mItems.size(); }
+
+    /// add an item to the queue, wait while the queue is full.
+    /// returns false if the queue is closed.
+    bool push(const T &item) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotFull.wait(lock, [this]() { return mClosed || mCount < mItems.size(); });
+        if (mClosed)
+            return false;
+        mItems[(mHead + mCount) % mItems.size()] = item;
+        ++mCount;
+        lock.unlock();
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    /// get the next item from the queue, wait while the queue is empty.
+    /// returns false if the queue is closed (and empty).
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotEmpty.wait(lock, [this]() { return mClosed || mCount > 0; });
+        return take(item, lock);
+    }
+
+    /// like pop(), but wait at most `timeout`. Returns false on timeout.
+    bool popFor(T &item, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!mNotEmpty.wait_for(lock, timeout, [this]() { return mClosed || mCount > 0; }))
+            return false;
+        return take(item, lock);
+    }
+
+    /// close the queue and release all waiting threads
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mClosed = true;
+        }
+        mNotEmpty.notify_all();
+        mNotFull.notify_all();
+    }
+    /// open a closed queue again
+    void reopen() { std::lock_guard<std::mutex> lock(mMutex); mClosed = false; }
+    bool isClosed() const { std::lock_guard<std::mutex> lock(mMutex); return mClosed; }
+
+    /// number of items currently in the queue
+    size_t size() const { std::lock_guard<std::mutex> lock(mMutex); return mCount; }
+
+private:
+    bool take(T &item, std::unique_lock<std::mutex> &lock) {
+        if (mCount == 0)
+            return false; // closed
+        item = mItems[mHead];
+        mHead = (mHead + 1) % mItems.size();
+        --mCount;
+        lock.unlock();
+        mNotFull.notify_one();
+        return true;
+    }
+    std::vector<T> mItems;
+    size_t mHead {0};
+    size_t mCount {0};
+    bool mClosed {false};
+    mutable std::mutex mMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+};
+
+#endif // BATCHQUEUE_H
@@ -0,0 +1,213 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "batchrecorder.h"
+
+#include <stdexcept>
+#include <cstring>
+#include "spdlog/spdlog.h"
+
+BatchRecorder *BatchRecorder::mInstance = nullptr;
+
+namespace {
+void writeUInt(std::ofstream &out, uint32_t value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(uint32_t));
+}
+
+void writeString(std::ofstream &out, const std::string &s)
+{
+    writeUInt(out, static_cast<uint32_t>(s.size()));
+    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+/// read a uint32; returns false at the end of the file
+bool readUInt(std::ifstream &in, uint32_t &value)
+{
+    in.read(reinterpret_cast<char*>(&value), sizeof(uint32_t));
+    return static_cast<bool>(in);
+}
+
+uint32_t readUInt(std::ifstream &in)
+{
+    uint32_t value;
+    if (!readUInt(in, value))
+        throw std::logic_error("unexpected end of file");
+    return value;
+}
+
+std::string readString(std::ifstream &in)
+{
+    uint32_t len = readUInt(in);
+    std::string s(len, '\0');
+    in.read(&s[0], len);
+    if (!in)
+        throw std::logic_error("unexpected end of file");
+    return s;
+}
+} // end namespace
+
+BatchRecorder::BatchRecorder(const std::string &file_name, const std::string &network_file, const std::vector<std::string> &output_names,
+                             const std::list<InputTensorItem> &tensors, size_t max_batches)
+{
+    if (mInstance!=nullptr)
+        throw std::logic_error("Creation of the batch recorder: instance ptr is not 0.");
+    mFileName = file_name;
+    mNetworkFile = network_file;
+    mOutputNames = output_names;
+    mMaxBatches = max_batches;
+    for (const auto &t : tensors)
+        mContent[t.name] = t.content;
+    mFile.open(file_name, std::ios::binary | std::ios::trunc);
+    if (!mFile)
+        throw std::logic_error("BatchRecorder: cannot create the file '" + file_name + "'.");
+    mInstance = this;
+}
+
+BatchRecorder::~BatchRecorder()
+{
+    mFile.close();
+    auto lg = spdlog::get("dnn");
+    if (lg)
+        lg->info("Recorded {} batches ({} examples) to '{}'.", mBatches, mRows, mFileName);
+    mInstance = nullptr;
+}
+
+void BatchRecorder::write(const std::vector<TensorView> &inputs, size_t n_rows)
+{
+    std::lock_guard<std::mutex> guard(mLock);
+    if (mMaxBatches > 0 && mBatches >= mMaxBatches)
+        return;
+    if (!mHeaderWritten)
+        writeHeader(inputs);
+
+    writeUInt(mFile, static_cast<uint32_t>(n_rows));
+    for (const auto &t : inputs) {
+        size_t n_bytes = InputTensorItem::datatypeSize(t.type);
+        if (!t.shape.empty()) {
+            for (size_t d=1; d<t.shape.size(); ++d)
+                n_bytes *= static_cast<size_t>(t.shape[d]);
+            n_bytes *= n_rows;
+        }
+        mFile.write(static_cast<const char*>(t.data), static_cast<std::streamsize>(n_bytes));
+    }
+    mFile.flush(); // the file is usable while the model is still running
+    if (!mFile)
+        throw std::logic_error("BatchRecorder: error writing to '" + mFileName + "'.");
+    ++mBatches;
+    mRows += n_rows;
+}
+
+void BatchRecorder::writeHeader(const std::vector<TensorView> &inputs)
+{
+    mFile.write("SVDR", 4);
+    writeUInt(mFile, 1); // version
+    writeString(mFile, mNetworkFile);
+    writeUInt(mFile, static_cast<uint32_t>(mOutputNames.size()));
+    for (const auto &name : mOutputNames)
+        writeString(mFile, name);
+    writeUInt(mFile, static_cast<uint32_t>(inputs.size()));
+    for (const auto &t : inputs) {
+        writeString(mFile, t.name);
+        writeUInt(mFile, static_cast<uint32_t>(t.type));
+        auto it = mContent.find(t.name);
+        writeUInt(mFile, static_cast<uint32_t>(it != mContent.end() ? it->second : InputTensorItem::Invalid));
+        // the dimensions without the batch dimension
+        const size_t ndim = t.shape.empty() ? 0 : t.shape.size() - 1;
+        writeUInt(mFile, static_cast<uint32_t>(ndim));
+        for (size_t d=1; d<t.shape.size(); ++d)
+            writeUInt(mFile, static_cast<uint32_t>(t.shape[d]));
+    }
+    mHeaderWritten = true;
+}
+
+BatchRecorder::Recording BatchRecorder::read(const std::string &file_name)
+{
+    std::ifstream in(file_name, std::ios::binary);
+    if (!in)
+        throw std::logic_error("BatchRecorder: cannot open the file '" + file_name + "'.");
+    Recording rec;
+    try {
+        char magic[4];
+        in.read(magic, 4);
+        if (!in || std::strncmp(magic, "SVDR", 4) != 0)
+            throw std::logic_error("not a SVD recording (expected 'SVDR' header)");
+        uint32_t version = readUInt(in);
+        if (version != 1)
+            throw std::logic_error("unsupported version " + std::to_string(version));
+        rec.networkFile = readString(in);
+        uint32_t n_outputs = readUInt(in);
+        for (uint32_t i=0; i<n_outputs; ++i)
+            rec.outputNames.push_back(readString(in));
+        uint32_t n_tensors = readUInt(in);
+        for (uint32_t i=0; i<n_tensors; ++i) {
+            Tensor t;
+            t.name = readString(in);
+            t.type = static_cast<InputTensorItem::DataType>(readUInt(in));
+            t.content = static_cast<InputTensorItem::DataContent>(readUInt(in));
+            uint32_t ndim = readUInt(in);
+            size_t n_values = 1;
+            for (uint32_t d=0; d<ndim; ++d) {
+                t.shape.push_back(readUInt(in));
+                n_values *= static_cast<size_t>(t.shape.back());
+            }
+            if (InputTensorItem::datatypeSize(t.type) == 0)
+                throw std::logic_error("tensor '" + t.name + "': invalid data type");
+            t.rowBytes = ndim > 0 ? n_values * InputTensorItem::datatypeSize(t.type) : 0;
+            rec.tensors.push_back(t);
+        }
+
+        // the batches
+        uint32_t n_rows;
+        while (readUInt(in, n_rows)) {
+            for (auto &t : rec.tensors) {
+                const size_t n_bytes = t.rowBytes > 0 ? t.rowBytes * n_rows : InputTensorItem::datatypeSize(t.type);
+                std::vector<char> buffer(n_bytes);
+                in.read(buffer.data(), static_cast<std::streamsize>(n_bytes));
+                if (!in)
+                    throw std::logic_error("unexpected end of file (batch " + std::to_string(rec.batchSizes.size()) + ")");
+                if (t.rowBytes > 0)
+                    t.data.insert(t.data.end(), buffer.begin(), buffer.end());
+                else if (t.data.empty())
+                    t.data = buffer; // scalars: the value of the first batch
+            }
+            rec.batchSizes.push_back(n_rows);
+            rec.nRows += n_rows;
+        }
+    } catch (const std::logic_error &e) {
+        throw std::logic_error("BatchRecorder: error reading the file '" + file_name + "': " + e.what());
+    }
+    return rec;
+}
+
+std::vector<TensorView> BatchRecorder::Recording::views(size_t first, size_t n)
+{
+    if (first + n > nRows)
+        throw std::logic_error("BatchRecorder: invalid range of examples.");
+    std::vector<TensorView> result;
+    for (auto &t : tensors) {
+        if (t.rowBytes == 0) {
+            result.push_back(TensorView(t.name, t.type, {}, t.data.data()));
+            continue;
+        }
+        std::vector<int64_t> shape = { static_cast<int64_t>(n) };
+        shape.insert(shape.end(), t.shape.begin(), t.shape.end());
+        result.push_back(TensorView(t.name, t.type, shape, t.data.data() + first * t.rowBytes));
+    }
+    return result;
+}
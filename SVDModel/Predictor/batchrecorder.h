@@ -0,0 +1,97 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef BATCHRECORDER_H
+#define BATCHRECORDER_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <mutex>
+#include <fstream>
+
+#include "inferencebackend.h"
+
+/**
+ * @brief The BatchRecorder class writes the input tensors of every batch that is sent to the DNN
+ * to a binary file (`dnn.record.file`). The recording is used to benchmark the inference
+ * without running the model (see SVDBench).
+ *
+ * The file starts with a header (network file, names of the outputs, and the definition of the input tensors),
+ * followed by one record per batch (number of examples and the data of each tensor, all values little endian):
+ * ```
+ * "SVDR" uint32 version (=1)
+ * string network file, uint32 number of outputs, string name of each output
+ * uint32 number of tensors, for each tensor: string name, uint32 data type, uint32 content,
+ *                                             uint32 number of dimensions (per example), uint32 size of each dimension
+ * for each batch: uint32 number of examples, for each tensor: the data of the examples (scalars: a single value)
+ * ```
+ * Strings are stored as `uint32` length followed by the characters.
+ */
+class BatchRecorder
+{
+public:
+    /// create a recorder that writes to `file_name` (at most `max_batches` batches, 0: no limit)
+    BatchRecorder(const std::string &file_name, const std::string &network_file, const std::vector<std::string> &output_names,
+                  const std::list<InputTensorItem> &tensors, size_t max_batches);
+    ~BatchRecorder();
+    static BatchRecorder *instance() { return mInstance; }
+
+    /// append the first `n_rows` examples of the input tensors of a batch to the file (thread safe)
+    void write(const std::vector<TensorView> &inputs, size_t n_rows);
+
+    size_t batchesWritten() const { return mBatches; }
+
+    /// the content of a recording file
+    struct Tensor {
+        std::string name;
+        InputTensorItem::DataType type;
+        InputTensorItem::DataContent content;
+        std::vector<int64_t> shape; ///< dimensions of a single example (empty for scalars)
+        size_t rowBytes; ///< bytes per example (0 for scalars)
+        std::vector<char> data; ///< the data of all examples (scalars: the value)
+    };
+    struct Recording {
+        std::string networkFile;
+        std::vector<std::string> outputNames;
+        std::vector<Tensor> tensors;
+        std::vector<size_t> batchSizes; ///< number of examples of each recorded batch
+        size_t nRows {0}; ///< total number of examples
+        /// the inputs of `n` examples starting with the example `first`
+        std::vector<TensorView> views(size_t first, size_t n);
+    };
+    /// read a recording from `file_name`. Throws an exception on error.
+    static Recording read(const std::string &file_name);
+
+private:
+    void writeHeader(const std::vector<TensorView> &inputs);
+    std::ofstream mFile;
+    std::string mFileName;
+    std::string mNetworkFile;
+    std::vector<std::string> mOutputNames;
+    std::map<std::string, InputTensorItem::DataContent> mContent; ///< content of the tensors (by name)
+    size_t mMaxBatches;
+    size_t mBatches {0};
+    size_t mRows {0};
+    bool mHeaderWritten {false};
+    std::mutex mLock;
+    static BatchRecorder *mInstance;
+};
+
+#endif // BATCHRECORDER_H
@@ -0,0 +1,101 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "classsampler.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "randomgen.h"
+
+void ClassSampler::topK(const float *values, size_t n, size_t n_top, int32_t *indices, float *scores)
+{
+    // partial selection: the current top k are kept sorted in 'scores'; blocks of values are only
+    // examined if at least one value exceeds the current threshold (the smallest of the top k).
+    // The test of a block is branch free and vectorized by the compiler. As the outputs of the DNN
+    // are mostly tiny probabilities, most of the blocks are skipped.
+    const size_t BlockSize = 16;
+    size_t n_found = 0;
+    float threshold = -std::numeric_limits<float>::infinity();
+    for (size_t b=0; b<n; b+=BlockSize) {
+        const size_t e = std::min(n, b + BlockSize);
+        if (n_found == n_top) {
+            int n_above = 0;
+            for (size_t j=b; j<e; ++j)
+                n_above += values[j] > threshold ? 1 : 0;
+            if (n_above == 0)
+                continue;
+        }
+        for (size_t j=b; j<e; ++j) {
+            const float v = values[j];
+            if (n_found == n_top && !(v > threshold))
+                continue;
+            // insertion (from the end of the sorted list)
+            size_t pos = n_found < n_top ? n_found++ : n_top - 1;
+            while (pos > 0 && v > scores[pos-1]) {
+                scores[pos] = scores[pos-1];
+                indices[pos] = indices[pos-1];
+                --pos;
+            }
+            scores[pos] = v;
+            indices[pos] = static_cast<int32_t>(j);
+            if (n_found == n_top)
+                threshold = scores[n_top - 1];
+        }
+    }
+    // less values than n_top
+    for (size_t i=n_found; i<n_top; ++i) {
+        scores[i] = 0.f;
+        indices[i] = 0;
+    }
+}
+
+// Example code Francois Chollet, Deep Learning Book:
+//def sample_next(predictions, temperature=1.0):
+//    predictions = np.asarray(predictions).astype("float64")
+//    predictions = np.log(predictions) / temperature
+//    exp_preds = np.exp(predictions)
+//    predictions = exp_preds / np.sum(exp_preds)
+//    probas = np.random.multinomial(1, predictions, 1)
+//    return np.argmax(probas)
+size_t ClassSampler::sample(float *values, size_t n, double temperature)
+{
+    // temperature scaling and sum in one pass; the normalization is included in the
+    // random number (drawn from [0, sum of probs))
+    double p_sum = 0.;
+    if (temperature != 1.) {
+        for (size_t i=0; i<n; ++i) {
+            values[i] = static_cast<float>( std::exp( std::log(static_cast<double>(values[i])) / temperature ) );
+            p_sum += static_cast<double>(values[i]);
+        }
+    } else {
+        for (size_t i=0; i<n; ++i)
+            p_sum += static_cast<double>(values[i]);
+    }
+
+    const double p = nrandom(0., p_sum);
+
+    p_sum = 0.;
+    for (size_t i=0; i<n; ++i) {
+        p_sum += static_cast<double>(values[i]);
+        if (p < p_sum)
+            return i;
+    }
+    return n-1;
+}
@@ -0,0 +1,44 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef CLASSSAMPLER_H
+#define CLASSSAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The ClassSampler class contains the kernels that select the next state and residence time
+ * from the DNN outputs (probability distributions).
+ *
+ * The functions are stateless and thread safe (the random numbers are drawn from the current random stream
+ * of the thread, see RandomGenerator::setStream()). They are called per example from the DNN worker threads.
+ */
+class ClassSampler
+{
+public:
+    /// select the `n_top` largest `values` (length `n`). The results (`indices` and `scores`, length `n_top`)
+    /// are sorted in descending order; for equal values the lower index is preferred.
+    static void topK(const float *values, size_t n, size_t n_top, int32_t *indices, float *scores);
+
+    /// sample an index from the (unnormalized) distribution `values` (length `n`). The values are
+    /// scaled in place with the `temperature` (p^(1/T)).
+    static size_t sample(float *values, size_t n, double temperature);
+};
+
+#endif // CLASSSAMPLER_H
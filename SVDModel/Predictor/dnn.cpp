@@ -18,55 +18,28 @@
 ********************************************************************************************/
 #include "dnn.h"
 
-#ifdef USE_TENSORFLOW
-
 #include "settings.h"
 #include "model.h"
 #include "tools.h"
 #include "tensorhelper.h"
+#include "inferencebackend.h"
 #include "batch.h"
 #include "batchdnn.h"
 #include "batchmanager.h"
 #include "randomgen.h"
-#include "settings.h"
+#include "perfstats.h"
 #include "fetchdata.h"
+#include "classsampler.h"
+#include "batchrecorder.h"
 
-// Tensorflow includes
-//  from inception demo
 #include <fstream>
 #include <vector>
 #include <iomanip>
+#include <thread>
+#include <cmath>
 
-#include <queue>
-
-#ifdef COMPILER_MSVC
-#pragma warning(push, 0)
-#endif
-
-//Some includes with unfixable warnings: https://stackoverflow.com/questions/2541984/how-to-suppress-warnings-in-external-headers-in-visual-c
-
-#include "tensorflow/cc/ops/const_op.h"
-#include "tensorflow/cc/ops/image_ops.h"
-#include "tensorflow/cc/ops/standard_ops.h"
-#include "tensorflow/core/framework/graph.pb.h"
-#include "tensorflow/core/framework/tensor.h"
-#include "tensorflow/core/graph/default_device.h"
-#include "tensorflow/core/graph/graph_def_builder.h"
-#include "tensorflow/core/lib/core/errors.h"
-#include "tensorflow/core/lib/core/stringpiece.h"
-#include "tensorflow/core/lib/core/threadpool.h"
-#include "tensorflow/core/lib/io/path.h"
-#include "tensorflow/core/lib/strings/stringprintf.h"
-#include "tensorflow/core/platform/init_main.h"
-#include "tensorflow/core/platform/logging.h"
-#include "tensorflow/core/platform/types.h"
-#include "tensorflow/core/public/session.h"
-#include "tensorflow/core/util/command_line_flags.h"
-#include "tensorflow/core/framework/op_kernel.h"
-
-#ifdef COMPILER_MSVC
-#pragma warning(pop)
-#endif
+#include <cstring>
+#include <unordered_map>
 
 // CUDA Profiling
 // #define CUDA_PROFILING
@@ -76,37 +49,6 @@
 
 std::list<InputTensorItem> DNN::mTensorDef; // static def
 
-// These are all common classes it's handy to reference with no namespace.
-using tensorflow::Flag;
-using tensorflow::Tensor;
-using tensorflow::Status;
-using tensorflow::string;
-using tensorflow::int32;
-
-// Reads a model graph definition from disk, and creates a session object you
-// can use to run it.
-Status DNN::loadGraph(string graph_file_name,
-                 tensorflow::Session* session) {
-  tensorflow::GraphDef graph_def;
-
-  Status load_graph_status =
-      ReadBinaryProto(tensorflow::Env::Default(), graph_file_name, &graph_def);
-  if (!load_graph_status.ok()) {
-      // TF > 2.9
-    //return tensorflow::errors::NotFound("Failed to load compute graph at '",
-    //                                    graph_file_name, "'");
-  }
-
-  //session->reset(tensorflow::NewSession(tensorflow::SessionOptions()));
-  Status session_create_status = session->Create(graph_def);
-  if (!session_create_status.ok()) {
-    return session_create_status;
-  }
-
-  dumpTensorInfo(graph_def, "dummy");
-  return Status::OK();
-}
-
 
 
 DNN::DNN()
@@ -114,8 +56,9 @@ DNN::DNN()
 
     if (spdlog::get("dnn"))
         spdlog::get("dnn")->debug("DNN created: {}", static_cast<void*>(this));
-    session = nullptr;
-    top_k_session = nullptr;
+    mDummyDNN = false;
+    mVerifyBatches = 0;
+    mVerifyTolerance = 0.;
     mTopK_tf = true;
     mTopK_NClasses = 10;
     mNResTimeCls = 0; mNStateCls = 0;
@@ -123,10 +66,6 @@ DNN::DNN()
 
 DNN::~DNN()
 {
-    if (session)
-        session->Close();
-    if (top_k_session)
-        top_k_session->Close();
 }
 
 bool DNN::setupDNN(size_t aindex)
@@ -167,154 +106,54 @@ bool DNN::setupDNN(size_t aindex)
 
 
     // set-up of the DNN
-    if (session) {
-        lg->info("Session is already open... closing.");
-        session->Close();
-        delete session;
-    }
 #ifdef TF_DEBUG_MODE
     lg->info("*** debug build: Tensorflow is disabled.");
     mDummyDNN = true;
     return true;
 #else
     mDummyDNN = false;
-    tensorflow::SessionOptions opts;
-    tensorflow::ConfigProto* config = &opts.config;
-
-    tensorflow::GraphDef graph_def;
-
-
-    // log of device placement if log level debug is on
-    if (lg->should_log(spdlog::level::debug))
-        opts.config.set_log_device_placement(true);
-
-    //opts.config.set_inter_op_parallelism_threads(16); // no big effect.... but uses more threads
-    //opts.config.set_intra_op_parallelism_threads(16);
-    lg->debug("Available GPUs: '{}'", opts.config.gpu_options().visible_device_list());
-
-    opts.config.mutable_gpu_options()->set_allow_growth(true); // do not allocate all the RAM
-
-    //opts.config.mutable_gpu_options()->set_visible_device_list("0");
-    //opts.config.gpu_options().visible_device_list()
-
-    //(*config->mutable_device_count())["GPU"] = 4;
-    //auto device_count = config->device_count();
-    //lg->debug("device-count GPU: {}, CPU: {}", device_count["GPU"], device_count["CPU"]);
-
-    //if (!selected_gpu.empty())
-    //    setenv("CUDA_VISIBLE_DEVICES", selected_gpu.c_str(), 1);
-
-    //lg->debug("CUDA_VISBLE_DEVICES = {} (dnn.selectedGPU was: {})", getenv("CUDA_VISIBLE_DEVICES"), selected_gpu);
-
-    //if (aindex == 1) {
-        //std::string devices = "2";
-        //opts.config.mutable_gpu_options()->set_visible_device_list(devices);
-    //}
-
-
-
-    Status load_graph_status =
-        ReadBinaryProto(tensorflow::Env::Default(), file, &graph_def);
-    if (!load_graph_status.ok()) {
-      // return tensorflow::errors::NotFound("Failed to load compute graph at '", file, "'");
-    }
-
-
-    //tensorflow::graph::SetDefaultDevice("2", &graph_def);
-
-
-
-
-    session = tensorflow::NewSession(opts); // no specific options: tensorflow::SessionOptions()
-
-    //device_count = config->device_count();
-    //lg->debug("post device-count GPU: {}, CPU: {}", device_count["GPU"], device_count["CPU"]);
-
-    lg->trace("attempting to load the graph...");
-
-    load_graph_status = session->Create(graph_def);
-
-    //Status load_graph_status = loadGraph(file, session);
-    if (!load_graph_status.ok()) {
-        lg->error("Error loading the graph: {}", load_graph_status.error_message().data());
+    std::string backend_name = settings.valueString("dnn.backend", "tensorflow");
+    try {
+        mBackend = InferenceBackend::create(backend_name);
+        lg->info("Inference backend: '{}'", mBackend->name());
+        lg->trace("attempting to load the graph...");
+        mBackend->load(file, mOutputTensorNames);
+    } catch (const std::exception &e) {
+        lg->error("Error setting up the inference backend '{}': {}", backend_name, e.what());
         return false;
     }
     lg->trace("Successfully loaded graph!");
 
+    // optionally: reduced numerical precision (e.g. int8), calibrated with the first examples of the run
+    std::string precision = settings.valueString("dnn.precision", "float32");
+    if (!mBackend->setupPrecision(precision,
+                                  settings.valueUInt("dnn.precision.calibrationRows", 4096),
+                                  settings.valueDouble("dnn.precision.maxError", 0.01))) {
+        lg->error("The precision '{}' (dnn.precision) is not supported by the inference backend '{}'.", precision, mBackend->name());
+        return false;
+    }
 
-    if (mTopK_tf) {
-        lg->trace("build the top-k graph...");
-        // output_classes = new tensorflow::Tensor(dt, tensorflow::TensorShape({ static_cast<int>(mBatchSize), static_cast<int>(1418)}));
-        //output_classes = new tensorflow::Input();
-        int bs = static_cast<int>( BatchManager::instance()->batchSize() );
-        // number of classes:
-        int ncls = static_cast<int>( mNStateCls );
-        Tensor top_k_tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({bs, ncls}));
-        //top_k_tensor = new tensorflow::Tensor(tensorflow::DT_FLOAT, tensorflow::PartialTensorShape({-1, ncls}));
-        //new tensorflow::Tensor(dt, tensorflow::TensorShape({ static_cast<int>(mBatchSize), static_cast<int>(mRows), static_cast<int>(mCols)}));
-
-
-        auto root = tensorflow::Scope::NewRootScope();
-        string output_name = "top_k";
-        tensorflow::GraphDefBuilder b;
-        //string topk_input_name = "topk_input";
-
-        // tensorflow::Node* topk =
-        tensorflow::ops::TopK tk(root.WithOpName(output_name), top_k_tensor, static_cast<int>(mTopK_NClasses));
-
-
-        lg->trace("top-k-tensor: {}", top_k_tensor.DebugString());
-        //lg->trace("node: {}", topk->DebugString());
-
-        tensorflow::GraphDef graph;
-        Status tf_status;
-        tf_status = root.ToGraphDef(&graph);
-
-        if (!tf_status.ok()) {
-            lg->error("Error building top-k graph definition: {}", tf_status.error_message());
-            return false;
-        }
-
-        lg->trace("TK NODES") ;
-        for (tensorflow::Node* node : root.graph()->nodes()) {
-            lg->trace("Node {}: {}",node->id(), node->DebugString());
-        }
-
-        top_k_session = tensorflow::NewSession(tensorflow::SessionOptions());
-
-        tf_status = top_k_session->Create(graph);
-        //tf_status = session->Create(graph);
-        if (!tf_status.ok()) {
-            lg->error("Error creating top-k graph: {}", tf_status.error_message());
+    // optionally: compare the results of the first batches with a second backend
+    std::string verify_backend = settings.valueString("dnn.verifyBackend", "");
+    if (!verify_backend.empty()) {
+        std::string verify_file = Tools::path(settings.valueString("dnn.verifyFile"));
+        try {
+            mReference = InferenceBackend::create(verify_backend);
+            mReference->load(verify_file, mOutputTensorNames);
+        } catch (const std::exception &e) {
+            lg->error("Error setting up the backend '{}' for verification: {}", verify_backend, e.what());
             return false;
         }
+        mVerifyBatches = static_cast<int>(settings.valueUInt("dnn.verifyBatches", 1));
+        mVerifyTolerance = settings.valueDouble("dnn.verifyTolerance", 1e-4);
+        lg->info("The results of the first {} batches are verified with backend '{}' ('{}'), tolerance: {}.", mVerifyBatches, verify_backend, verify_file, mVerifyTolerance);
+    }
 
-
-        // TEST
-//        auto tsess = tensorflow::NewSession(opts);
-//        auto troot = tensorflow::Scope::NewRootScope();
-//        auto tscope = troot.WithDevice("/device:GPU:0");
-//        tensorflow::GraphDef tgraph;
-
-//        tensorflow::ops::Softmax sm(tscope.WithOpName("tsoftmax"),top_k_tensor);
-//        tf_status = tscope.ToGraphDef(&tgraph);
-//        if (!tf_status.ok())
-//            lg->error("Error building graph definition: {}", tf_status.error_message());
-//        tf_status = tsess->Create(tgraph);
-//        if (!tf_status.ok())
-//            lg->error("Error creating graph in session: {}", tf_status.error_message());
-
-//        lg->trace("TK NODES2") ;
-//        for (tensorflow::Node* node : troot.graph()->nodes()) {
-//            lg->trace("Node {}: {}",node->id(), node->DebugString());
-//        }
-//        std::vector< Tensor > tmp;
-//        tf_status = tsess->Run({ {"Const/Const" , top_k_tensor} }, {"tsoftmax:0"},
-//        {}, &tmp);
-//        if (!tf_status.ok())
-//            lg->error("Error running: {}", tf_status.error_message());
-
-//        tensorflow::LogAllRegisteredKernels();
+    if (mTopK_tf) {
+        // the top-k can run within the backend (e.g. on the GPU); fall back to the CPU otherwise
+        mTopK_tf = mBackend->setupTopK(mTopK_NClasses, mNStateCls);
+        if (!mTopK_tf)
+            lg->info("Top-K is not supported by the backend '{}' - using the CPU.", mBackend->name());
     }
 
     // setup output: store ptr only when output is enabled
@@ -360,18 +199,25 @@ Batch * DNN::run(Batch *abatch)
 #endif
     try {
 
-    std::vector<Tensor> outputs;
     STimer timr(lg, "DNN::run:" + to_string(batch->packageId()));
     lg->debug("DNN#{}: started execution for package {}.", mIndex, batch->packageId());
 
-    std::vector<std::pair<string, Tensor> > inputs;
+    std::vector<TensorView> inputs;
     const std::list<InputTensorItem> &tdef = tensorDefinition();
     size_t tindex=0;
+    // batches can be sent before they are full (adaptive batching): only the used rows are
+    // passed to the backend (the tensors keep the memory of the full batch)
+    const size_t n_rows = batch->usedSlots();
     for (const auto &def : tdef) {
-        inputs.push_back( std::pair<string, Tensor>( def.name, batch->tensor(tindex)->tensor() ));
+        TensorWrapper *t = batch->tensor(tindex);
+        inputs.push_back( TensorView{ def.name, t->dataType(), t->shape(), t->data() } );
         tindex++;
     }
+    // write the inputs to a file for benchmarking (dnn.record.file)
+    if (BatchRecorder::instance())
+        BatchRecorder::instance()->write(inputs, n_rows);
 
+    PerfTimer dnn_timer(PerfStats::DNNRun);
     // if disabled (in debug mode), TF_DEBUG_MODE
     if (mDummyDNN) {
         lg->debug("DNN in debug mode... no action");
@@ -380,6 +226,9 @@ Batch * DNN::run(Batch *abatch)
         // ... and produce a random result
         state_t new_state;
         for (size_t i=0;i<batch->usedSlots();++i) {
+            if (!batch->isSlotFilled(i))
+                continue;
+            RandomGenerator::setStream(static_cast<uint64_t>(batch->cells()[i]->cellIndex()), RandomGenerator::DNNSelection);
             InferenceData &id=batch->inferenceData(i);
             // select a new state randomly ....
             //const State &s = Model::instance()->states()->randomState();
@@ -394,16 +243,39 @@ Batch * DNN::run(Batch *abatch)
         return batch;
     }
 
-    /* Run Tensorflow */
+    /* Run the network */
     timr.print("before main dnn");
     //timr.now();
 
-    Status run_status = session->Run(inputs, mOutputTensorNames, {}, &outputs);
-    if (!run_status.ok()) {
-        lg->trace("{}", batch->inferenceData(0).dumpTensorData());
-        lg->error("Tensorflow error (run main network): {}", run_status.error_message());
-        batch->setError(true);
-        return batch;
+    // inference cache: examples with known inputs get the results from the cache, and only
+    // examples with new inputs (unique within the batch) run through the network
+    InferenceCache *cache = InferenceCache::instance();
+    CachedRows cached;
+    size_t n_run = n_rows;
+    if (cache)
+        n_run = lookupCache(batch, inputs, n_rows, cached);
+    const std::vector<TensorView> &run_inputs = cache ? cached.inputs : inputs;
+
+    std::unique_ptr<InferenceOutput> outputs;
+    if (n_run > 0) {
+        try {
+            outputs = mBackend->run(run_inputs, n_run);
+        } catch (const std::exception &e) {
+            dnn_timer.stop();
+            lg->trace("{}", batch->inferenceData(0).dumpTensorData());
+            lg->error("Inference error (run main network): {}", e.what());
+            batch->setError(true);
+            return batch;
+        }
+    }
+    dnn_timer.stop();
+
+    // note: DNN::run() can be called concurrently for the same DNN
+    if (outputs && mVerifyBatches > 0 && mVerifyBatches-- > 0) {
+        if (!verifyOutputs(run_inputs, n_run, *outputs)) {
+            batch->setError(true);
+            return batch;
+        }
     }
 
     // tracing now in batchdnn.cpp
@@ -414,88 +286,78 @@ Batch * DNN::run(Batch *abatch)
     //timr.now();
 
     // test dimensions of the network
-    if (outputs.size() != 2 || static_cast<size_t>(outputs[0].dim_size(1)) != mNStateCls || static_cast<size_t>(outputs[1].dim_size(1)) != mNResTimeCls ) {
+    const size_t n_out = outputs ? outputs->size() : 0;
+    auto out_dim = [&outputs, n_out](size_t i) -> int64_t { return i<n_out && outputs->output(i).shape.size()>1 ? outputs->output(i).shape[1] : 0; };
+    if (outputs && (n_out < (mTopK_tf ? 4 : 2) || static_cast<size_t>(out_dim(0)) != mNStateCls || static_cast<size_t>(out_dim(1)) != mNResTimeCls) ) {
         lg->error("Wrong number of dimensions of DNN outputs. Number of output tensors: '{}' (expected: 2), Classes state: '{}' (expected: {}); classes residence time: '{}' (expected: {}).",
-                  outputs.size(), outputs.size()>0 ? outputs[0].dim_size(1) : 0, mNStateCls,
-                  outputs.size()>1 ? outputs[1].dim_size(1) : 0 , mNResTimeCls);
+                  n_out, out_dim(0), mNStateCls,
+                  out_dim(1), mNResTimeCls);
         batch->setError(true);
         return batch;
     }
 
-    tensorflow::Tensor *scores= nullptr;
-    tensorflow::Tensor *indices = nullptr;
-    std::vector< Tensor > topk_output;
-    if (mTopK_tf) {
-        // run top-k labels
-        // top_k_session
-        run_status = top_k_session->Run({ {"Const/Const" , outputs[0]} }, {"top_k:0", "top_k:1"},
-        {}, &topk_output);
-        if (!run_status.ok()) {
-            lg->trace("{}", batch->inferenceData(0).dumpTensorData());
-            lg->error("Tensorflow error (run top-k): {}", run_status.error_message());
-            batch->setError(true);
-            return batch;
+    // Fused pass over the examples: top-k of the state probabilities, copy of the results (states, probabilities,
+    // residence times) to the batch, and selection of the next state and residence time (with temperature).
+    // This runs on the DNN worker thread (and not in the model thread).
+    PerfTimer topk_timer(PerfStats::TopK);
+    const float *state_prob = outputs ? static_cast<const float*>(outputs->output(0).data) : nullptr;
+    const float *time_prob = outputs ? static_cast<const float*>(outputs->output(1).data) : nullptr;
+    // the top-k labels are calculated by the backend and appended to the outputs (if enabled)
+    const float *topk_scores = outputs && mTopK_tf ? static_cast<const float*>(outputs->output(n_out-2).data) : nullptr;
+    const int32_t *topk_indices = outputs && mTopK_tf ? static_cast<const int32_t*>(outputs->output(n_out-1).data) : nullptr;
+    if (!mTopK_tf && lg->should_log(spdlog::level::trace))
+        lg->trace("Running Top-K (CPU) for package {}:", abatch->packageId());
+
+    std::vector<int32_t> row_indices(mTopK_NClasses);
+    for (size_t i=0; i<n_rows; ++i) {
+        size_t r = i; // the row of the example in the outputs
+        if (cache) {
+            if (cached.source[i] < 0) {
+                // the results are already copied from the cache (or the slot is empty)
+                batch->selectClass(i);
+                continue;
+            }
+            r = static_cast<size_t>(cached.source[i]);
         }
-        timr.print("topk dnn");
-        scores = &topk_output[0];
-        indices = &topk_output[1];
-    } else {
-        // use CPU to extract top-k results
-        // outputs[0] is the output tensor with the state probabilities
-        scores = new Tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({  static_cast<long long>(batch->batchSize()), static_cast<long long>(mTopK_NClasses)}));
-        indices = new Tensor(tensorflow::DT_INT32, tensorflow::TensorShape({  static_cast<long long>(batch->batchSize()), static_cast<long long>(mTopK_NClasses)}));
-
-        // run the top-k on CPU
-        if (lg->should_log(spdlog::level::trace))
-            lg->trace("Running Top-K for package {}:", abatch->packageId());
-        getTopClasses(outputs[0], batch->batchSize(), mTopK_NClasses, indices, scores);
-        timr.print("topk cpu");
-
-
-    }
-#ifdef CUDA_PROFILING
-    cudaProfilerStop();
-#endif
-
-
-    lg->debug("DNN result (#{}): {} output tensors. package {}, {} slots.", mIndex, outputs.size(), batch->packageId(), batch->usedSlots());
-    lg->debug("out:  {}", outputs[0].DebugString());
-    lg->debug("time: {}", outputs[1].DebugString());
-    // output tensors: 2dim; 1x batch, 1x data
-    // lg->debug("dimension time: {} x {}.", outputs[1].dim_size(0), outputs[1].dim_size(0));
-
-
-    TensorWrap2d<float> out_time(outputs[1]);
-    TensorWrap2d<float> scores_flat(*scores);
-    TensorWrap2d<int32> indices_flat(*indices);
-
-    // Copy the results of the TopK (states, probabilities, residence times) to the batch
-    for (size_t i=0; i<batch->usedSlots(); ++i) {
-        float *ostate = scores_flat.example(i);
         float *tstate = batch->stateProbResult(i);
-        int *oidx = indices_flat.example(i);
+        const int32_t *oidx;
+        if (mTopK_tf) {
+            std::memcpy(tstate, topk_scores + r*mTopK_NClasses, mTopK_NClasses*sizeof(float));
+            oidx = topk_indices + r*mTopK_NClasses;
+        } else {
+            // use CPU to extract top-k results
+            ClassSampler::topK(state_prob + r*mNStateCls, mNStateCls, mTopK_NClasses, row_indices.data(), tstate);
+            oidx = row_indices.data();
+        }
         state_t *tidx = batch->stateResult(i);
-        for (size_t r=0;r<mTopK_NClasses;++r) {
-
-            *tstate++ = *ostate++;
+        for (size_t k=0;k<mTopK_NClasses;++k) {
             // the result of TopK is the *index* within the input of the operation
             // the StateId starts with 1, i.e. to convert from the index (0-based).
             //*tidx++ = Model::instance()->states()->stateByIndex(static_cast<size_t>(*oidx++)).id();
             *tidx++ = Model::instance()->states()->stateById(static_cast<state_t>(*oidx++)).id();
         }
 
-        float *otime = out_time.example(i);
-        float *ttime = batch->timeProbResult(i);
-        for (size_t r=0;r<mNResTimeCls;++r) {
-            *ttime++ = *otime++;
-        }
-    }
+        std::memcpy(batch->timeProbResult(i), time_prob + r*mNResTimeCls, mNResTimeCls*sizeof(float));
 
+        // store the result (before the selection changes the probabilities)
+        if (cache && cached.first[i])
+            cache->insert(cached.keys[i], tstate, batch->stateResult(i), batch->timeProbResult(i));
 
-    // cleanup
-    if (!mTopK_tf) {
-        delete scores;
-        delete indices;
+        batch->selectClass(i);
+    }
+    topk_timer.stop();
+    timr.print(mTopK_tf ? "topk dnn + selection" : "topk cpu + selection");
+#ifdef CUDA_PROFILING
+    cudaProfilerStop();
+#endif
+
+    lg->debug("DNN result (#{}): {} output tensors. package {}, {} slots ({} examples run through the DNN).", mIndex, n_out, batch->packageId(), batch->usedSlots(), n_run);
+    if (lg->should_log(spdlog::level::trace)) {
+        // output details for the first example.....
+        lg->trace("Top-K-calculation, first example:");
+        for (size_t r=0;r<mTopK_NClasses;++r)
+            lg->trace("State: {}, Score: {} %", batch->stateResult(0)[r], batch->stateProbResult(0)[r]*100.f);
+        batch->traceSelection();
     }
 
     lg->debug("DNN::run finished; package {}", batch->packageId());
@@ -672,89 +534,100 @@ void DNN::setupBatch(Batch *abatch, std::vector<TensorWrapper *> &tensors)
 
 }
 
-tensorflow::Status DNN::getTopClassesOldCode(const tensorflow::Tensor &classes, const int n_top, tensorflow::Tensor *indices, tensorflow::Tensor *scores)
+size_t DNN::lookupCache(BatchDNN *batch, const std::vector<TensorView> &inputs, size_t n_rows, DNN::CachedRows &rows)
 {
-    auto root = tensorflow::Scope::NewRootScope();
-    using namespace ::tensorflow::ops;  // NOLINT(build/namespaces)
-
-    string output_name = "top_k";
-    TopK(root.WithOpName(output_name), classes, n_top);
-    // This runs the GraphDef network definition that we've just constructed, and
-    // returns the results in the output tensors.
-    tensorflow::GraphDef graph;
-    TF_RETURN_IF_ERROR(root.ToGraphDef(&graph));
-
-    std::unique_ptr<tensorflow::Session> session(
-        tensorflow::NewSession(tensorflow::SessionOptions()));
-    TF_RETURN_IF_ERROR(session->Create(graph));
-    // The TopK node returns two outputs, the scores and their original indices,
-    // so we have to append :0 and :1 to specify them both.
-    std::vector<Tensor> out_tensors;
-    TF_RETURN_IF_ERROR(session->Run({}, {output_name + ":0", output_name + ":1"},
-                                    {}, &out_tensors));
-    *scores = out_tensors[0];
-    *indices = out_tensors[1];
-
-    return Status::OK();
-
-
-
-}
-
-class ComparisonClassTopK {
-public:
-    bool operator() (const std::pair<float, size_t> &p1, const std::pair<float, size_t> &p2) {
-        //comparison code here: we want to keep track of the smallest element in the list
-        return p1.first>p2.first;
+    InferenceCache *cache = InferenceCache::instance();
+    rows.source.assign(n_rows, -1);
+    rows.first.assign(n_rows, false);
+    rows.keys.resize(n_rows);
+    std::unordered_map<InferenceCache::Key, int, InferenceCache::KeyHash> batch_keys;
+    std::vector<size_t> unique_rows;
+    size_t n_duplicates = 0;
+    for (size_t i=0; i<n_rows; ++i) {
+        if (!batch->isSlotFilled(i))
+            continue;
+        rows.keys[i] = InferenceCache::signature(inputs, i);
+        if (cache->lookup(rows.keys[i], batch->stateProbResult(i), batch->stateResult(i), batch->timeProbResult(i)))
+            continue;
+        auto it = batch_keys.find(rows.keys[i]);
+        if (it != batch_keys.end()) {
+            // the same inputs as another example in the batch
+            rows.source[i] = it->second;
+            ++n_duplicates;
+            continue;
+        }
+        rows.source[i] = static_cast<int>(unique_rows.size());
+        rows.first[i] = true;
+        batch_keys[rows.keys[i]] = rows.source[i];
+        unique_rows.push_back(i);
+    }
+    cache->addBatchDuplicates(n_duplicates);
+
+    // no copy required, if the unique examples are the first rows of the batch
+    bool is_prefix = true;
+    for (size_t j=0; j<unique_rows.size() && is_prefix; ++j)
+        is_prefix = unique_rows[j] == j;
+    if (is_prefix) {
+        rows.inputs = inputs;
+        return unique_rows.size();
     }
-};
 
-void DNN::getTopClasses( tensorflow::Tensor &classes, const size_t batch_size, const size_t n_top, tensorflow::Tensor *indices, tensorflow::Tensor *scores)
-{
-    std::priority_queue< std::pair<float, size_t>, std::vector<std::pair<float, size_t> >, ComparisonClassTopK > queue;
-
-    lg->debug("CPU-TopK: Classes: x={}, y={}, Indices: x={}, y={}", classes.dim_size(0), classes.dim_size(1), indices->dim_size(0), indices->dim_size(1));
-    lg->debug("classes : {}", classes.DebugString());
-    lg->debug("indicies: {}", indices->DebugString());
-    lg->debug("scores  : {}", scores->DebugString());
-
-    size_t n_cls = static_cast<size_t>(classes.dim_size(1));
-    TensorWrap2d<float> cls_dat(classes);
-    TensorWrap2d<int32> res_ind(*indices);
-    TensorWrap2d<float> res_scores(*scores);
-    for (size_t i=0; i<batch_size; i++) {
-
-        float *p = cls_dat.example(i);
-        for (size_t j=0; j<n_cls; ++j, ++p) {
-            if (queue.size()<n_top || *p > queue.top().first) {
-                if (queue.size() == n_top)
-                    queue.pop();
-                queue.push( std::pair<float, size_t>(*p,j));
-            }
-        }
-        // write back results... and empty the queue
-        int j=0;
-        while( !queue.empty() ) {
-            res_ind.example(i)[j] = static_cast<tensorflow::int32>(queue.top().second); // the index
-            res_scores.example(i)[j] = queue.top().first; // the score
-            queue.pop();
-            ++j;
+    // copy the inputs of the unique examples
+    rows.inputs.clear();
+    rows.buffers.clear();
+    for (const auto &t : inputs) {
+        if (t.shape.empty()) {
+            rows.inputs.push_back(t); // scalar
+            continue;
         }
+        size_t row_bytes = InputTensorItem::datatypeSize(t.type);
+        for (size_t d=1; d<t.shape.size(); ++d)
+            row_bytes *= static_cast<size_t>(t.shape[d]);
+        AlignedBuffer *buffer = new AlignedBuffer(std::max(unique_rows.size(), size_t(1)) * row_bytes);
+        rows.buffers.push_back(std::unique_ptr<AlignedBuffer>(buffer));
+        char *dest = static_cast<char*>(buffer->data());
+        const char *src = static_cast<const char*>(t.data);
+        for (size_t j=0; j<unique_rows.size(); ++j)
+            std::memcpy(dest + j*row_bytes, src + unique_rows[j]*row_bytes, row_bytes);
+        std::vector<int64_t> shape = t.shape;
+        shape[0] = static_cast<int64_t>(unique_rows.size());
+        rows.inputs.push_back(TensorView(t.name, t.type, shape, buffer->data()));
+    }
+    return unique_rows.size();
+}
 
+bool DNN::verifyOutputs(const std::vector<TensorView> &inputs, size_t n_rows, const InferenceOutput &outputs)
+{
+    std::unique_ptr<InferenceOutput> ref;
+    try {
+        ref = mReference->run(inputs, n_rows);
+    } catch (const std::exception &e) {
+        lg->error("Verification of DNN results: error running the reference backend: {}", e.what());
+        return false;
     }
-    if (lg->should_log(spdlog::level::trace)) {
-        // output details for the first example.....
-        lg->trace("Top-K-calculation (CPU):");
-        std::stringstream s;
-        for (size_t i=0;i<n_cls;++i)
-            s << cls_dat.example(0)[i] << ", ";
-
-        lg->trace("{}", s.str());
-        for (size_t i=0;i<n_top;++i) {
-            lg->trace("Index: {}, Score: {} %", res_ind.example(0)[i], res_scores.example(0)[i]*100.f);
+    // compare the two main outputs (state and residence time)
+    for (size_t i=0; i<2; ++i) {
+        TensorView a = outputs.output(i);
+        TensorView b = ref->output(i);
+        if (a.shape != b.shape) {
+            lg->error("Verification of DNN results: output {} has different shapes.", i);
+            return false;
+        }
+        size_t n = 1;
+        for (auto d : a.shape)
+            n *= static_cast<size_t>(d);
+        const float *pa = static_cast<const float*>(a.data);
+        const float *pb = static_cast<const float*>(b.data);
+        double max_diff = 0.;
+        for (size_t j=0; j<n; ++j)
+            max_diff = std::max(max_diff, static_cast<double>(std::fabs(pa[j] - pb[j])));
+        lg->info("Verification of DNN results (DNN #{}, output '{}', {} examples): max. difference: {}", mIndex, mOutputTensorNames[i], n_rows, max_diff);
+        if (max_diff > mVerifyTolerance) {
+            lg->error("Verification of DNN results: the difference ({}) exceeds the tolerance (dnn.verifyTolerance: {}).", max_diff, mVerifyTolerance);
+            return false;
         }
     }
-
+    return true;
 }
 
 // choose randomly a value in *values (length=n), return the index.
@@ -778,88 +651,3 @@ int DNN::chooseProbabilisticIndex(float *values, int n, int skip_index)
     return n-1;
 }
 
-
-void DNN::dumpTensorInfo(tensorflow::GraphDef &graph_def, std::string name_tensor)
-{
-
-    int node_count = graph_def.node_size();
-    for (int i=0;i<node_count;++i) {
-        //graph_def.node(i).PrintDebugString();
-        //lg->trace("{}", graph_def.node(i).PrintDebugString());
-    }
-    /*int node_count = graph_def.node_size();
-    for (int i = 0; i < node_count; i++)
-    {
-            auto n = graph_def.node(i);
-            lg->trace("Layer: {}", n.name());
-            //cout<<"Names : "<< n.name() <<endl;
-
-    }
-
-    /*for (int i=0; i < graph_def.node_size(); ++i) {
-        if (graph_def.node(i).name() != name_tensor) {
-            lg->trace("Tensor: '{}'", graph_def.node(i).name());
-
-            /*
-            auto node = graph_def.node(i);
-            auto attr_map = node.attr();
-            for (auto it=attr_map.begin(); it != attr_map.end(); it++) {
-                auto key = it->first;
-                auto value = it->second;
-                if (value.has_shape()) {
-                    auto shape = value.shape();
-                    for (int i=0; i<shape.dim_size(); ++i) {
-                        auto dim = shape.dim(i);
-                        auto dim_size = dim.size();
-
-                        //lg->trace("Shape {}: dim-size: {}", i, dim_size);
-                        //tensor_shape.push_back(dim_size);
-                    }
-                }
-            }
-            * /
-        }
-    } */
-
-}
-
-#else
-// dummy versions for non-Tensorflow-build
-
-std::list<InputTensorItem> DNN::mTensorDef; // static def
-
-DNN::DNN()
-{
-    if (spdlog::get("dnn"))
-        spdlog::get("dnn")->debug("DNN created: {}", static_cast<void*>(this));
-
-}
-
-DNN::~DNN()
-{
-
-}
-
-bool DNN::setupDNN(size_t aindex)
-{
-    return true;
-}
-
-void DNN::setupInput()
-{
-
-}
-
-void DNN::setupBatch(Batch *abatch, std::vector<TensorWrapper *> &tensors)
-{
-    throw std::logic_error("Setting up a DNN batch is not possible with the NON-Tenorflow version!");
-
-}
-
-Batch *DNN::run(Batch *abatch)
-{
-    throw std::logic_error("Running a DNN batch is not possible with the NON-Tenorflow version!");
-}
-
-#endif
-
@@ -22,18 +22,15 @@
 #undef SWIG
 
 #include "spdlog/spdlog.h"
-namespace tensorflow { // forward declarations...
-class Session;
-class Tensor;
-//class Status;
-class Input;
-class GraphDef;
-}
 class Batch; // forward
+class BatchDNN; // forward
 
 #include "inputtensoritem.h"
 #include "tensorhelper.h"
+#include "inferencecache.h"
 #include <list>
+#include <memory>
+#include <atomic>
 
 class DNN
 {
@@ -42,7 +39,7 @@ public:
     ~DNN();
     size_t index() const {return mIndex; }
 
-    /// set up the actual DNN (TensorFlow)
+    /// set up the actual DNN (load the network with the inference backend, `dnn.backend`)
     bool setupDNN(size_t aindex);
 
     /// set up the links to the main model
@@ -66,23 +63,31 @@ private:
 
     // DNN specifics
     size_t mIndex; ///< internal number of the DNN
-    bool mDummyDNN; ///< if true, then the tensorflow components are not really used (for debug builds)
-
-    bool mTopK_tf; ///< use tensorflow for the state top k calculation
+    bool mDummyDNN; ///< if true, then the inference backend is not really used (for debug builds)
+    std::unique_ptr<InferenceBackend> mBackend; ///< the runtime that executes the network
+    std::unique_ptr<InferenceBackend> mReference; ///< a second backend to verify the results (`dnn.verifyBackend`)
+    std::atomic<int> mVerifyBatches; ///< number of batches still to verify against mReference
+    double mVerifyTolerance; ///< max. allowed absolute difference of the outputs of mBackend and mReference
+    /// compare the outputs with the outputs of the reference backend; returns false if the difference is too large
+    bool verifyOutputs(const std::vector<TensorView> &inputs, size_t n_rows, const InferenceOutput &outputs);
+
+    /// the examples of a batch that need to run through the DNN (if the inference cache is enabled)
+    struct CachedRows {
+        std::vector<int> source; ///< output row for each example (-1: result from the cache, or an empty slot)
+        std::vector<bool> first; ///< true for the first example with a signature (the result is stored in the cache)
+        std::vector<InferenceCache::Key> keys; ///< input signature of each example
+        std::vector< std::unique_ptr<AlignedBuffer> > buffers; ///< memory for the inputs of the unique examples
+        std::vector<TensorView> inputs; ///< inputs of the unique examples
+    };
+    /// look up the examples of the batch in the cache, and collect the inputs of the examples with unknown signatures
+    /// in `rows`. Returns the number of examples that need to run through the DNN.
+    size_t lookupCache(BatchDNN *batch, const std::vector<TensorView> &inputs, size_t n_rows, CachedRows &rows);
+
+    bool mTopK_tf; ///< use the backend (e.g. tensorflow on the GPU) for the state top k calculation (if supported)
     size_t mTopK_NClasses; ///< number of classes used for the top k algorithm
     std::vector<std::string> mOutputTensorNames; ///< names of the output tensors (e.g. output/Softmax)
     size_t mNStateCls; ///< number of output classes for state
     size_t mNResTimeCls; ///< number of classes for residence time
-    tensorflow::Status getTopClassesOldCode(const tensorflow::Tensor &classes, const int n_top, tensorflow::Tensor *indices, tensorflow::Tensor *scores);
-
-    /// retrieve the top n classes in "classes" and store results in 'indices' and 'scores'.
-    /// this function uses CPU (and not tensorflow)
-    void getTopClasses(tensorflow::Tensor &classes, const size_t batch_size, const size_t n_top, tensorflow::Tensor *indices, tensorflow::Tensor *scores);
-    tensorflow::Session *session;
-    tensorflow::Session *top_k_session;
-
-    tensorflow::Status loadGraph(std::string graph_file_name, tensorflow::Session* session);
-    void dumpTensorInfo(tensorflow::GraphDef &graph_def, std::string name_tensor);
 
     /// select randomly an index 0..n-1, with values the weights.
     int chooseProbabilisticIndex(float *values, int n, int skip_index=-1);
@@ -19,39 +19,42 @@
 #include "dnnshell.h"
 
 #include <QThread>
-#include <QMetaType>
 #include <QCoreApplication>
-#include <QtConcurrent>
-#include <QFutureWatcher>
 
 #include "inferencedata.h"
 #include "randomgen.h"
 #include "model.h"
 #include "batch.h"
 #include "batchmanager.h"
+#include "inferencepipeline.h"
+#include "inferencecache.h"
+#include "batchrecorder.h"
 #include "dnn.h"
+#include "tools.h"
 
+#ifdef USE_TENSORFLOW
 #include <tensorflow/core/public/version.h>
+#endif
 
 DNNShell::DNNShell()
 {
-    mThreads = new QThreadPool();
 }
 
 DNNShell::~DNNShell()
 {
+    // stop the worker threads before the DNNs are deleted
+    mPipeline.reset();
     delete_and_clear(mDNNs);
-    delete mThreads;
+    mCache.reset();
+    mRecorder.reset();
 
 }
 
 
 void DNNShell::setup(QString fileName)
 {
-    mBatchesProcessed = 0;
-    mCellsProcessed = 0;
-    mProcessing = 0;
-    mExecutionCount = 0;
+    mPipeline.reset();
+    mRecorder.reset();
 
     // setup is called *after* the set up of the main model
     lg = spdlog::get("dnn");
@@ -106,99 +109,70 @@ void DNNShell::setup(QString fileName)
         return;
     }
     int n_threads = Model::instance()->settings().valueInt("dnn.threads", -1);
-    if (n_threads>-1) {
-        mThreads->setMaxThreadCount(n_threads);
+    if (n_threads<1)
+        n_threads = QThread::idealThreadCount();
+    else
         lg->debug("setting DNN threads to {}.", n_threads);
-    }
-    lg->debug("Thread pool for DNN: using {} threads.", mThreads->maxThreadCount());
-
-    RunState::instance()->dnnState()=ModelRunState::ReadyToRun;
-
-
-}
-
-void DNNShell::doWork(Batch *batch)
-{
 
-    RunState::instance()->dnnState() = ModelRunState::Running;
-
-    if (RunState::instance()->cancel()) {
-        batch->setError(true);
-        //RunState::instance()->dnnState()=ModelRunState::Stopping; // TODO: main
-        Q_EMIT workDone(batch);
-        return;
+    mCache.reset();
+    if (Model::instance()->settings().valueBool("dnn.cache.enabled", "false")) {
+        const auto &settings = Model::instance()->settings();
+        mCache = std::unique_ptr<InferenceCache>(new InferenceCache(settings.valueUInt("dnn.topKNClasses", 10),
+                                                                    settings.valueUInt("dnn.restime.N", 10),
+                                                                    settings.valueUInt("dnn.cache.maxEntries", 1000000)));
+        lg->info("Inference cache enabled (max. {} entries).", settings.valueUInt("dnn.cache.maxEntries", 1000000));
     }
-    if (mDNNs.size()==0) {
-        lg->error("Cannot execute DNN batch because no DNN is available!");
-        RunState::instance()->dnnState() = ModelRunState::Error;
-        batch->setError(true);
-        Q_EMIT workDone(batch);
-        return;
-    }
-
-
-    if (batch->state()!=Batch::Fill)
-        lg->error("Batch {} [{}] is in the wrong state {}, size: {}", batch->packageId(), static_cast<void*>(batch), batch->state(), batch->usedSlots());
-
-    batch->changeState(Batch::DNNInference);
-    mProcessing++;
-    lg->debug("DNNShell: received package {}. Starting DNN (batch: {}, state: {}, active threads now: {}, #processing: {}) ", batch->packageId(), static_cast<void*>(batch), batch->state(), mThreads->activeThreadCount(), mProcessing);
-
-    QtConcurrent::run( mThreads,
-                       [](DNNShell *shell, Batch *batch, DNN *dnn){
-                            dnn->run(batch);
-
-                            if (!QMetaObject::invokeMethod(shell, "dnnFinished", Qt::QueuedConnection,
-                                                           Q_ARG(void*, static_cast<void*>(batch))) ) {
-                                batch->setError(true);
-                            }
-                        }, this, batch, mDNNs[mExecutionCount++ % mDNNs.size()]);
-}
 
-void DNNShell::dnnFinished(void *vbatch)
-{
-    Batch * batch = static_cast<Batch*>(vbatch);
-    mProcessing--;
-    // get the batch from the future watcher
-    //Batch *batch = getFinishedBatch();
-    //QFutureWatcher<Batch*> *watcher = static_cast< QFutureWatcher<Batch*> * >(sender());
-    if (!batch) {
-        RunState::instance()->setError("Error in DNN (no watcher)", RunState::instance()->dnnState());
-        return;
+    std::string record_file = Model::instance()->settings().valueString("dnn.record.file", "");
+    if (!record_file.empty()) {
+        const auto &settings = Model::instance()->settings();
+        try {
+            mRecorder = std::unique_ptr<BatchRecorder>(new BatchRecorder(Tools::path(record_file),
+                                                                         Tools::path(settings.valueString("dnn.file")),
+                                                                         { settings.valueString("dnn.state.name"), settings.valueString("dnn.restime.name") },
+                                                                         DNN::tensorDefinition(),
+                                                                         settings.valueUInt("dnn.record.maxBatches", 0)));
+        } catch (const std::exception &e) {
+            RunState::instance()->dnnState()=ModelRunState::ErrorDuringSetup;
+            lg->error("An error occurred during setup of the batch recorder: {}", e.what());
+            return;
+        }
+        lg->info("Recording the inputs of the DNN to '{}'.", Tools::path(record_file));
     }
 
-
-    if (batch->hasError()) {
-        RunState::instance()->setError("Error in DNN", RunState::instance()->dnnState());
-        Q_EMIT workDone(batch);
-        QCoreApplication::processEvents();
+    try {
+        mPipeline = std::unique_ptr<InferencePipeline>(new InferencePipeline(mDNNs, static_cast<size_t>(n_threads), mBatchManager->maxQueueLength()));
+        mBatchManager->setInferenceThreads(static_cast<size_t>(n_threads));
+        if (mBatchManager->isAdaptive()) {
+            BatchManager *bm = mBatchManager.get();
+            mPipeline->setIdleCallback([bm]() { bm->flushOnIdle(); });
+        }
+        mPipeline->start();
+    } catch (const std::exception &e) {
+        RunState::instance()->dnnState()=ModelRunState::ErrorDuringSetup;
+        lg->error("An error occurred during setup of the inference pipeline: {}", e.what());
         return;
     }
+    lg->debug("Inference pipeline for DNN: using {} threads.", n_threads);
 
-    lg->debug("DNNShell: dnn finished, package {}, {} cells. Sending to main.", batch->packageId(), batch->usedSlots());
-
-    mBatchesProcessed++;
-    mCellsProcessed += batch->usedSlots();
-
-    batch->changeState(Batch::Finished);
-
-    lg->debug("finished data package {} [{}] (size={})", batch->packageId(), static_cast<void*>(batch), batch->usedSlots());
-
-    //dumpObjectInfo();
-    Q_EMIT workDone(batch);
-    QCoreApplication::processEvents();
-
-    if (!isRunnig())
-        RunState::instance()->dnnState() = ModelRunState::ReadyToRun;
+    RunState::instance()->dnnState()=ModelRunState::ReadyToRun;
 
 
 }
 
+bool DNNShell::isRunnig()
+{
+    return mPipeline && mPipeline->isRunning();
+}
 
+size_t DNNShell::batchesProcessed() const
+{
+    return mPipeline ? mPipeline->batchesProcessed() : 0;
+}
 
-bool DNNShell::isRunnig()
+size_t DNNShell::cellsProcessed() const
 {
-    return mProcessing > 0;
+    return mPipeline ? mPipeline->cellsProcessed() : 0;
 }
 
 const char *DNNShell::tensorFlowVersion()
@@ -20,8 +20,6 @@
 #define DNNSHELL_H
 
 #include <QObject>
-#include <QFutureWatcher>
-#include <QThreadPool>
 #include "spdlog/spdlog.h"
 
 #include "modelrunstate.h"
@@ -30,6 +28,9 @@ class InferenceData; // forward
 class Batch; // forward
 class DNN; // forward
 class BatchManager; // forward
+class InferencePipeline; // forward
+class InferenceCache; // forward
+class BatchRecorder; // forward
 
 class DNNShell: public QObject
 {
@@ -39,36 +40,27 @@ public:
     ~DNNShell();
 
     bool isRunnig();
-    size_t batchesProcessed() const { return mBatchesProcessed; }
-    size_t cellsProcessed() const { return mCellsProcessed; }
+    size_t batchesProcessed() const;
+    size_t cellsProcessed() const;
     static const char *tensorFlowVersion();
 
 private:
 public Q_SLOTS:
     void setup(QString fileName);
-    void doWork(Batch *batch);
-
-    void dnnFinished(void *vbatch);
-Q_SIGNALS:
-    void workDone(Batch *batch);
 
 private:
-    /// thread pool for running the DNN
-    QThreadPool *mThreads;
-
     // loggers
     std::shared_ptr<spdlog::logger> lg;
 
     std::unique_ptr<BatchManager> mBatchManager;
     //std::unique_ptr<DNN> mDNN;
     std::vector<DNN *> mDNNs;
-    std::atomic<size_t> mExecutionCount;
-    std::atomic<int> mProcessing;
-
-    // store a watcher and a flag if the watcher is used (=true) or free (false)
-    //std::vector<std::pair<QFutureWatcher<Batch*>*, Batch*> > mWatchers;
-    size_t mBatchesProcessed;
-    size_t mCellsProcessed;
+    /// worker threads that run the DNN(s)
+    std::unique_ptr<InferencePipeline> mPipeline;
+    /// results of the DNN for known inputs (if enabled)
+    std::unique_ptr<InferenceCache> mCache;
+    /// writes the inputs of all batches to a file (if enabled)
+    std::unique_ptr<BatchRecorder> mRecorder;
 
 };
 
@@ -19,6 +19,7 @@
 #include "fetchdata.h"
 
 #include <regex>
+#include <cstring>
 
 #include "model.h"
 #include "tensorhelper.h"
@@ -37,6 +38,12 @@ void FetchData::fetch(Cell * /* cell */, BatchDNN* /*batch */, size_t /* slot */
 {
 }
 
+void FetchData::fetchBatch(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch)
+{
+    for (size_t i=0;i<n;++i)
+        fetch(cells[i], batch, slots[i]);
+}
+
 FetchData *FetchData::createFetchObject(InputTensorItem *def)
 {
     FetchData *f=nullptr;
@@ -125,6 +132,11 @@ void FetchDataStandard::setup(const Settings * /*settings*/, const std::string &
             throw logic_error_fmt("Input ResidenceTime: invalid data type '{}', allowed data types are: uint16, int16, int32", InputTensorItem::datatypeString(item.type));
         return;
 
+    // species shares of the neighbors: calculated once per year for all due cells
+    case InputTensorItem::Neighbors:
+        Model::instance()->landscape()->speciesNeighbors().setEnabled(true);
+        return;
+
 
 
 
@@ -135,176 +147,208 @@ void FetchDataStandard::setup(const Settings * /*settings*/, const std::string &
 
 void FetchDataStandard::fetch(Cell *cell, BatchDNN *batch, size_t slot)
 {
+    fetchBatch(&cell, &slot, 1, batch);
+}
+
+void FetchDataStandard::fetchBatch(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch)
+{
+    // the content type is resolved once per batch, the functions below loop over all cells
     switch (mItem->content) {
     case InputTensorItem::Climate:
-        fetchClimate(cell, batch, slot);
+        fetchClimate(cells, slots, n, batch);
         break;
     case InputTensorItem::State:
-        fetchState(cell, batch, slot);
+        fetchState(cells, slots, n, batch);
         break;
     case InputTensorItem::StateHistory:
-        fetchStateHistory(cell, batch, slot);
+        fetchStateHistory(cells, slots, n, batch);
         break;
 
     case InputTensorItem::ResidenceTime:
-        fetchResidenceTime(cell, batch, slot);
+        fetchResidenceTime(cells, slots, n, batch);
         break;
     case InputTensorItem::ResTimeHistory:
-        fetchResTimeHistory(cell, batch, slot);
+        fetchResTimeHistory(cells, slots, n, batch);
         break;
     case InputTensorItem::SiteNPKA:
-        fetchSite(cell, batch, slot);
+        fetchSite(cells, slots, n, batch);
         break;
     case InputTensorItem::Neighbors:
-        fetchNeighbors(cell, batch, slot);
+        fetchNeighbors(cells, slots, n, batch);
         break;
     case InputTensorItem::Scalar:
         // a scalar is already set to the correct value.
         break;
     case InputTensorItem::DistanceOutside:
-        fetchDistanceOutside(cell, batch, slot);
+        fetchDistanceOutside(cells, slots, n, batch);
         break;
 
     default:
-        throw std::logic_error("InferenceData::fetchData: invalid content type.");
+        throw std::logic_error("FetchDataStandard::fetchBatch: invalid content type.");
 
     }
 
 }
 
+// number of cells the loops below look ahead
+static const size_t PrefetchDistance = 4;
+/// hint the CPU to load the data of the cell `cells[i+PrefetchDistance]` (if available)
+static inline void prefetchCell(Cell * const *cells, size_t i, size_t n)
+{
+#if defined(__GNUC__)
+    if (i + PrefetchDistance < n)
+        __builtin_prefetch(cells[i + PrefetchDistance]);
+#else
+    (void)cells; (void)i; (void)n;
+#endif
+}
+
+/// fill a column with a single value per example. `value` is called for each cell.
+template<typename T, typename F>
+static inline void fillColumn(TensorWrapper *t, Cell * const *cells, const size_t *slots, size_t n, F value)
+{
+    TensorWrap2d<T> *tw = static_cast<TensorWrap2d<T>*>(t);
+    T *data = static_cast<T*>(tw->data());
+    const size_t stride = tw->n();
+    for (size_t i=0;i<n;++i) {
+        prefetchCell(cells, i, n);
+        data[slots[i]*stride] = static_cast<T>(value(cells[i]));
+    }
+}
 
 
-void FetchDataStandard::fetchClimate(Cell *cell, BatchDNN* batch, size_t slot)
+void FetchDataStandard::fetchClimate(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch)
 {
 
-    // the climate data
-    const auto &ec = cell->environment();
-    auto climate_series = Model::instance()->climate()->series(Model::instance()->year(),
-                                                               mItem->sizeX,
-                                                               ec->climateId());
+    // the climate data: the series of all cells with the same climateId are assembled once per year
     auto n_values = Model::instance()->climate()->nDNNcolumns();
+    if (n_values != mItem->sizeY)
+        throw logic_error_fmt("FetchDataStandard::fetchClimate: mismatch in dimensions: expected '{}' columns, got '{}' columns (per year)!",
+                              mItem->sizeY, n_values);
 
     TensorWrapper *t = batch->tensor(mItem->index);
     TensorWrap3d<float> *tw = static_cast<TensorWrap3d<float>*>(t);
-
-
-    if (climate_series.size() == 0 || climate_series.size() != mItem->sizeX || n_values != mItem->sizeY)
-        throw logic_error_fmt("FetchDataStandard::fetchClimate: mismatch in dimensions: expected '{}', got '{}' years (rows); expected '{}' columns, got '{}' columns (per year)!",
-                              mItem->sizeX, climate_series.size(),
-                              mItem->sizeY, n_values);
-
-    if (climate_series[0]->size() < n_values)
-        throw logic_error_fmt("FetchDataStandard::fetchClimate: inconsistent climate variables. Number of values for DNN: {}, total number of values {}.", n_values, climate_series[0]->size());
-
-    // copy the climate data to the tensors
-    // Note that data transformations are applied already during loading of climate data
-    size_t i = 0;
-    for (const std::vector<float> *p : climate_series) {
-        float *d = tw->row(slot, i++);
-        memcpy(d, p->data(), sizeof(float) * n_values);
+    const int year = Model::instance()->year();
+    const size_t n_bytes = sizeof(float) * mItem->sizeX * n_values;
+
+    // neighboring cells share mostly the same climate: look up the block only if the climateId changes
+    int last_id = -1;
+    const float *block = nullptr;
+    for (size_t i=0;i<n;++i) {
+        prefetchCell(cells, i, n);
+        int climate_id = cells[i]->environment()->climateId();
+        if (climate_id != last_id || !block) {
+            block = Model::instance()->climate()->seriesBlock(year, mItem->sizeX, climate_id);
+            last_id = climate_id;
+        }
+        // copy the climate data to the tensors (a single block)
+        // Note that data transformations are applied already during loading of climate data
+        memcpy(tw->example(slots[i]), block, n_bytes);
     }
 
 }
 
-void FetchDataStandard::fetchState(Cell *cell, BatchDNN* batch, size_t slot)
+void FetchDataStandard::fetchState(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch)
 {
     // the current state
     TensorWrapper *t = batch->tensor(mItem->index);
-    if (t->dataType() == InputTensorItem::DT_UINT16) {
-        TensorWrap2d<short int> *tw = static_cast<TensorWrap2d<short int>*>(t);
-        short int *p = tw->example(slot);
-        // stateId starts with 1, the state tensor is 0-based
-        *p = cell->stateId(); // TODO: check!
+    auto state_id = [](const Cell *c) { return c->stateId(); };
+    switch (t->dataType()) {
+    case InputTensorItem::DT_UINT16:
+    case InputTensorItem::DT_INT16:
+        fillColumn<short int>(t, cells, slots, n, state_id);
         return;
-    }
-    if (t->dataType() == InputTensorItem::DT_INT16) {
-        TensorWrap2d<short int> *tw = static_cast<TensorWrap2d<short int>*>(t);
-        short int *p = tw->example(slot);
-        // stateId starts with 1, the state tensor is 0-based
-        *p = cell->stateId();
-        return;
-    }
-
-    if (t->dataType() == InputTensorItem::DT_INT32) {
-        TensorWrap2d<int32_t> *tw = static_cast<TensorWrap2d<int32_t>*>(t);
-        int32_t *p = tw->example(slot);
-        // stateId starts with 1, the state tensor is 0-based
-        *p = cell->stateId();
+    case InputTensorItem::DT_INT32:
+        fillColumn<int32_t>(t, cells, slots, n, state_id);
         return;
+    default:
+        throw logic_error_fmt("FetchDataStandard:fetchState: invalid data type (allowed: uint16, int16, int32){}", "");
     }
-    throw logic_error_fmt("FetchDataStandard:fetchState: invalid data type (allowed: uint16, int16, int32){}", "");
 
 }
 
-void FetchDataStandard::fetchResidenceTime(Cell *cell, BatchDNN* batch, size_t slot)
+void FetchDataStandard::fetchResidenceTime(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch)
 {
-    TensorWrapper *t = batch->tensor(mItem->index);
-    TensorWrap2d<float> *tw = static_cast<TensorWrap2d<float>*>(t);
-    float *p = tw->example(slot);
     // TODO: residence time, now fixed divide by 10
-    *p = static_cast<float>(cell->residenceTime() / 10.f);
+    fillColumn<float>(batch->tensor(mItem->index), cells, slots, n,
+                      [](const Cell *c) { return c->residenceTime() / 10.f; });
 }
 
-void FetchDataStandard::fetchStateHistory(Cell *cell, BatchDNN *batch, size_t slot)
+void FetchDataStandard::fetchStateHistory(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch)
 {
     TensorWrapper *t = batch->tensor(mItem->index);
     TensorWrap2d<state_t> *tw = static_cast<TensorWrap2d<state_t>*>(t);
-    const state_t *state_history = cell->stateHistory();
-    state_t *p = tw->example(slot);
-    for (size_t i = 0; i<cell->historySize(); ++i) {
-        *p++ = *state_history++;
+    const size_t n_bytes = sizeof(state_t) * Cell::historySize();
+    for (size_t i=0;i<n;++i) {
+        prefetchCell(cells, i, n);
+        memcpy(tw->example(slots[i]), cells[i]->stateHistory(), n_bytes);
     }
 }
 
-void FetchDataStandard::fetchResTimeHistory(Cell *cell, BatchDNN *batch, size_t slot)
+void FetchDataStandard::fetchResTimeHistory(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch)
 {
     TensorWrapper *t = batch->tensor(mItem->index);
     TensorWrap2d<float> *tw = static_cast<TensorWrap2d<float>*>(t);
-    const restime_t *state_history = cell->resTimeHistory();
-    float *p = tw->example(slot);
-    for (size_t i = 0; i<cell->historySize(); ++i) {
-        *p++ = *state_history / 10.f; // divide by 10
-        state_history++;
+    const size_t n_hist = Cell::historySize();
+    for (size_t i=0;i<n;++i) {
+        prefetchCell(cells, i, n);
+        const restime_t *history = cells[i]->resTimeHistory();
+        float *p = tw->example(slots[i]);
+        for (size_t j=0; j<n_hist; ++j)
+            p[j] = history[j] / 10.f; // divide by 10
     }
 }
 
 
-void FetchDataStandard::fetchNeighbors(Cell *cell, BatchDNN* batch, size_t slot)
+void FetchDataStandard::fetchNeighbors(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch)
 {
     const size_t n_neighbors = 62; // 2x32
     TensorWrapper *t = batch->tensor(mItem->index);
     TensorWrap2d<float> *tw = static_cast<TensorWrap2d<float>*>(t);
-    float *p = tw->example(slot);
 
-    auto neighbors = cell->neighborSpecies();
-    if (neighbors.size() != n_neighbors)
-        throw std::logic_error("Invalid number of neighbors...");
+    // the values are calculated at the start of the year for all due cells (see SpeciesNeighbors)
+    const SpeciesNeighbors &sn = Model::instance()->landscape()->speciesNeighbors();
+    for (size_t i=0;i<n;++i) {
+        float *p = tw->example(slots[i]);
+        if (const float *values = sn.values(cells[i])) {
+            if (sn.valuesPerCell() != n_neighbors)
+                throw std::logic_error("Invalid number of neighbors...");
+            std::memcpy(p, values, n_neighbors * sizeof(float));
+            continue;
+        }
+        // cells that were not due at the start of the year
+        auto neighbors = cells[i]->neighborSpecies();
+        if (neighbors.size() != n_neighbors)
+            throw std::logic_error("Invalid number of neighbors...");
 
-    for (size_t i=0;i<n_neighbors;++i)
-        *p++ = static_cast<float>(neighbors[i]);
+        for (size_t j=0;j<n_neighbors;++j)
+            p[j] = static_cast<float>(neighbors[j]);
+    }
 
 }
 
-void FetchDataStandard::fetchSite(Cell *cell, BatchDNN* batch, size_t slot)
+void FetchDataStandard::fetchSite(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch)
 {
     TensorWrapper *t = batch->tensor(mItem->index);
     TensorWrap2d<float> *tw = static_cast<TensorWrap2d<float>*>(t);
-    float *p = tw->example(slot);
-    // site: nitrogen/soil-depth
-    const auto &ec = cell->environment();
-    // TODO: transformation...
-    *p++ = static_cast<float>( (ec->value(static_cast<size_t>(i_nitrogen)) -58.500)/41.536 );
-    *p++ = static_cast<float>( (ec->value(static_cast<size_t>(i_soildepth))-58.500)/41.536 );
+    const size_t i_n = static_cast<size_t>(i_nitrogen);
+    const size_t i_s = static_cast<size_t>(i_soildepth);
+    for (size_t i=0;i<n;++i) {
+        prefetchCell(cells, i, n);
+        float *p = tw->example(slots[i]);
+        // site: nitrogen/soil-depth
+        const auto &ec = cells[i]->environment();
+        // TODO: transformation...
+        p[0] = static_cast<float>( (ec->value(i_n) -58.500)/41.536 );
+        p[1] = static_cast<float>( (ec->value(i_s)-58.500)/41.536 );
+    }
 }
 
-void FetchDataStandard::fetchDistanceOutside(Cell *cell, BatchDNN* batch, size_t slot)
+void FetchDataStandard::fetchDistanceOutside(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch)
 {
-    TensorWrapper *t = batch->tensor(mItem->index);
-    TensorWrap2d<float> *tw = static_cast<TensorWrap2d<float>*>(t);
-    float *p = tw->example(slot);
-    const auto &ec = cell->environment();
-
-    *p = static_cast<float>( ec->value(static_cast<size_t>(i_distance)) );
+    const size_t i_d = static_cast<size_t>(i_distance);
+    fillColumn<float>(batch->tensor(mItem->index), cells, slots, n,
+                      [i_d](const Cell *c) { return c->environment()->value(i_d); });
 
 }
 
@@ -347,13 +391,20 @@ void FetchDataVars::setup(const Settings *settings, const std::string &key, cons
 }
 
 void FetchDataVars::fetch(Cell *cell, BatchDNN *batch, size_t slot)
+{
+    fetchBatch(&cell, &slot, 1, batch);
+}
+
+void FetchDataVars::fetchBatch(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch)
 {
     TensorWrapper *t = batch->tensor(mItem->index);
     TensorWrap2d<float> *tw = static_cast<TensorWrap2d<float>*>(t);
-    float *p = tw->example(slot);
-    CellWrapper cw(cell);
-    for (auto &expr : mExpressions) {
-        *p++ = static_cast<float>( expr->calculate(cw) );
+    for (size_t i=0;i<n;++i) {
+        float *p = tw->example(slots[i]);
+        CellWrapper cw(cells[i]);
+        for (auto &expr : mExpressions) {
+            *p++ = static_cast<float>( expr->calculate(cw) );
+        }
     }
 
 }
@@ -384,27 +435,29 @@ void FetchDataFunction::setup(const Settings *settings, const std::string &key,
 }
 
 void FetchDataFunction::fetch(Cell *cell , BatchDNN *batch, size_t slot)
+{
+    fetchBatch(&cell, &slot, 1, batch);
+}
+
+void FetchDataFunction::fetchBatch(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch)
 {
     TensorWrapper *t = batch->tensor(mItem->index);
     TensorWrap2d<float> *tw = static_cast<TensorWrap2d<float>*>(t);
-    float *p = tw->example(slot);
 
-    float value;
     switch (mFn) {
     case DistToSeedSource:
-        value = calculateDistToSeedSource(cell);
-        break;
-    case SimpleManagement: {
-        float rActivity, rTime;
-        calculateSimpleManagement(cell, rActivity, rTime);
-        *p++ = rActivity;
-        *p = rTime;
+        for (size_t i=0;i<n;++i)
+            *tw->example(slots[i]) = calculateDistToSeedSource(cells[i]);
+        return;
+    case SimpleManagement:
+        for (size_t i=0;i<n;++i) {
+            float *p = tw->example(slots[i]);
+            calculateSimpleManagement(cells[i], p[0], p[1]);
+        }
         return;
-    }
     default:
         throw logic_error_fmt("FetchDataFunction: invalid Function: {}.", mFn );
     }
-    *p = value;
 
 }
 
@@ -415,59 +468,42 @@ void FetchDataFunction::setupDisttoSeedSource()
         throw std::logic_error("The 'DistToSeedSource' function requires the state properties 'seedSourceType' and 'seedTargetType'.");
     mD2S_seed_source = static_cast<size_t>(State::valueIndex("seedSourceType"));
     mD2S_target = static_cast<size_t>(State::valueIndex("seedTargetType"));
-}
 
+    // a distance raster for each type of seed source (updated every year, see DistanceFields)
+    mD2S_layers.clear();
+    const size_t seed_source = mD2S_seed_source;
+    for (const auto &s : Model::instance()->states()->states()) {
+        size_t source_type = static_cast<size_t>(s.value(seed_source));
+        if (mD2S_layers.find(source_type) != mD2S_layers.end())
+            continue;
+        mD2S_layers[source_type] = Model::instance()->landscape()->distanceFields().addLayer("seed source " + to_string(source_type),
+                               [seed_source, source_type](const Cell &cell) {
+            return cell.state()!=nullptr && static_cast<size_t>(cell.state()->value(seed_source)) == source_type;
+        });
+    }
+}
 
-// distances from center point (X)
-// 4 4 3 4 4
-// 4 2 1 2 4
-// 3 1 X 1 3
-// 4 2 1 2 4
-// 4 4 3 4 4
-// 1..4: distance classes (50m, 100m, 150m, 200m)
-static std::vector<std::pair<Point, float> > dist2seeds = {
-    {{1,0},50.f }, {{0,1},50.f }, {{-1,0},50.f }, {{0,-1},50.f },  // distances 1
-    {{-1,-1},100.f }, {{1,-1},100.f }, {{-1,1},100.f }, {{1,1},100.f }, // distances 2
-    {{2,0},150.f }, {{0,2},150.f }, {{-2,0},150.f }, {{0, -2},150.f }, // distances 3
-    {{-2,-2},200.f }, {{-1,-2},200.f }, {{1,-2},200.f }, {{2,-2},200.f }, {{-2,-1},200.f }, {{2,-1},200.f }, // distances 4 (upper half)
-    {{-2, 2},200.f }, {{-1, 2},200.f }, {{1, 2},200.f }, {{2, 2},200.f }, {{-2, 1},200.f }, {{2, 1},200.f } // distances 4 (lower half)
-};
 
 float FetchDataFunction::calculateDistToSeedSource(Cell *cell)
 {
     if (cell->state()==nullptr)
         return 0.f;
 
-    auto &grid =  Model::instance()->landscape()->grid();
-
     size_t target = static_cast<size_t>(cell->state()->value(mD2S_target));
-
-    Point center = grid.indexOf(cell->cellIndex());
-
-    for (const auto &p : dist2seeds) {
-        if (grid.isIndexValid(center + p.first)) {
-            GridCell &c = grid.valueAtIndex(center + p.first);
-            if (!c.isNull() && c.cell().state()!=nullptr)
-                if (static_cast<size_t>(c.cell().state()->value(mD2S_seed_source)) == target) {
-                    // found a distance
-                    return p.second / 1000.f;
-                }
-        }
+    auto it = mD2S_layers.find(target);
+    if (it == mD2S_layers.end())
+        return 12.5f / 10.f; // no seed source of this type
+
+    // distance (cells) of the corner of the cell to the nearest seed source (lookup in the distance raster)
+    DistanceFields &fields = Model::instance()->landscape()->distanceFields();
+    float min_dist = DistanceFields::distance(it->second, cell->cellIndex());
+    if (min_dist <= DistanceFields::nearDistance()) {
+        // seed sources in the immediate neighborhood: fixed distances (m) per distance class
+        int near_class = fields.nearSourceClass(it->second, cell->cellIndex());
+        if (near_class > 0)
+            return near_class * 50.f / 1000.f;
     }
-
-    // brute force
-    float min_dist_sq = 100000.f;
-    for (int y=-12; y<=12; ++y)
-        for (int x=-12; x<=12; ++x)
-            if (grid.isIndexValid(center + Point(x,y))) {
-                GridCell &c = grid.valueAtIndex(center + Point(x,y));
-                if (!c.isNull() && c.cell().state()!=nullptr)
-                    if (static_cast<size_t>(c.cell().state()->value(mD2S_seed_source)) == target) {
-                        // found a seed pixel: (x-0.5)*(x-0.5)=x^2-x+0.25
-                        min_dist_sq = std::min(min_dist_sq, x*x-x+0.25f + y*y-y+0.25f);
-                    }
-            }
-    float min_dist = std::min(sqrt(min_dist_sq), 12.5f); // training data goes to 1250m distance, unit here is 100m steps
+    min_dist = std::min(min_dist, 12.5f); // training data goes to 1250m distance, unit here is 100m steps
     return min_dist / 10.f; // convert to m/1000
 
 }
@@ -22,6 +22,9 @@
 #include "inputtensoritem.h"
 #include "expression.h"
 #include "strtools.h"
+#include "distancefields.h"
+
+#include <map>
 
 class Cell; // forward
 class Batch; // forward
@@ -34,7 +37,11 @@ public:
     virtual ~FetchData() { }
     virtual void setup(const Settings *settings, const std::string &key, const InputTensorItem &item);
 
+    /// fetch the data of a single cell into the example `slot` of the batch
     virtual void fetch(Cell *cell, BatchDNN* batch, size_t slot);
+    /// fetch the data for `n` cells (`cells[i]` goes to the example `slots[i]`) into the
+    /// tensor column of the item. The default implementation calls fetch() for each cell.
+    virtual void fetchBatch(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch);
 
     // factory function
     static FetchData *createFetchObject(InputTensorItem *def);
@@ -50,15 +57,17 @@ public:
     FetchDataStandard(InputTensorItem *item) : FetchData(item) {}
     virtual void setup(const Settings *settings, const std::string &key, const InputTensorItem &item);
     virtual void fetch(Cell *cell, BatchDNN *batch, size_t slot);
+    virtual void fetchBatch(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch);
 private:
-    void fetchClimate(Cell *cell, BatchDNN* batch, size_t slot);
-    void fetchState(Cell *cell, BatchDNN *batch, size_t slot);
-    void fetchResidenceTime(Cell *cell, BatchDNN* batch, size_t slot);
-    void fetchStateHistory(Cell *cell, BatchDNN *batch, size_t slot);
-    void fetchResTimeHistory(Cell *cell, BatchDNN *batch, size_t slot);
-    void fetchNeighbors(Cell *cell, BatchDNN* batch, size_t slot);
-    void fetchSite(Cell *cell, BatchDNN* batch, size_t slot);
-    void fetchDistanceOutside(Cell *cell, BatchDNN* batch, size_t slot); // should be FetchDataFunction
+    // each function fills the whole column (all cells of the batch)
+    void fetchClimate(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch);
+    void fetchState(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch);
+    void fetchResidenceTime(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch);
+    void fetchStateHistory(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch);
+    void fetchResTimeHistory(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch);
+    void fetchNeighbors(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch);
+    void fetchSite(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch);
+    void fetchDistanceOutside(Cell * const *cells, const size_t *slots, size_t n, BatchDNN* batch); // should be FetchDataFunction
     // columns
     int i_distance;
     int i_nitrogen;
@@ -76,6 +85,7 @@ public:
     FetchDataVars(InputTensorItem *item) : FetchData(item) {}
     virtual void setup(const Settings *settings, const std::string &key, const InputTensorItem &item);
     virtual void fetch(Cell *cell, BatchDNN *batch, size_t slot);
+    virtual void fetchBatch(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch);
 private:
     std::vector<Expression*> mExpressions; ///< list of expressions
 };
@@ -91,6 +101,7 @@ public:
     FetchDataFunction(InputTensorItem *item) : FetchData(item) { mFn = Invalid; }
     virtual void setup(const Settings *settings, const std::string &key, const InputTensorItem &item);
     virtual void fetch(Cell *cell, BatchDNN *batch, size_t slot);
+    virtual void fetchBatch(Cell * const *cells, const size_t *slots, size_t n, BatchDNN *batch);
 
     // functions
     enum EFunctions { Invalid=0,
@@ -104,6 +115,7 @@ private:
     float calculateDistToSeedSource(Cell *cell);
     size_t mD2S_target; // index of target
     size_t mD2S_seed_source; // index of source
+    std::map<size_t, const DistanceFields::Layer*> mD2S_layers; ///< distance raster for each value of the seed source type
 
     // simple management
     void setupSimpleManagement();
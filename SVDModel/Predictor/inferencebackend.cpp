@@ -0,0 +1,41 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "inferencebackend.h"
+
+#include <stdexcept>
+
+#include "nativebackend.h"
+
+#ifdef USE_TENSORFLOW
+#include "tfbackend.h"
+#endif
+
+std::unique_ptr<InferenceBackend> InferenceBackend::create(const std::string &backend_name)
+{
+    if (backend_name == "tensorflow") {
+#ifdef USE_TENSORFLOW
+        return std::unique_ptr<InferenceBackend>(new TFBackend());
+#else
+        throw std::logic_error("The inference backend 'tensorflow' is not available (SVD is built without TensorFlow, see config.pri).");
+#endif
+    }
+    if (backend_name == "native")
+        return std::unique_ptr<InferenceBackend>(new NativeBackend());
+    throw std::logic_error("Invalid inference backend '" + backend_name + "' (dnn.backend). Available backends: tensorflow, native.");
+}
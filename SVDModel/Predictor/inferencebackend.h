@@ -0,0 +1,89 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef INFERENCEBACKEND_H
+#define INFERENCEBACKEND_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "inputtensoritem.h"
+
+/// TensorView describes a contiguous (row major) block of memory that is passed to or from an inference backend.
+/// The memory is not owned by the view.
+struct TensorView {
+    std::string name; ///< name of the tensor in the network
+    InputTensorItem::DataType type;
+    std::vector<int64_t> shape; ///< dimensions (the first is the batch dimension), empty for scalars
+    void *data;
+    TensorView(): type(InputTensorItem::DT_INVALID), data(nullptr) {}
+    TensorView(const std::string &aname, InputTensorItem::DataType atype, const std::vector<int64_t> &ashape, void *adata):
+        name(aname), type(atype), shape(ashape), data(adata) {}
+};
+
+/// InferenceOutput holds the results of a single call to InferenceBackend::run().
+/// The memory of the outputs is owned by the object (and released with it).
+class InferenceOutput
+{
+public:
+    virtual ~InferenceOutput() {}
+    /// number of output tensors
+    virtual size_t size() const = 0;
+    /// the output tensor with index `i` (in the order of the output names used for load())
+    virtual TensorView output(size_t i) const = 0;
+};
+
+/**
+ * @brief The InferenceBackend class is the interface to a runtime that executes the DNN.
+ *
+ * A backend loads a network from a file and runs the inference for a batch of examples.
+ * Inputs are passed as raw contiguous buffers (see TensorWrapper), which are not copied; only the
+ * first `n_rows` rows (examples) of the inputs are used. The backend is selected by `dnn.backend`,
+ * each DNN instance has its own backend object. run() is called from the worker threads of the inference pipeline,
+ * also concurrently (if `dnn.threads` > `dnn.count`), i.e. it must be thread safe.
+ */
+class InferenceBackend
+{
+public:
+    virtual ~InferenceBackend() {}
+    /// create a backend by name (e.g. "tensorflow"). Throws an exception if the backend is not available.
+    static std::unique_ptr<InferenceBackend> create(const std::string &backend_name);
+
+    virtual std::string name() const = 0;
+    /// load the network from `file_name`. `output_names` are the names of the output tensors.
+    /// Throws an exception on error.
+    virtual void load(const std::string &file_name, const std::vector<std::string> &output_names) = 0;
+
+    /// request the top `n_top` classes of the first output (scores and indices) from the backend.
+    /// Returns false if not supported (top-k is then calculated by the caller).
+    virtual bool setupTopK(size_t /*n_top*/, size_t /*n_classes*/) { return false; }
+
+    /// request a reduced numerical precision (e.g. "int8") for the inference. The backend calibrates with
+    /// the first `calibration_rows` examples, and uses the reduced precision only if the difference of the outputs
+    /// (compared to float32) is below `max_error`. Returns false if the precision is not supported.
+    virtual bool setupPrecision(const std::string &precision, size_t /*calibration_rows*/, double /*max_error*/) { return precision == "float32"; }
+
+    /// run the inference for `n_rows` examples. If top-k is enabled (setupTopK()), the outputs
+    /// contain the top-k scores (float) and indices (int32) as additional (last) outputs.
+    /// Throws an exception on error.
+    virtual std::unique_ptr<InferenceOutput> run(const std::vector<TensorView> &inputs, size_t n_rows) = 0;
+};
+
+#endif // INFERENCEBACKEND_H
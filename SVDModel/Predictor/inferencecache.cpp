@@ -0,0 +1,149 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "inferencecache.h"
+
+#include <cstring>
+#include <stdexcept>
+#include "spdlog/spdlog.h"
+
+InferenceCache *InferenceCache::mInstance = nullptr;
+
+namespace {
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+inline uint64_t finalize(uint64_t h)
+{
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+} // end namespace
+
+InferenceCache::InferenceCache(size_t n_top, size_t n_time_classes, size_t max_entries)
+{
+    if (mInstance)
+        throw std::logic_error("Creation of InferenceCache: instance ptr is not 0.");
+    mInstance = this;
+    mNTop = n_top;
+    mNTime = n_time_classes;
+    mMaxEntries = max_entries;
+    mShards.reset(new Shard[NShards]);
+    mSize = 0;
+    mLookups = 0;
+    mHits = 0;
+    mLookupsTotal = 0;
+    mHitsTotal = 0;
+}
+
+InferenceCache::~InferenceCache()
+{
+    mInstance = nullptr;
+}
+
+InferenceCache::Key InferenceCache::signature(const std::vector<TensorView> &inputs, size_t row)
+{
+    // two independent 64 bit hashes over the bytes of all input values of the example
+    uint64_t h1 = 0x9e3779b97f4a7c15ULL, h2 = 0x632be59bd9b4e019ULL;
+    for (const auto &t : inputs) {
+        if (t.shape.empty())
+            continue; // scalars are the same for all examples
+        size_t n_values = 1;
+        for (size_t d=1; d<t.shape.size(); ++d)
+            n_values *= static_cast<size_t>(t.shape[d]);
+        const size_t n_bytes = n_values * InputTensorItem::datatypeSize(t.type);
+        const unsigned char *p = static_cast<const unsigned char*>(t.data) + row * n_bytes;
+        size_t i = 0;
+        for (; i + 8 <= n_bytes; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, p + i, 8);
+            h1 = rotl(h1 ^ (w * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+            h2 = rotl(h2 + (w ^ 0x52dce729da3ed173ULL), 27) * 0x9e3779b97f4a7c15ULL + h1;
+        }
+        if (i < n_bytes) {
+            uint64_t w = 0;
+            std::memcpy(&w, p + i, n_bytes - i);
+            h1 = rotl(h1 ^ (w * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+            h2 = rotl(h2 + (w ^ 0x52dce729da3ed173ULL), 27) * 0x9e3779b97f4a7c15ULL + h1;
+        }
+        // separate the tensors
+        h1 ^= n_bytes;
+        h2 += n_bytes;
+    }
+    return Key{ finalize(h1), finalize(h2 ^ h1) };
+}
+
+bool InferenceCache::lookup(const Key &key, float *state_prob, state_t *states, float *time_prob)
+{
+    ++mLookups;
+    Shard &s = shard(key);
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.index.find(key);
+    if (it == s.index.end())
+        return false;
+    const size_t pos = it->second;
+    std::memcpy(state_prob, &s.stateProb[pos * mNTop], mNTop * sizeof(float));
+    std::memcpy(states, &s.states[pos * mNTop], mNTop * sizeof(state_t));
+    std::memcpy(time_prob, &s.timeProb[pos * mNTime], mNTime * sizeof(float));
+    ++mHits;
+    return true;
+}
+
+void InferenceCache::insert(const Key &key, const float *state_prob, const state_t *states, const float *time_prob)
+{
+    if (mSize >= mMaxEntries)
+        return;
+    Shard &s = shard(key);
+    std::lock_guard<std::mutex> guard(s.lock);
+    const size_t pos = s.index.size();
+    if (!s.index.emplace(key, pos).second)
+        return; // already stored (by another thread)
+    s.stateProb.insert(s.stateProb.end(), state_prob, state_prob + mNTop);
+    s.states.insert(s.states.end(), states, states + mNTop);
+    s.timeProb.insert(s.timeProb.end(), time_prob, time_prob + mNTime);
+    ++mSize;
+}
+
+void InferenceCache::newYear()
+{
+    if (mLookups > 0) {
+        auto lg = spdlog::get("dnn");
+        if (lg)
+            lg->info("Inference cache: {} of {} examples without DNN (hit rate {}%, total {}%), {} stored results.",
+                     mHits.load(), mLookups.load(), hitRate() * 100., hitRateTotal() * 100., mSize.load());
+    }
+    mLookupsTotal += mLookups;
+    mHitsTotal += mHits;
+    mLookups = 0;
+    mHits = 0;
+    for (size_t i=0; i<NShards; ++i) {
+        Shard &s = mShards[i];
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.index.clear();
+        s.stateProb.clear();
+        s.states.clear();
+        s.timeProb.clear();
+    }
+    mSize = 0;
+}
+
+double InferenceCache::hitRateTotal() const
+{
+    const size_t lookups = mLookupsTotal + mLookups;
+    return lookups > 0 ? static_cast<double>(mHitsTotal + mHits) / static_cast<double>(lookups) : 0.;
+}
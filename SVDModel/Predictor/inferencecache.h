@@ -0,0 +1,105 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef INFERENCECACHE_H
+#define INFERENCECACHE_H
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+#include "states.h"
+#include "inferencebackend.h"
+
+/**
+ * @brief The InferenceCache class stores the results of the DNN (top-k states and probabilities, residence time probabilities)
+ * for a signature of the input data of an example (a 128 bit hash over all input values of the example).
+ *
+ * Cells with identical inputs (e.g. the same state, residence time, climate, site and neighborhood) share the result of the DNN;
+ * only examples with new signatures are sent to the network. The selection of the next state is still done for every cell
+ * (with the random stream of the cell), i.e. the results of the simulation are not affected by the cache.
+ * The cache is emptied every year (BatchManager::newYear()) and is split in shards (with separate locks) to allow concurrent access
+ * from the DNN worker threads. The cache is enabled with `dnn.cache.enabled`.
+ */
+class InferenceCache
+{
+public:
+    /// the signature of the inputs of an example
+    struct Key {
+        uint64_t h1;
+        uint64_t h2;
+        bool operator==(const Key &other) const { return h1 == other.h1 && h2 == other.h2; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key &k) const { return static_cast<size_t>(k.h1); }
+    };
+    InferenceCache(size_t n_top, size_t n_time_classes, size_t max_entries);
+    ~InferenceCache();
+    static InferenceCache *instance() { return mInstance; }
+
+    /// calculate the signature of the example `row` from the input tensors (scalar inputs are ignored)
+    static Key signature(const std::vector<TensorView> &inputs, size_t row);
+
+    /// look up `key`; if found, the stored results are copied to `state_prob`, `states` (n_top values) and `time_prob` (n_time_classes).
+    bool lookup(const Key &key, float *state_prob, state_t *states, float *time_prob);
+    /// store results for `key` (no action if the cache is full)
+    void insert(const Key &key, const float *state_prob, const state_t *states, const float *time_prob);
+
+    /// log the statistics of the year and empty the cache
+    void newYear();
+
+    // statistics
+    /// number of examples (lookups) in the current year
+    size_t lookups() const { return mLookups; }
+    /// number of examples in the current year that did not run through the DNN
+    size_t hits() const { return mHits; }
+    /// the fraction of examples (0..1) of the current year that did not run through the DNN
+    double hitRate() const { return mLookups > 0 ? static_cast<double>(mHits) / static_cast<double>(mLookups) : 0.; }
+    /// the fraction of examples (0..1) that did not run through the DNN (since the start of the simulation)
+    double hitRateTotal() const;
+    /// number of stored results
+    size_t size() const { return mSize; }
+    /// count examples that share a signature with another example in the same batch (they run only once through the DNN)
+    void addBatchDuplicates(size_t n) { mHits += n; }
+
+private:
+    struct Shard {
+        std::mutex lock;
+        std::unordered_map<Key, size_t, KeyHash> index; ///< key -> position of the data
+        std::vector<float> stateProb;
+        std::vector<state_t> states;
+        std::vector<float> timeProb;
+    };
+    static const size_t NShards = 64;
+    Shard &shard(const Key &key) { return mShards[(key.h2 >> 58) & (NShards-1)]; }
+    std::unique_ptr<Shard[]> mShards;
+    size_t mNTop;
+    size_t mNTime;
+    size_t mMaxEntries;
+    std::atomic<size_t> mSize;
+    std::atomic<size_t> mLookups;
+    std::atomic<size_t> mHits;
+    size_t mLookupsTotal;
+    size_t mHitsTotal;
+
+    static InferenceCache *mInstance;
+};
+
+#endif // INFERENCECACHE_H
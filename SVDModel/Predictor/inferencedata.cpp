@@ -23,7 +23,7 @@
 #include "dnn.h"
 
 
-void InferenceData::fetchData(Cell *cell, BatchDNN *batch, size_t slot)
+void InferenceData::init(Cell *cell, BatchDNN *batch, size_t slot)
 {
     mOldState = cell->stateId();
     mResidenceTime = cell->residenceTime();
@@ -39,9 +39,6 @@ void InferenceData::fetchData(Cell *cell, BatchDNN *batch, size_t slot)
         throw logic_error_fmt("InferenceData: invalid cell: index: {}, current state: {}, ptr-state: {}, ptr-env: {}",
                               mIndex, mOldState, (void*)cell->state(), (void*)cell->environment());
     }
-
-    // now pull all the data
-    //internalFetchData();
 }
 
 void InferenceData::setResult(state_t state, restime_t time)
@@ -30,8 +30,9 @@ class InferenceData
 public:
     InferenceData(): mOldState(-1), mNextState(-1), mNextTime(-1), mBatch(nullptr), mSlot(std::numeric_limits<size_t>::max()) {}
 
-    /// fills an item by pulling all the required data from the model
-    void fetchData(Cell *cell, BatchDNN *batch, size_t slot);
+    /// set up the item for `cell` (example `slot` of `batch`). The predictors
+    /// are fetched for all cells of the batch at once (see BatchDNN::fetchBatch()).
+    void init(Cell *cell, BatchDNN *batch, size_t slot);
 
     /// set the result of the DNN
     void setResult(state_t state, restime_t time);
@@ -0,0 +1,288 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "inferencepipeline.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "batch.h"
+#include "dnn.h"
+#include "batchmanager.h"
+#include "perfstats.h"
+#include "tracerecorder.h"
+#include "modelrunstate.h"
+
+InferencePipeline *InferencePipeline::mInstance = nullptr;
+
+InferencePipeline::InferencePipeline(const std::vector<DNN *> &dnns, size_t n_threads, size_t queue_length)
+{
+    if (mInstance!=nullptr)
+        throw std::logic_error("Creation of inference pipeline: instance ptr is not 0.");
+    mInstance = this;
+    lg = spdlog::get("dnn");
+    mDNNs = dnns;
+    mNThreads = n_threads > 0 ? n_threads : 1;
+    // each worker thread is bound to a DNN instance: instances without a worker are not used
+    mInstances = std::vector<Instance>(std::max(std::min(mDNNs.size(), mNThreads), size_t(1)));
+    mCapacity = queue_length > 0 ? queue_length : 1;
+    // the completion queue holds all batches + the (single, see wakeUp()) wake up signal, i.e. workers never block
+    mCompleted.setCapacity(queue_length + 2);
+    mExecutionCount = 0;
+    mStartTime = std::chrono::steady_clock::now();
+    mProcessing = 0;
+    mBatchesProcessed = 0;
+    mCellsProcessed = 0;
+}
+
+InferencePipeline::~InferencePipeline()
+{
+    stop();
+    mInstance = nullptr;
+}
+
+void InferencePipeline::start()
+{
+    if (!mWorkers.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = false;
+        mStartTime = std::chrono::steady_clock::now();
+    }
+    mWakeUpPending = false;
+    mCompleted.reopen();
+    for (size_t i=0;i<mNThreads;++i)
+        mWorkers.push_back(std::thread(&InferencePipeline::worker, this, i));
+    if (lg) {
+        lg->debug("Inference pipeline: started {} worker threads for {} DNN(s), queue length: {}.", mNThreads, mDNNs.size(), mCapacity);
+        if (mDNNs.size() > mInstances.size())
+            lg->info("Inference pipeline: only {} of {} DNN instances are used (one worker thread per instance, 'dnn.threads'={}).", mInstances.size(), mDNNs.size(), mNThreads);
+    }
+}
+
+void InferencePipeline::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = true;
+    }
+    mNotEmpty.notify_all();
+    mNotFull.notify_all();
+    mCompleted.close();
+    for (auto &t : mWorkers)
+        if (t.joinable())
+            t.join();
+    if (!mWorkers.empty() && lg && lg->should_log(spdlog::level::debug)) {
+        auto stats = instanceStats();
+        for (size_t i=0;i<stats.size();++i)
+            lg->debug("DNN instance {}: {} batches ({} stolen), mean latency: {:.1f}ms, max: {:.1f}ms, occupancy: {:.2f}",
+                      i, stats[i].batches, stats[i].stolen, stats[i].meanLatency*1000., stats[i].maxLatency*1000., stats[i].occupancy);
+    }
+    mWorkers.clear();
+}
+
+bool InferencePipeline::submit(Batch *batch)
+{
+    batch->markSubmitted();
+    TraceRecorder::batchSpan("fill", batch->openTime(), batch->submitTime(), batch->packageId(), static_cast<int>(batch->usedSlots()));
+    size_t n_cells = batch->usedSlots();
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotFull.wait(lock, [this]() { return mClosed || mNQueued < mCapacity; });
+        if (mClosed)
+            return false;
+        // the instance with the lowest expected load; instances without measurements are preferred
+        // (the scan starts at a rotating position to break ties)
+        size_t best = 0;
+        double best_load = std::numeric_limits<double>::max();
+        for (size_t k=0;k<mInstances.size();++k) {
+            size_t i = (mExecutionCount + k) % mInstances.size();
+            const Instance &inst = mInstances[i];
+            double load = static_cast<double>(inst.queuedCells + inst.runningCells) * inst.secondsPerCell;
+            if (load < best_load) {
+                best_load = load;
+                best = i;
+            }
+        }
+        ++mExecutionCount;
+        mInstances[best].queue.push_back(batch);
+        mInstances[best].queuedCells += n_cells;
+        ++mNQueued;
+    }
+    // any worker can take the batch (by stealing, if it is not the worker of the instance)
+    mNotEmpty.notify_one();
+    return true;
+}
+
+bool InferencePipeline::nextBatch(size_t instance, Batch *&batch, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (!mNotEmpty.wait_for(lock, timeout, [this]() { return mClosed || mNQueued > 0; }))
+        return false;
+    if (mNQueued == 0)
+        return false; // closed
+    Instance &own = mInstances[instance];
+    size_t from = instance;
+    if (own.queue.empty()) {
+        // steal from the instance with the most waiting cells
+        size_t max_cells = 0;
+        for (size_t i=0;i<mInstances.size();++i) {
+            if (!mInstances[i].queue.empty() && mInstances[i].queuedCells >= max_cells) {
+                max_cells = mInstances[i].queuedCells;
+                from = i;
+            }
+        }
+        ++own.stats.stolen;
+    }
+    Instance &src = mInstances[from];
+    batch = src.queue.front();
+    src.queue.pop_front();
+    size_t n_cells = batch->usedSlots();
+    src.queuedCells -= std::min(src.queuedCells, n_cells);
+    --mNQueued;
+    ++own.running;
+    own.runningCells += n_cells;
+    lock.unlock();
+    mNotFull.notify_one();
+    return true;
+}
+
+void InferencePipeline::finishBatch(size_t instance, size_t n_cells, double seconds)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Instance &inst = mInstances[instance];
+    --inst.running;
+    inst.runningCells -= std::min(inst.runningCells, n_cells);
+    if (n_cells > 0) {
+        double spc = seconds / static_cast<double>(n_cells);
+        inst.secondsPerCell = inst.secondsPerCell > 0. ? 0.8 * inst.secondsPerCell + 0.2 * spc : spc;
+    }
+    inst.busySeconds += seconds;
+    inst.sumLatency += seconds;
+    ++inst.stats.batches;
+    inst.stats.cells += n_cells;
+    inst.stats.maxLatency = std::max(inst.stats.maxLatency, seconds);
+}
+
+std::vector<InferencePipeline::InstanceStats> InferencePipeline::instanceStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStartTime).count();
+    std::vector<InstanceStats> result;
+    for (const auto &inst : mInstances) {
+        InstanceStats s = inst.stats;
+        s.queued = inst.queue.size();
+        s.meanLatency = s.batches > 0 ? inst.sumLatency / static_cast<double>(s.batches) : 0.;
+        s.occupancy = elapsed > 0. ? inst.busySeconds / elapsed : 0.;
+        result.push_back(s);
+    }
+    return result;
+}
+
+void InferencePipeline::complete(Batch *batch)
+{
+    if (!mCompleted.push(batch) && batch)
+        batch->setError(true);
+}
+
+bool InferencePipeline::waitForResult(Batch *&batch)
+{
+    if (!mCompleted.pop(batch))
+        return false;
+    // the consumer checks its conditions after this point: later wake ups need a new signal
+    if (!batch)
+        mWakeUpPending = false;
+    return true;
+}
+
+void InferencePipeline::worker(size_t thread_index)
+{
+    TraceRecorder::setThreadName("DNN worker " + std::to_string(thread_index));
+    // the DNN instance of the worker
+    const size_t instance = thread_index % mInstances.size();
+    Batch *batch;
+    while (true) {
+        if (!nextBatch(instance, batch, std::chrono::milliseconds(20))) {
+            // no batch available: the DNN is idle
+            if (isClosed())
+                break;
+            if (mIdleCallback && queueLength()==0)
+                mIdleCallback();
+            continue;
+        }
+        if (PerfStats::isEnabled())
+            PerfStats::record(PerfStats::QueueWait, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - batch->submitTime()).count()));
+        TraceRecorder::batchSpan("queue", batch->submitTime(), TraceRecorder::now(), batch->packageId(), static_cast<int>(batch->usedSlots()));
+        if (RunState::instance()->cancel()) {
+            finishBatch(instance, 0, 0.);
+            batch->setError(true);
+            complete(batch);
+            continue;
+        }
+        if (mDNNs.size()==0) {
+            lg->error("Cannot execute DNN batch because no DNN is available!");
+            RunState::instance()->dnnState() = ModelRunState::Error;
+            finishBatch(instance, 0, 0.);
+            batch->setError(true);
+            complete(batch);
+            continue;
+        }
+
+        if (batch->state()!=Batch::Fill)
+            lg->error("Batch {} [{}] is in the wrong state {}, size: {}", batch->packageId(), static_cast<void*>(batch), batch->state(), batch->usedSlots());
+
+        RunState::instance()->dnnState() = ModelRunState::Running;
+        batch->changeState(Batch::DNNInference);
+        ++mProcessing;
+        lg->debug("Inference pipeline (thread {}, DNN {}): starting DNN for package {} (batch: {}, #processing: {})", thread_index, instance, batch->packageId(), static_cast<void*>(batch), mProcessing);
+
+        auto t_start = std::chrono::steady_clock::now();
+        try {
+            mDNNs[instance]->run(batch);
+        } catch (const std::exception &e) {
+            lg->error("An error occurred in the DNN: {}", e.what());
+            batch->setError(true);
+        }
+        finishBatch(instance, batch->usedSlots(), std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count());
+
+        --mProcessing;
+        if (TraceRecorder::isEnabled()) {
+            auto t_end = TraceRecorder::now();
+            TraceRecorder::span("dnn run", "dnn", t_start, t_end, batch->packageId(), static_cast<int>(batch->usedSlots()));
+            TraceRecorder::batchSpan("inference", t_start, t_end, batch->packageId(), static_cast<int>(batch->usedSlots()));
+        }
+
+        if (batch->hasError()) {
+            RunState::instance()->setError("Error in DNN", RunState::instance()->dnnState());
+        } else {
+            ++mBatchesProcessed;
+            mCellsProcessed += batch->usedSlots();
+            if (BatchManager::hasInstance())
+                BatchManager::instance()->updateStatistics(batch->usedSlots(), batch->fillTime(),
+                                                           std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count());
+            batch->changeState(Batch::Finished);
+            lg->debug("finished data package {} [{}] (size={})", batch->packageId(), static_cast<void*>(batch), batch->usedSlots());
+        }
+
+        complete(batch);
+
+        if (!isRunning())
+            RunState::instance()->dnnState() = ModelRunState::ReadyToRun;
+    }
+}
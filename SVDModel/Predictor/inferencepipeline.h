@@ -0,0 +1,140 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef INFERENCEPIPELINE_H
+#define INFERENCEPIPELINE_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cassert>
+#include <functional>
+#include "spdlog/spdlog.h"
+
+#include "batchqueue.h"
+
+class Batch; // forward
+class DNN; // forward
+
+/**
+ * @brief The InferencePipeline class connects the model with the DNN(s).
+ *
+ * Filled batches are submitted to the pipeline (submit()), and processed
+ * by a fixed number of worker threads that run the DNN. Each DNN instance has its own queue,
+ * and every worker thread is bound to one instance. A new batch is queued at the instance with the
+ * lowest expected load (the queued and running cells weighted with the measured time per cell);
+ * workers of an instance with an empty queue take (steal) batches from the instance with the longest queue.
+ * The total number of queued batches is bounded (submit() blocks).
+ * Processed batches are put into the completion queue, from which the model retrieves them (waitForResult()).
+ * The pipeline does not require a (Qt) event loop.
+ */
+class InferencePipeline
+{
+public:
+    /// create the pipeline for the given DNN instances (not owned), `n_threads` workers and `queue_length` batches
+    InferencePipeline(const std::vector<DNN*> &dnns, size_t n_threads, size_t queue_length);
+    ~InferencePipeline();
+    static InferencePipeline *instance() {
+        assert(mInstance!=nullptr);
+        return mInstance; }
+    static bool hasInstance() { return mInstance != nullptr; }
+
+    /// start the worker threads
+    void start();
+    /// stop all worker threads and release waiting threads
+    void stop();
+
+    /// statistics for a single DNN instance
+    struct InstanceStats {
+        size_t batches {0}; ///< number of processed batches
+        size_t cells {0}; ///< number of processed cells
+        size_t queued {0}; ///< batches currently in the queue of the instance
+        size_t stolen {0}; ///< batches that the workers of the instance took from other queues
+        double meanLatency {0.}; ///< mean time (seconds) to run a batch
+        double maxLatency {0.}; ///< maximum time (seconds) to run a batch
+        double occupancy {0.}; ///< mean number of batches in process (busy time / elapsed time)
+    };
+
+    /// queue a (filled) batch for inference. Blocks if the queue is full.
+    bool submit(Batch *batch);
+    /// put a batch directly to the completion queue
+    void complete(Batch *batch);
+    /// put an empty item (nullptr) to the completion queue, e.g. to wake up the consumer.
+    /// Wake ups are coalesced: at most one nullptr is in the queue (until it is consumed by waitForResult()).
+    void wakeUp() { if (!mWakeUpPending.exchange(true)) complete(nullptr); }
+    /// wait for the next processed batch. Returns false if the pipeline is stopped.
+    bool waitForResult(Batch *&batch);
+    /// function that is called by worker threads that are idle (no batch available for some time)
+    void setIdleCallback(std::function<void()> callback) { mIdleCallback = callback; }
+
+    // statistics
+    bool isRunning() const { return mProcessing > 0 || queueLength() > 0; }
+    size_t queueLength() const { std::lock_guard<std::mutex> lock(mMutex); return mNQueued; }
+    size_t batchesProcessed() const { return mBatchesProcessed; }
+    size_t cellsProcessed() const { return mCellsProcessed; }
+    /// statistics of the DNN instances that are in use
+    std::vector<InstanceStats> instanceStats() const;
+
+private:
+    void worker(size_t thread_index);
+    /// get the next batch for a worker of the instance `instance` (wait at most `timeout`)
+    bool nextBatch(size_t instance, Batch *&batch, std::chrono::milliseconds timeout);
+    /// update the statistics of `instance` after running a batch with `n_cells` cells
+    void finishBatch(size_t instance, size_t n_cells, double seconds);
+    bool isClosed() const { std::lock_guard<std::mutex> lock(mMutex); return mClosed; }
+
+    /// a DNN instance with its queue; the members are protected by mMutex
+    struct Instance {
+        std::deque<Batch*> queue; ///< batches waiting for this instance
+        size_t queuedCells {0};
+        size_t running {0}; ///< number of batches in process
+        size_t runningCells {0};
+        double secondsPerCell {0.}; ///< moving average of the time per cell (0: unknown)
+        InstanceStats stats;
+        double busySeconds {0.};
+        double sumLatency {0.};
+    };
+    std::vector<Instance> mInstances; ///< the DNN instances that are used (one per DNN, at most one per worker thread)
+    size_t mCapacity; ///< maximum number of queued batches (all instances)
+    size_t mNQueued {0}; ///< currently queued batches (all instances)
+    bool mClosed {false};
+    mutable std::mutex mMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+    std::chrono::steady_clock::time_point mStartTime;
+
+    BatchQueue<Batch*> mCompleted; ///< batches processed by the DNN
+    std::atomic<bool> mWakeUpPending {false}; ///< true while a wake up signal (nullptr) is in mCompleted
+    std::vector<DNN*> mDNNs;
+    std::vector<std::thread> mWorkers;
+    size_t mNThreads;
+    size_t mExecutionCount; ///< used to break ties when selecting an instance
+    std::atomic<int> mProcessing;
+    std::atomic<size_t> mBatchesProcessed;
+    std::atomic<size_t> mCellsProcessed;
+    std::function<void()> mIdleCallback;
+
+    static InferencePipeline *mInstance;
+    std::shared_ptr<spdlog::logger> lg;
+};
+
+#endif // INFERENCEPIPELINE_H
@@ -71,6 +71,8 @@ struct InputTensorItem {
     static DataType datatypeFromString(std::string name);
     static std::string contentString(DataContent content);
     static std::string datatypeString(DataType dtype);
+    /// the size (bytes) of a single value of the data type
+    static size_t datatypeSize(DataType dtype);
     static std::string allDataTypeStrings();
     static std::string allContentStrings();
 };
@@ -0,0 +1,844 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "nativebackend.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "spdlog/spdlog.h"
+
+#if defined(__AVX512F__)
+#define SVD_NATIVE_AVX512
+#elif defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define SVD_NATIVE_AVX2
+#endif
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Dense layers: C (rows x N) = A (rows x K) * W (K x N) + bias.
+// W is packed at load time into panels of NR columns (K x NR each, zero padded), the micro kernel
+// computes MR rows x NR columns of C in registers. The rows are processed in blocks of RowBlock rows,
+// so that a block of A stays in the L2 cache while all panels of W (which are read sequentially) pass by.
+const size_t MR = 4;
+#ifdef SVD_NATIVE_AVX512
+const size_t NR = 32;
+#else
+const size_t NR = 16;
+#endif
+const size_t RowBlock = 64;
+
+#if defined(SVD_NATIVE_AVX512)
+inline void microKernel(size_t K, const float * const a[MR], const float *panel, const float *bias, float * const c[MR])
+{
+    __m512 acc[MR][2];
+    const __m512 b0 = _mm512_loadu_ps(bias), b1 = _mm512_loadu_ps(bias + 16);
+    for (size_t r=0; r<MR; ++r) { acc[r][0] = b0; acc[r][1] = b1; }
+    for (size_t k=0; k<K; ++k, panel+=NR) {
+        const __m512 w0 = _mm512_loadu_ps(panel), w1 = _mm512_loadu_ps(panel + 16);
+        for (size_t r=0; r<MR; ++r) {
+            const __m512 av = _mm512_set1_ps(a[r][k]);
+            acc[r][0] = _mm512_fmadd_ps(av, w0, acc[r][0]);
+            acc[r][1] = _mm512_fmadd_ps(av, w1, acc[r][1]);
+        }
+    }
+    for (size_t r=0; r<MR; ++r) {
+        _mm512_storeu_ps(c[r], acc[r][0]);
+        _mm512_storeu_ps(c[r] + 16, acc[r][1]);
+    }
+}
+#elif defined(SVD_NATIVE_AVX2)
+inline void microKernel(size_t K, const float * const a[MR], const float *panel, const float *bias, float * const c[MR])
+{
+    __m256 acc[MR][2];
+    const __m256 b0 = _mm256_loadu_ps(bias), b1 = _mm256_loadu_ps(bias + 8);
+    for (size_t r=0; r<MR; ++r) { acc[r][0] = b0; acc[r][1] = b1; }
+    for (size_t k=0; k<K; ++k, panel+=NR) {
+        const __m256 w0 = _mm256_loadu_ps(panel), w1 = _mm256_loadu_ps(panel + 8);
+        for (size_t r=0; r<MR; ++r) {
+            const __m256 av = _mm256_broadcast_ss(a[r] + k);
+            acc[r][0] = _mm256_fmadd_ps(av, w0, acc[r][0]);
+            acc[r][1] = _mm256_fmadd_ps(av, w1, acc[r][1]);
+        }
+    }
+    for (size_t r=0; r<MR; ++r) {
+        _mm256_storeu_ps(c[r], acc[r][0]);
+        _mm256_storeu_ps(c[r] + 8, acc[r][1]);
+    }
+}
+#else
+inline void microKernel(size_t K, const float * const a[MR], const float *panel, const float *bias, float * const c[MR])
+{
+    float acc[MR][NR];
+    for (size_t r=0; r<MR; ++r)
+        for (size_t j=0; j<NR; ++j)
+            acc[r][j] = bias[j];
+    for (size_t k=0; k<K; ++k, panel+=NR) {
+        for (size_t r=0; r<MR; ++r) {
+            const float av = a[r][k];
+            for (size_t j=0; j<NR; ++j)
+                acc[r][j] += av * panel[j];
+        }
+    }
+    for (size_t r=0; r<MR; ++r)
+        std::memcpy(c[r], acc[r], NR*sizeof(float));
+}
+#endif
+
+void denseForward(const float *a, size_t n_rows, size_t K, size_t N, const float *packed, const float *bias, float *c)
+{
+    const size_t n_panels = (N + NR - 1) / NR;
+    float tail[MR][NR]; // results of the last (partial) panel and of rows beyond the end
+    for (size_t i0=0; i0<n_rows; i0+=RowBlock) {
+        const size_t i1 = std::min(n_rows, i0 + RowBlock);
+        for (size_t p=0; p<n_panels; ++p) {
+            const float *panel = packed + p*K*NR;
+            const size_t j0 = p*NR;
+            const size_t n_valid = std::min(NR, N - j0);
+            for (size_t i=i0; i<i1; i+=MR) {
+                const float *ap[MR];
+                float *cp[MR];
+                for (size_t r=0; r<MR; ++r) {
+                    const bool valid_row = i + r < i1;
+                    ap[r] = a + (valid_row ? i + r : i) * K;
+                    cp[r] = valid_row && n_valid==NR ? c + (i + r)*N + j0 : tail[r];
+                }
+                microKernel(K, ap, panel, bias + j0, cp);
+                if (n_valid < NR)
+                    for (size_t r=0; r<MR && i + r < i1; ++r)
+                        std::memcpy(c + (i + r)*N + j0, tail[r], n_valid*sizeof(float));
+            }
+        }
+    }
+}
+
+// int8 dense layers: the inputs are quantized to 7 bit unsigned values (0..127) with a zero point, the weights
+// to signed 8 bit values (-127..127). Products of four consecutive inputs are summed to int32 (the sum of two products
+// fits into int16, i.e. the pairwise instructions do not saturate). The kernel is packed into panels of QNR columns,
+// each panel holds groups of four rows of the kernel (4 bytes per column).
+#if defined(SVD_NATIVE_AVX512) && defined(__AVX512BW__)
+#define SVD_NATIVE_INT8_AVX512
+const size_t QNR = 32;
+#elif defined(__AVX2__)
+#define SVD_NATIVE_INT8_AVX2
+const size_t QNR = 16;
+#else
+const size_t QNR = 16;
+#endif
+
+#if defined(SVD_NATIVE_INT8_AVX512)
+inline void microKernelInt8(size_t n_quads, const uint8_t * const a[MR], const int8_t *panel, const float *scale, const float *offset, float * const c[MR])
+{
+    __m512i acc[MR][2];
+    for (size_t r=0; r<MR; ++r) { acc[r][0] = _mm512_setzero_si512(); acc[r][1] = _mm512_setzero_si512(); }
+#ifndef __AVX512VNNI__
+    const __m512i ones = _mm512_set1_epi16(1);
+#endif
+    for (size_t q=0; q<n_quads; ++q, panel+=4*QNR) {
+        const __m512i w0 = _mm512_loadu_si512(panel), w1 = _mm512_loadu_si512(panel + 64);
+        for (size_t r=0; r<MR; ++r) {
+            int32_t quad;
+            std::memcpy(&quad, a[r] + 4*q, sizeof(int32_t));
+            const __m512i av = _mm512_set1_epi32(quad);
+#ifdef __AVX512VNNI__
+            acc[r][0] = _mm512_dpbusd_epi32(acc[r][0], av, w0);
+            acc[r][1] = _mm512_dpbusd_epi32(acc[r][1], av, w1);
+#else
+            acc[r][0] = _mm512_add_epi32(acc[r][0], _mm512_madd_epi16(_mm512_maddubs_epi16(av, w0), ones));
+            acc[r][1] = _mm512_add_epi32(acc[r][1], _mm512_madd_epi16(_mm512_maddubs_epi16(av, w1), ones));
+#endif
+        }
+    }
+    const __m512 s0 = _mm512_loadu_ps(scale), s1 = _mm512_loadu_ps(scale + 16);
+    const __m512 o0 = _mm512_loadu_ps(offset), o1 = _mm512_loadu_ps(offset + 16);
+    for (size_t r=0; r<MR; ++r) {
+        _mm512_storeu_ps(c[r], _mm512_fmadd_ps(_mm512_cvtepi32_ps(acc[r][0]), s0, o0));
+        _mm512_storeu_ps(c[r] + 16, _mm512_fmadd_ps(_mm512_cvtepi32_ps(acc[r][1]), s1, o1));
+    }
+}
+#elif defined(SVD_NATIVE_INT8_AVX2)
+inline void microKernelInt8(size_t n_quads, const uint8_t * const a[MR], const int8_t *panel, const float *scale, const float *offset, float * const c[MR])
+{
+    __m256i acc[MR][2];
+    for (size_t r=0; r<MR; ++r) { acc[r][0] = _mm256_setzero_si256(); acc[r][1] = _mm256_setzero_si256(); }
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (size_t q=0; q<n_quads; ++q, panel+=4*QNR) {
+        const __m256i w0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(panel));
+        const __m256i w1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(panel + 32));
+        for (size_t r=0; r<MR; ++r) {
+            int32_t quad;
+            std::memcpy(&quad, a[r] + 4*q, sizeof(int32_t));
+            const __m256i av = _mm256_set1_epi32(quad);
+            acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(_mm256_maddubs_epi16(av, w0), ones));
+            acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(_mm256_maddubs_epi16(av, w1), ones));
+        }
+    }
+    const __m256 s0 = _mm256_loadu_ps(scale), s1 = _mm256_loadu_ps(scale + 8);
+    const __m256 o0 = _mm256_loadu_ps(offset), o1 = _mm256_loadu_ps(offset + 8);
+    for (size_t r=0; r<MR; ++r) {
+        _mm256_storeu_ps(c[r], _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(acc[r][0]), s0), o0));
+        _mm256_storeu_ps(c[r] + 8, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(acc[r][1]), s1), o1));
+    }
+}
+#else
+inline void microKernelInt8(size_t n_quads, const uint8_t * const a[MR], const int8_t *panel, const float *scale, const float *offset, float * const c[MR])
+{
+    int32_t acc[MR][QNR] = {};
+    for (size_t q=0; q<n_quads; ++q, panel+=4*QNR) {
+        for (size_t r=0; r<MR; ++r) {
+            const uint8_t *av = a[r] + 4*q;
+            for (size_t j=0; j<QNR; ++j)
+                acc[r][j] += av[0]*panel[4*j] + av[1]*panel[4*j+1] + av[2]*panel[4*j+2] + av[3]*panel[4*j+3];
+        }
+    }
+    for (size_t r=0; r<MR; ++r)
+        for (size_t j=0; j<QNR; ++j)
+            c[r][j] = static_cast<float>(acc[r][j]) * scale[j] + offset[j];
+}
+#endif
+
+/// quantize the rows of `a` (n_rows x K) to unsigned 7 bit values (n_rows x k_padded)
+void quantizeRows(const float *a, size_t n_rows, size_t K, size_t k_padded, float scale, int zero_point, uint8_t *q)
+{
+    const float inv = 1.f / scale;
+    const float zp = static_cast<float>(zero_point);
+    for (size_t i=0; i<n_rows; ++i, a+=K, q+=k_padded) {
+        // clamp first, then round (the values are positive); the loop is vectorized by the compiler
+        for (size_t k=0; k<K; ++k) {
+            const float v = std::max(0.f, std::min(127.f, a[k] * inv + zp));
+            q[k] = static_cast<uint8_t>(static_cast<int>(v + 0.5f));
+        }
+        for (size_t k=K; k<k_padded; ++k)
+            q[k] = 0; // the padded weights are 0
+    }
+}
+
+void denseForwardInt8(const uint8_t *a, size_t n_rows, size_t k_padded, size_t N, const int8_t *packed, const float *scale, const float *offset, float *c)
+{
+    const size_t n_panels = (N + QNR - 1) / QNR;
+    const size_t n_quads = k_padded / 4;
+    float tail[MR][QNR];
+    for (size_t i0=0; i0<n_rows; i0+=RowBlock) {
+        const size_t i1 = std::min(n_rows, i0 + RowBlock);
+        for (size_t p=0; p<n_panels; ++p) {
+            const int8_t *panel = packed + p*k_padded*QNR;
+            const size_t j0 = p*QNR;
+            const size_t n_valid = std::min(QNR, N - j0);
+            for (size_t i=i0; i<i1; i+=MR) {
+                const uint8_t *ap[MR];
+                float *cp[MR];
+                for (size_t r=0; r<MR; ++r) {
+                    const bool valid_row = i + r < i1;
+                    ap[r] = a + (valid_row ? i + r : i) * k_padded;
+                    cp[r] = valid_row && n_valid==QNR ? c + (i + r)*N + j0 : tail[r];
+                }
+                microKernelInt8(n_quads, ap, panel, scale + j0, offset + j0, cp);
+                if (n_valid < QNR)
+                    for (size_t r=0; r<MR && i + r < i1; ++r)
+                        std::memcpy(c + (i + r)*N + j0, tail[r], n_valid*sizeof(float));
+            }
+        }
+    }
+}
+
+/// exp() with a polynomial for 2^f (relative error < 2e-7)
+inline float fastExp(float x)
+{
+    x = std::max(-87.f, std::min(88.f, x));
+    const float t = x * 1.44269504f; // log2(e)
+    const float n = std::floor(t + 0.5f);
+    const float f = (t - n) * 0.69314718f; // |f| <= ln(2)/2
+    const float p = 1.f + f*(1.f + f*(0.5f + f*(1.f/6.f + f*(1.f/24.f + f*(1.f/120.f + f*(1.f/720.f))))));
+    const int32_t bits = (static_cast<int32_t>(n) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(float));
+    return p * scale;
+}
+
+void applyActivation(NativeBackend::ActivationType act, float *data, size_t n_rows, size_t width)
+{
+    const size_t n = n_rows * width;
+    switch (act) {
+    case NativeBackend::Linear: break;
+    case NativeBackend::ReLU:
+        for (size_t i=0; i<n; ++i) data[i] = std::max(data[i], 0.f);
+        break;
+    case NativeBackend::ELU:
+        for (size_t i=0; i<n; ++i) data[i] = data[i] > 0.f ? data[i] : fastExp(data[i]) - 1.f;
+        break;
+    case NativeBackend::Tanh:
+        for (size_t i=0; i<n; ++i) data[i] = std::tanh(data[i]);
+        break;
+    case NativeBackend::Sigmoid:
+        for (size_t i=0; i<n; ++i) data[i] = 1.f / (1.f + fastExp(-data[i]));
+        break;
+    case NativeBackend::Softmax:
+        for (size_t r=0; r<n_rows; ++r) {
+            float *row = data + r*width;
+            const float max_value = *std::max_element(row, row + width);
+            float sum = 0.f;
+            for (size_t j=0; j<width; ++j) {
+                row[j] = fastExp(row[j] - max_value);
+                sum += row[j];
+            }
+            const float inv = 1.f / sum;
+            for (size_t j=0; j<width; ++j) row[j] *= inv;
+        }
+        break;
+    }
+}
+
+/// convert the values of an input tensor to float
+template<typename T>
+void convertInput(const void *src, float *dest, size_t n)
+{
+    const T *p = static_cast<const T*>(src);
+    for (size_t i=0; i<n; ++i)
+        dest[i] = static_cast<float>(p[i]);
+}
+
+// reading the binary network file
+uint32_t readUInt(std::ifstream &in)
+{
+    uint32_t value = 0;
+    in.read(reinterpret_cast<char*>(&value), sizeof(uint32_t));
+    if (!in)
+        throw std::logic_error("unexpected end of file");
+    return value;
+}
+
+std::string readString(std::ifstream &in)
+{
+    uint32_t len = readUInt(in);
+    std::string s(len, '\0');
+    in.read(&s[0], len);
+    if (!in)
+        throw std::logic_error("unexpected end of file");
+    return s;
+}
+
+std::vector<float> readArray(std::ifstream &in)
+{
+    uint32_t n = readUInt(in);
+    std::vector<float> values(n);
+    in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(n * sizeof(float)));
+    if (!in)
+        throw std::logic_error("unexpected end of file");
+    return values;
+}
+
+/// the results of NativeBackend::run() (copies of the output layers)
+class NativeOutput : public InferenceOutput {
+public:
+    size_t size() const { return values.size(); }
+    TensorView output(size_t i) const {
+        return TensorView(std::string(), InputTensorItem::DT_FLOAT,
+                          { static_cast<int64_t>(rows), static_cast<int64_t>(widths[i]) },
+                          const_cast<float*>(values[i].data()));
+    }
+    size_t rows;
+    std::vector<size_t> widths;
+    std::vector< std::vector<float> > values;
+};
+
+} // end namespace
+
+NativeBackend::NativeBackend()
+{
+}
+
+NativeBackend::~NativeBackend()
+{
+}
+
+const char *NativeBackend::instructionSet()
+{
+#if defined(SVD_NATIVE_AVX512)
+    return "avx512";
+#elif defined(SVD_NATIVE_AVX2)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
+
+void NativeBackend::load(const std::string &file_name, const std::vector<std::string> &output_names)
+{
+    auto lg = spdlog::get("setup");
+    readFile(file_name);
+
+    mOutputLayers.clear();
+    for (const auto &output_name : output_names) {
+        // tensor names may include the output index (e.g. "out/Softmax:0")
+        std::string name = output_name;
+        if (name.size()>2 && name.substr(name.size()-2) == ":0")
+            name = name.substr(0, name.size()-2);
+        auto it = std::find_if(mLayers.begin(), mLayers.end(), [&name](const Layer &l) { return l.name == name; });
+        if (it == mLayers.end())
+            throw std::logic_error("NativeBackend: output '" + output_name + "' is not a layer of the network '" + file_name + "'.");
+        mOutputLayers.push_back(static_cast<size_t>(it - mLayers.begin()));
+    }
+    lg->info("Native inference engine: loaded {} layers from '{}', kernels: {}.", mLayers.size(), file_name, instructionSet());
+}
+
+void NativeBackend::readFile(const std::string &file_name)
+{
+    std::ifstream in(file_name, std::ios::binary);
+    if (!in)
+        throw std::logic_error("NativeBackend: cannot open the network file '" + file_name + "'.");
+    try {
+        char magic[4];
+        in.read(magic, 4);
+        if (!in || std::strncmp(magic, "SVDN", 4) != 0)
+            throw std::logic_error("not a SVD network file (expected 'SVDN' header)");
+        uint32_t version = readUInt(in);
+        if (version != 1)
+            throw std::logic_error("unsupported version " + std::to_string(version));
+        uint32_t n_layers = readUInt(in);
+        mLayers.clear();
+        mLayers.resize(n_layers);
+        for (size_t li=0; li<n_layers; ++li) {
+            Layer &l = mLayers[li];
+            uint32_t type = readUInt(in);
+            uint32_t act = readUInt(in);
+            if (type > Scale)
+                throw std::logic_error("invalid layer type " + std::to_string(type));
+            if (act > Softmax)
+                throw std::logic_error("invalid activation " + std::to_string(act));
+            l.type = static_cast<LayerType>(type);
+            l.activation = static_cast<ActivationType>(act);
+            l.name = readString(in);
+            uint32_t n_inputs = readUInt(in);
+            for (uint32_t i=0; i<n_inputs; ++i) {
+                std::string input_name = readString(in);
+                // inputs need to be defined before the layer
+                auto it = std::find_if(mLayers.begin(), mLayers.begin() + static_cast<long>(li), [&input_name](const Layer &x) { return x.name == input_name; });
+                if (it == mLayers.begin() + static_cast<long>(li))
+                    throw std::logic_error("layer '" + l.name + "': unknown input '" + input_name + "'");
+                l.inputs.push_back(static_cast<size_t>(it - mLayers.begin()));
+            }
+            l.width = readUInt(in);
+            l.nIn = readUInt(in);
+            uint32_t n_arrays = readUInt(in);
+            std::vector< std::vector<float> > arrays;
+            for (uint32_t i=0; i<n_arrays; ++i)
+                arrays.push_back(readArray(in));
+
+            // check the consistency of the layer and set up the weights
+            size_t in_width = l.inputs.empty() ? 0 : mLayers[l.inputs[0]].width;
+            if (l.type != Input && l.type != Concat && l.inputs.size() != 1)
+                throw std::logic_error("layer '" + l.name + "': expected a single input");
+            switch (l.type) {
+            case Input:
+                if (!l.inputs.empty() || l.width == 0 || l.activation != Linear)
+                    throw std::logic_error("input layer '" + l.name + "': invalid definition");
+                break;
+            case Dense: {
+                if (in_width != l.nIn || arrays.empty() || arrays[0].size() != l.nIn * l.width || (arrays.size()>1 && arrays[1].size() != l.width))
+                    throw std::logic_error("dense layer '" + l.name + "': invalid dimensions");
+                // pack the kernel (K x N, row major) into panels of NR columns
+                const size_t n_panels = (l.width + NR - 1) / NR;
+                l.weights.assign(n_panels * l.nIn * NR, 0.f);
+                l.bias.assign(n_panels * NR, 0.f);
+                for (size_t k=0; k<l.nIn; ++k)
+                    for (size_t j=0; j<l.width; ++j)
+                        l.weights[(j / NR)*l.nIn*NR + k*NR + j % NR] = arrays[0][k*l.width + j];
+                if (arrays.size()>1)
+                    std::copy(arrays[1].begin(), arrays[1].end(), l.bias.begin());
+                break;
+            }
+            case Embedding: {
+                if (arrays.size() != 1 || l.nIn == 0 || arrays[0].size() % l.nIn != 0)
+                    throw std::logic_error("embedding layer '" + l.name + "': invalid dimensions");
+                if (in_width * (arrays[0].size() / l.nIn) != l.width)
+                    throw std::logic_error("embedding layer '" + l.name + "': invalid width");
+                l.weights = arrays[0];
+                break;
+            }
+            case Concat: {
+                size_t sum = 0;
+                for (size_t i : l.inputs) sum += mLayers[i].width;
+                if (l.inputs.empty() || sum != l.width)
+                    throw std::logic_error("concat layer '" + l.name + "': invalid width");
+                break;
+            }
+            case Flatten:
+            case Activation:
+                if (in_width != l.width || (l.type == Flatten && l.activation != Linear))
+                    throw std::logic_error("layer '" + l.name + "': invalid width");
+                break;
+            case Scale:
+                if (in_width != l.width || arrays.size() != 2 || arrays[0].size() != l.width || arrays[1].size() != l.width)
+                    throw std::logic_error("scale layer '" + l.name + "': invalid dimensions");
+                l.weights = arrays[0];
+                l.bias = arrays[1];
+                break;
+            }
+        }
+    } catch (const std::logic_error &e) {
+        throw std::logic_error("NativeBackend: error reading the network file '" + file_name + "': " + e.what());
+    }
+}
+
+std::unique_ptr<InferenceOutput> NativeBackend::run(const std::vector<TensorView> &inputs, size_t n_rows)
+{
+    // reduced precision: the first examples are used for calibration (and processed with float32)
+    if (mMode.load(std::memory_order_acquire) == Collecting) {
+        if (collectCalibrationInputs(inputs, n_rows))
+            calibrate();
+    }
+    const bool quantized = mMode.load(std::memory_order_acquire) == Int8;
+
+    // get a workspace (memory of a previous run, if available)
+    std::unique_ptr<Workspace> ws;
+    {
+        std::lock_guard<std::mutex> guard(mWorkspaceLock);
+        if (!mFreeWorkspaces.empty()) {
+            ws = std::move(mFreeWorkspaces.back());
+            mFreeWorkspaces.pop_back();
+        }
+    }
+    if (!ws)
+        ws.reset(new Workspace());
+
+    runNetwork(*ws, inputs, n_rows, quantized);
+
+    NativeOutput *result = new NativeOutput();
+    std::unique_ptr<InferenceOutput> output(result);
+    result->rows = n_rows;
+    for (size_t i : mOutputLayers) {
+        const Layer &l = mLayers[i];
+        result->widths.push_back(l.width);
+        result->values.push_back(std::vector<float>(ws->out[i], ws->out[i] + n_rows * l.width));
+    }
+
+    std::lock_guard<std::mutex> guard(mWorkspaceLock);
+    mFreeWorkspaces.push_back(std::move(ws));
+    return output;
+}
+
+void NativeBackend::runNetwork(Workspace &ws, const std::vector<TensorView> &inputs, size_t n_rows, bool quantized)
+{
+    if (ws.buffers.size() != mLayers.size()) {
+        ws.buffers.resize(mLayers.size());
+        ws.out.resize(mLayers.size(), nullptr);
+    }
+    for (size_t i=0; i<mLayers.size(); ++i)
+        runLayer(i, ws, inputs, n_rows, quantized);
+}
+
+bool NativeBackend::setupPrecision(const std::string &precision, size_t calibration_rows, double max_error)
+{
+    if (precision == "float32") {
+        mMode = Float32;
+        return true;
+    }
+    if (precision != "int8")
+        return false;
+    mCalibrationRows = std::max(calibration_rows, size_t(1));
+    mMaxError = max_error;
+    mCalibrationInputs.clear();
+    mCalibrationCount = 0;
+    mMode = Collecting;
+    spdlog::get("setup")->info("Native inference engine: int8 precision requested (kernels: {}), calibration with {} examples, max. error: {}.",
+#if defined(SVD_NATIVE_INT8_AVX512)
+                               "avx512",
+#elif defined(SVD_NATIVE_INT8_AVX2)
+                               "avx2",
+#else
+                               "scalar",
+#endif
+                               mCalibrationRows, mMaxError);
+    return true;
+}
+
+bool NativeBackend::collectCalibrationInputs(const std::vector<TensorView> &inputs, size_t n_rows)
+{
+    std::lock_guard<std::mutex> guard(mCalibrationLock);
+    if (mMode.load() != Collecting)
+        return false; // another thread already completed the collection
+
+    if (mCalibrationInputs.empty()) {
+        for (const auto &t : inputs) {
+            CalibrationInput ci;
+            ci.view = t;
+            ci.view.data = nullptr;
+            size_t n_values = 1;
+            for (size_t d=1; d<t.shape.size(); ++d)
+                n_values *= static_cast<size_t>(t.shape[d]);
+            ci.rowBytes = t.shape.empty() ? 0 : n_values * InputTensorItem::datatypeSize(t.type);
+            if (t.shape.empty()) // a scalar: store the value
+                ci.data.assign(static_cast<const char*>(t.data), static_cast<const char*>(t.data) + InputTensorItem::datatypeSize(t.type));
+            mCalibrationInputs.push_back(ci);
+        }
+    }
+    if (inputs.size() != mCalibrationInputs.size())
+        throw std::logic_error("NativeBackend: calibration: the number of inputs changed.");
+
+    const size_t n = std::min(n_rows, mCalibrationRows - mCalibrationCount);
+    for (size_t i=0; i<inputs.size(); ++i) {
+        CalibrationInput &ci = mCalibrationInputs[i];
+        if (ci.rowBytes == 0)
+            continue;
+        const char *src = static_cast<const char*>(inputs[i].data);
+        ci.data.insert(ci.data.end(), src, src + n * ci.rowBytes);
+    }
+    mCalibrationCount += n;
+    if (mCalibrationCount < mCalibrationRows)
+        return false;
+    // this thread does the calibration
+    mMode = Calibrating;
+    return true;
+}
+
+void NativeBackend::calibrate()
+{
+    auto lg = spdlog::get("dnn");
+    const size_t n_rows = mCalibrationCount;
+    std::vector<TensorView> inputs;
+    for (auto &ci : mCalibrationInputs) {
+        TensorView t = ci.view;
+        t.data = ci.data.data();
+        if (!t.shape.empty())
+            t.shape[0] = static_cast<int64_t>(n_rows);
+        inputs.push_back(t);
+    }
+
+    // run the float32 network and record the range of the inputs of the dense layers
+    Workspace ws;
+    runNetwork(ws, inputs, n_rows, false);
+    for (auto &l : mLayers) {
+        if (l.type != Dense)
+            continue;
+        const float *in = ws.out[l.inputs[0]];
+        auto range = std::minmax_element(in, in + n_rows * l.nIn);
+        l.quant.inMin = std::min(*range.first, 0.f); // the range includes 0
+        l.quant.inMax = std::max(*range.second, 0.f);
+        quantizeDense(l);
+    }
+    std::vector< std::vector<float> > reference;
+    for (size_t i : mOutputLayers)
+        reference.push_back(std::vector<float>(ws.out[i], ws.out[i] + n_rows * mLayers[i].width));
+
+    // compare int8 with float32: the difference of the probability distributions (total variation distance)
+    // of each example, the difference of the mean distributions, and the agreement of the most likely class
+    auto evaluate = [&](std::vector<std::string> &report) {
+        runNetwork(ws, inputs, n_rows, true);
+        double max_error = 0.;
+        report.clear();
+        for (size_t o=0; o<mOutputLayers.size(); ++o) {
+            const Layer &l = mLayers[mOutputLayers[o]];
+            const float *q = ws.out[mOutputLayers[o]];
+            const float *f = reference[o].data();
+            double sum_tvd = 0., max_tvd = 0.;
+            size_t n_same = 0;
+            std::vector<double> mean_q(l.width, 0.), mean_f(l.width, 0.);
+            for (size_t r=0; r<n_rows; ++r, q+=l.width, f+=l.width) {
+                double tvd = 0.;
+                for (size_t j=0; j<l.width; ++j) {
+                    tvd += std::fabs(q[j] - f[j]);
+                    mean_q[j] += q[j];
+                    mean_f[j] += f[j];
+                }
+                tvd *= 0.5;
+                sum_tvd += tvd;
+                max_tvd = std::max(max_tvd, tvd);
+                if (std::max_element(q, q + l.width) - q == std::max_element(f, f + l.width) - f)
+                    ++n_same;
+            }
+            double mean_tvd = 0.;
+            for (size_t j=0; j<l.width; ++j)
+                mean_tvd += 0.5 * std::fabs(mean_q[j] - mean_f[j]) / static_cast<double>(n_rows);
+            sum_tvd /= static_cast<double>(n_rows);
+            max_error = std::max(max_error, sum_tvd);
+            report.push_back(fmt::format("output '{}': mean difference of distributions: {:.4f} (max: {:.4f}), difference of the mean distribution: {:.4f}, same top class: {:.1f}%",
+                                         l.name, sum_tvd, max_tvd, mean_tvd, 100. * static_cast<double>(n_same) / static_cast<double>(n_rows)));
+        }
+        return max_error;
+    };
+
+    std::vector<std::string> report;
+    double error = evaluate(report);
+    if (error > mMaxError) {
+        // second attempt: keep the output layers in float32
+        lg->info("Int8 calibration: difference {:.4f} > {}: using float32 for the output layers.", error, mMaxError);
+        for (size_t i : mOutputLayers)
+            mLayers[i].quant.enabled = false;
+        error = evaluate(report);
+    }
+    size_t n_quantized = 0;
+    for (const auto &l : mLayers)
+        if (l.type == Dense && l.quant.enabled)
+            ++n_quantized;
+
+    const bool accept = error <= mMaxError && n_quantized > 0;
+    lg->info("Int8 calibration with {} examples ({} int8 dense layers):", n_rows, n_quantized);
+    for (const auto &line : report)
+        lg->info("  {}", line);
+    if (accept)
+        lg->info("Int8 calibration: max. difference {:.4f} <= {}: using int8.", error, mMaxError);
+    else
+        lg->warn("Int8 calibration: max. difference {:.4f} > {} (dnn.precision.maxError): using float32.", error, mMaxError);
+
+    // release the memory of the calibration data
+    {
+        std::lock_guard<std::mutex> guard(mCalibrationLock);
+        mCalibrationInputs.clear();
+        mCalibrationInputs.shrink_to_fit();
+    }
+    // publish the quantized layers
+    mMode.store(accept ? Int8 : Float32, std::memory_order_release);
+}
+
+void NativeBackend::quantizeDense(Layer &l)
+{
+    QuantDense &q = l.quant;
+    const size_t K = l.nIn, N = l.width;
+    auto weight = [&l, K](size_t k, size_t j) { return l.weights[(j / NR)*K*NR + k*NR + j % NR]; };
+
+    // inputs: 7 bit (0..127) with a zero point, the range covers the calibrated values
+    q.inScale = (q.inMax - q.inMin) / 127.f;
+    if (q.inScale <= 0.f)
+        q.inScale = 1.f;
+    q.zeroPoint = static_cast<int>(std::lround(-q.inMin / q.inScale));
+
+    // weights: symmetric, per output column
+    q.kPadded = (K + 3) / 4 * 4;
+    const size_t n_panels = (N + QNR - 1) / QNR;
+    q.weights.assign(n_panels * q.kPadded * QNR, 0);
+    q.scale.assign(n_panels * QNR, 0.f);
+    q.offset.assign(n_panels * QNR, 0.f);
+    for (size_t j=0; j<N; ++j) {
+        float max_abs = 0.f;
+        for (size_t k=0; k<K; ++k)
+            max_abs = std::max(max_abs, std::fabs(weight(k, j)));
+        const float w_scale = max_abs > 0.f ? max_abs / 127.f : 1.f;
+        int32_t col_sum = 0;
+        int8_t *panel = q.weights.data() + (j / QNR)*q.kPadded*QNR;
+        for (size_t k=0; k<K; ++k) {
+            const int8_t w = static_cast<int8_t>(std::max(-127L, std::min(127L, std::lround(weight(k, j) / w_scale))));
+            panel[(k / 4)*4*QNR + (j % QNR)*4 + k % 4] = w;
+            col_sum += w;
+        }
+        // output = (sum(a_q * w_q) - zero_point * sum(w_q)) * in_scale * w_scale + bias
+        q.scale[j] = q.inScale * w_scale;
+        q.offset[j] = l.bias[j] - static_cast<float>(q.zeroPoint * col_sum) * q.scale[j];
+    }
+    q.enabled = true;
+}
+
+void NativeBackend::runLayer(size_t index, Workspace &ws, const std::vector<TensorView> &inputs, size_t n_rows, bool quantized)
+{
+    const Layer &l = mLayers[index];
+    if (l.type == Flatten) {
+        // the data is already contiguous per example
+        ws.out[index] = ws.out[l.inputs[0]];
+        return;
+    }
+    std::vector<float> &buffer = ws.buffers[index];
+    if (buffer.size() < n_rows * l.width)
+        buffer.resize(n_rows * l.width);
+    float *out = buffer.data();
+    ws.out[index] = out;
+
+    switch (l.type) {
+    case Input: {
+        auto it = std::find_if(inputs.begin(), inputs.end(), [&l](const TensorView &t) { return t.name == l.name; });
+        if (it == inputs.end())
+            throw std::logic_error("NativeBackend: the input tensor '" + l.name + "' is not provided.");
+        const TensorView &t = *it;
+        size_t n_values = 1;
+        for (size_t d=1; d<t.shape.size(); ++d)
+            n_values *= static_cast<size_t>(t.shape[d]);
+        if (t.shape.empty()) {
+            // a scalar: the same value for all examples
+            float value = 0.f;
+            switch (t.type) {
+            case InputTensorItem::DT_FLOAT: value = *static_cast<const float*>(t.data); break;
+            case InputTensorItem::DT_BOOL: value = *static_cast<const bool*>(t.data) ? 1.f : 0.f; break;
+            default: throw std::logic_error("NativeBackend: unsupported scalar input '" + l.name + "'.");
+            }
+            std::fill(out, out + n_rows * l.width, value);
+            break;
+        }
+        if (n_values != l.width)
+            throw std::logic_error("NativeBackend: the input tensor '" + l.name + "' has " + std::to_string(n_values) + " values per example (expected: " + std::to_string(l.width) + ").");
+        const size_t n = n_rows * l.width;
+        switch (t.type) {
+        case InputTensorItem::DT_FLOAT: ws.out[index] = static_cast<const float*>(t.data); break; // no copy
+        case InputTensorItem::DT_INT16: convertInput<int16_t>(t.data, out, n); break;
+        case InputTensorItem::DT_UINT16: convertInput<uint16_t>(t.data, out, n); break;
+        case InputTensorItem::DT_INT32: convertInput<int32_t>(t.data, out, n); break;
+        case InputTensorItem::DT_INT64: convertInput<int64_t>(t.data, out, n); break;
+        case InputTensorItem::DT_BOOL: convertInput<bool>(t.data, out, n); break;
+        default: throw std::logic_error("NativeBackend: unsupported data type of input '" + l.name + "'.");
+        }
+        break;
+    }
+    case Dense:
+        if (quantized && l.quant.enabled) {
+            const QuantDense &q = l.quant;
+            if (ws.quantized.size() < n_rows * q.kPadded)
+                ws.quantized.resize(n_rows * q.kPadded);
+            quantizeRows(ws.out[l.inputs[0]], n_rows, l.nIn, q.kPadded, q.inScale, q.zeroPoint, ws.quantized.data());
+            denseForwardInt8(ws.quantized.data(), n_rows, q.kPadded, l.width, q.weights.data(), q.scale.data(), q.offset.data(), out);
+        } else {
+            denseForward(ws.out[l.inputs[0]], n_rows, l.nIn, l.width, l.weights.data(), l.bias.data(), out);
+        }
+        break;
+    case Embedding: {
+        const Layer &in = mLayers[l.inputs[0]];
+        const size_t dim = l.weights.size() / l.nIn;
+        const float *src = ws.out[l.inputs[0]];
+        for (size_t i=0; i<n_rows * in.width; ++i, out+=dim) {
+            const long index = std::lround(src[i]);
+            if (index < 0 || static_cast<size_t>(index) >= l.nIn)
+                throw std::logic_error("NativeBackend: embedding '" + l.name + "': index " + std::to_string(index) + " out of range.");
+            std::memcpy(out, l.weights.data() + static_cast<size_t>(index)*dim, dim*sizeof(float));
+        }
+        break;
+    }
+    case Concat: {
+        size_t offset = 0;
+        for (size_t li : l.inputs) {
+            const Layer &in = mLayers[li];
+            for (size_t r=0; r<n_rows; ++r)
+                std::memcpy(out + r*l.width + offset, ws.out[li] + r*in.width, in.width*sizeof(float));
+            offset += in.width;
+        }
+        break;
+    }
+    case Activation:
+        std::memcpy(out, ws.out[l.inputs[0]], n_rows*l.width*sizeof(float));
+        break;
+    case Scale: {
+        const float *src = ws.out[l.inputs[0]];
+        for (size_t r=0; r<n_rows; ++r)
+            for (size_t j=0; j<l.width; ++j, ++src)
+                out[r*l.width + j] = *src * l.weights[j] + l.bias[j];
+        break;
+    }
+    case Flatten: break;
+    }
+    applyActivation(l.activation, buffer.data(), n_rows, l.width);
+}
@@ -0,0 +1,114 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef NATIVEBACKEND_H
+#define NATIVEBACKEND_H
+
+#include "inferencebackend.h"
+
+#include <mutex>
+#include <atomic>
+
+/**
+ * @brief The NativeBackend class is a built-in CPU inference engine for the (small) feed forward networks
+ * used by SVD (embeddings, dense layers, softmax heads).
+ *
+ * The network is loaded from a simple binary file (exported weights, see dnn_setup.md). Layers are executed
+ * in the order of the file; dense layers use a cache-blocked matrix multiplication with AVX2 or AVX-512 kernels
+ * (selected at compile time, see config.pri), and a scalar fallback otherwise.
+ * A single run is single threaded; run() can be called from several threads (`dnn.threads`) at the same time.
+ *
+ * Optionally, dense layers are executed with 8 bit integers (`dnn.precision=int8`): weights are quantized per
+ * output column, the inputs of the layers with a fixed range per layer. The ranges are calibrated with the inputs of the
+ * first examples of the run (which are processed with float32). The int8 network is then compared with
+ * the float32 network on these examples; int8 is used only if the difference is below a threshold.
+ */
+class NativeBackend : public InferenceBackend
+{
+public:
+    NativeBackend();
+    ~NativeBackend();
+    std::string name() const { return "native"; }
+    void load(const std::string &file_name, const std::vector<std::string> &output_names);
+    std::unique_ptr<InferenceOutput> run(const std::vector<TensorView> &inputs, size_t n_rows);
+    bool setupPrecision(const std::string &precision, size_t calibration_rows, double max_error);
+
+    /// the instruction set of the compute kernels ("avx512", "avx2" or "scalar")
+    static const char *instructionSet();
+
+    enum LayerType { Input=0, Dense=1, Embedding=2, Concat=3, Flatten=4, Activation=5, Scale=6 };
+    enum ActivationType { Linear=0, ReLU=1, ELU=2, Tanh=3, Sigmoid=4, Softmax=5 };
+private:
+    /// int8 version of a dense layer
+    struct QuantDense {
+        bool enabled {false};
+        float inMin {0.f}, inMax {0.f}; ///< calibrated range of the input values
+        float inScale {1.f}; ///< input value = (quantized value - zeroPoint) * inScale
+        int zeroPoint {0};
+        size_t kPadded {0}; ///< number of inputs (padded to a multiple of 4)
+        std::vector<int8_t> weights; ///< packed kernel (panels)
+        std::vector<float> scale; ///< output = sum * scale + offset (per output column)
+        std::vector<float> offset;
+    };
+    struct Layer {
+        LayerType type;
+        ActivationType activation;
+        std::string name;
+        std::vector<size_t> inputs; ///< index of input layers
+        size_t width; ///< number of output values per example
+        size_t nIn; ///< number of input values per example (Dense), size of the vocabulary (Embedding)
+        std::vector<float> weights; ///< Dense: packed kernel (panels), Embedding: table (nIn x dim), Scale: factors
+        std::vector<float> bias; ///< Dense: bias (padded to the panel width), Scale: offsets
+        QuantDense quant; ///< Dense: int8 version (dnn.precision)
+    };
+    /// the memory of a single run (run() can be called from several threads at the same time)
+    struct Workspace {
+        std::vector< std::vector<float> > buffers; ///< output values of each layer (rows x width)
+        std::vector<const float*> out; ///< pointer to the output of each layer (buffer, input data or the input of a Flatten)
+        std::vector<uint8_t> quantized; ///< quantized input of an int8 dense layer
+    };
+    void readFile(const std::string &file_name);
+    void runLayer(size_t index, Workspace &ws, const std::vector<TensorView> &inputs, size_t n_rows, bool quantized);
+    void runNetwork(Workspace &ws, const std::vector<TensorView> &inputs, size_t n_rows, bool quantized);
+    std::vector<Layer> mLayers;
+    std::vector<size_t> mOutputLayers;
+    std::mutex mWorkspaceLock;
+    std::vector< std::unique_ptr<Workspace> > mFreeWorkspaces; ///< workspaces that are currently not used
+
+    // reduced precision
+    enum Mode { Float32=0, Collecting=1, Calibrating=2, Int8=3 };
+    std::atomic<int> mMode {Float32};
+    /// copy of the inputs of the first examples (used for calibration)
+    struct CalibrationInput {
+        TensorView view; ///< name, type and shape (as in the first batch)
+        size_t rowBytes; ///< bytes per example (0 for scalars)
+        std::vector<char> data;
+    };
+    std::mutex mCalibrationLock;
+    std::vector<CalibrationInput> mCalibrationInputs;
+    size_t mCalibrationRows {0}; ///< number of examples used for calibration
+    size_t mCalibrationCount {0}; ///< number of examples collected so far
+    double mMaxError {0.}; ///< max. allowed difference (int8 vs float32)
+    /// store the inputs for calibration; returns true if enough examples are available
+    bool collectCalibrationInputs(const std::vector<TensorView> &inputs, size_t n_rows);
+    /// calibrate the int8 layers and compare with float32 (sets the mode to Int8 or Float32)
+    void calibrate();
+    void quantizeDense(Layer &l);
+};
+
+#endif // NATIVEBACKEND_H
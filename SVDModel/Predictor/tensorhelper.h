@@ -1,43 +1,61 @@
 #ifndef TENSORHELPER_H
 #define TENSORHELPER_H
 
-#ifdef COMPILER_MSVC
-#pragma warning(push, 0)
-#endif
-
-#include "tensorflow/core/framework/tensor.h"
-
-#ifdef COMPILER_MSVC
-#pragma warning(pop)
-#endif
-
 #include <stdint.h>
-
-/// Some array conversion tools.
-/// \author David Stutz
-template<typename T, int NDIMS>
-class TensorConversion {
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include "inputtensoritem.h"
+
+/// A block of memory aligned to 64 bytes (cache line / AVX-512), which
+/// is used as the storage of tensors. Inference backends read the memory without copying.
+class AlignedBuffer {
 public:
-
-  /// Access the underlying data pointer of the tensor.
-  /// \param tensor
-  /// \return
-  static T* AccessDataPointer(const tensorflow::Tensor &tensor) {
-    // get underlying Eigen tensor
-    auto tensor_map = tensor.tensor<T, NDIMS>();
-    // get the underlying array
-    auto array = tensor_map.data();
-    return const_cast<T*>(array);
-  }
+    static const size_t Alignment = 64;
+    AlignedBuffer(size_t n_bytes) {
+        mSize = n_bytes;
+        mMemory.reset(new char[n_bytes + Alignment]);
+        size_t offset = reinterpret_cast<uintptr_t>(mMemory.get()) % Alignment;
+        mData = mMemory.get() + (offset ? Alignment - offset : 0);
+        std::memset(mData, 0, n_bytes);
+    }
+    void *data() const { return mData; }
+    size_t size() const { return mSize; }
+private:
+    std::unique_ptr<char[]> mMemory;
+    char *mData;
+    size_t mSize;
 };
 
-
+/// the data type (see InputTensorItem) of the C++ type T
+template<typename T>
+InputTensorItem::DataType tensorDataType() {
+    InputTensorItem::DataType dt = InputTensorItem::DT_FLOAT;
+    if (typeid(T)==typeid(float)) dt=InputTensorItem::DT_FLOAT;
+    if (typeid(T)==typeid(int64_t) || typeid(T)==typeid(long long)) dt=InputTensorItem::DT_INT64;
+    if (typeid(T)==typeid(int32_t)) dt=InputTensorItem::DT_INT32;
+    if (typeid(T)==typeid(unsigned short)) dt=InputTensorItem::DT_UINT16;
+    if (typeid(T)==typeid(short int)) dt=InputTensorItem::DT_INT16;
+    if (typeid(T)==typeid(bool)) dt=InputTensorItem::DT_BOOL;
+    return dt;
+}
+
+/// TensorWrapper is the base class of tensors used as input for the DNN.
+/// The data is stored contiguously (row major, the first dimension is the batch).
 class TensorWrapper {
 public:
-    virtual tensorflow::Tensor &tensor() = 0;
     virtual int ndim() const = 0;
-    virtual tensorflow::DataType dataType() const = 0;
+    virtual InputTensorItem::DataType dataType() const = 0;
     virtual std::string asString(size_t example) const = 0;
+    /// pointer to the first element
+    virtual void *data() const = 0;
+    /// the dimensions of the tensor (including the batch dimension), empty for scalars
+    virtual std::vector<int64_t> shape() const = 0;
     virtual ~TensorWrapper() {}
 };
 
@@ -46,35 +64,26 @@ template<typename T>
 class TensorWrap1d : public TensorWrapper
 {
 public:
-    TensorWrap1d() {
-        tensorflow::DataType dt = tensorflow::DT_FLOAT;
-        if (typeid(T)==typeid(float)) dt=tensorflow::DT_FLOAT;
-        if (typeid(T)==typeid(int64_t)) dt=tensorflow::DT_INT64;
-        if (typeid(T)==typeid(int32_t)) dt=tensorflow::DT_INT32;
-        if (typeid(T)==typeid(unsigned short)) dt=tensorflow::DT_UINT16;
-        if (typeid(T)==typeid(short int)) dt=tensorflow::DT_INT16;
-        if (typeid(T)==typeid(bool)) dt=tensorflow::DT_BOOL;
+    TensorWrap1d(): mBuffer(sizeof(T)) {
         // create a scalar
-        mTensor = tensorflow::Tensor(dt, tensorflow::TensorShape());
-        mDataType = dt;
-        // mData = TensorConversion<T,1>::AccessDataPointer(mTensor);
+        mDataType = tensorDataType<T>();
     }
     ~TensorWrap1d() {}
-    tensorflow::Tensor &tensor()  { return mTensor; }
+    void *data() const { return mBuffer.data(); }
+    std::vector<int64_t> shape() const { return std::vector<int64_t>(); }
     size_t n() const  { return 1; }
     int ndim() const { return 0; }
-    tensorflow::DataType dataType() const  { return mDataType; }
-    T value() const { return mTensor.scalar<bool>()(); }
-    void setValue(T value) { mTensor.scalar<bool>()() = value; }
+    InputTensorItem::DataType dataType() const  { return mDataType; }
+    T value() const { return *static_cast<T*>(mBuffer.data()); }
+    void setValue(T value) { *static_cast<T*>(mBuffer.data()) = value; }
     std::string asString(size_t /*example*/) const {
         std::stringstream ss;
         ss << "Scalar: " << value();
         return ss.str();
     }
 private:
-    tensorflow::DataType mDataType;
-    tensorflow::Tensor mTensor;
-    //T* mData;
+    InputTensorItem::DataType mDataType;
+    AlignedBuffer mBuffer;
 };
 
 
@@ -82,34 +91,27 @@ template<typename T>
 class TensorWrap2d : public TensorWrapper
 {
 public:
+    /// create a tensor (batch_size x n) with its own memory
     TensorWrap2d(size_t batch_size, size_t n) {
         mBatchSize = batch_size; mN=n;
-        tensorflow::DataType dt = tensorflow::DT_FLOAT;
-        if (typeid(T)==typeid(float)) dt=tensorflow::DT_FLOAT;
-        if (typeid(T)==typeid(int64_t)) dt=tensorflow::DT_INT64;
-        if (typeid(T)==typeid(int32_t)) dt=tensorflow::DT_INT32;
-        if (typeid(T)==typeid(unsigned short)) dt=tensorflow::DT_UINT16;
-        if (typeid(T)==typeid(short int)) dt=tensorflow::DT_INT16;
-        if (typeid(T)==typeid(bool)) dt=tensorflow::DT_BOOL;
-        mDataType = dt;
-        mT = new tensorflow::Tensor(dt, tensorflow::TensorShape({ static_cast<int>(mBatchSize), static_cast<int>(mN)}));
-        mData = TensorConversion<T,2>::AccessDataPointer(*mT);
-        mPrivateTensor=true;
+        mDataType = tensorDataType<T>();
         mNBytes = sizeof(T) * mBatchSize * mN;
+        mBuffer.reset(new AlignedBuffer(mNBytes));
+        mData = static_cast<T*>(mBuffer->data());
     }
-    TensorWrap2d(tensorflow::Tensor &tensor) {
-        mBatchSize = tensor.dim_size(0);
-        mN = tensor.dim_size(1);
-        mT = &tensor;
-        mData = TensorConversion<T,2>::AccessDataPointer(tensor);
-        mPrivateTensor=false;
+    /// wrap existing memory (e.g. results of a backend); the memory is not owned
+    TensorWrap2d(T *data, size_t batch_size, size_t n) {
+        mBatchSize = batch_size; mN=n;
+        mDataType = tensorDataType<T>();
         mNBytes = sizeof(T) * mBatchSize * mN;
+        mData = data;
     }
-    tensorflow::Tensor &tensor()  { return *mT; }
+    void *data() const { return mData; }
+    std::vector<int64_t> shape() const { return { static_cast<int64_t>(mBatchSize), static_cast<int64_t>(mN) }; }
     size_t n() const  { return mN; }
     int ndim() const { return 2; }
     size_t batchSize() const { return mBatchSize; }
-    tensorflow::DataType dataType() const  { return mDataType; }
+    InputTensorItem::DataType dataType() const  { return mDataType; }
     T *example(size_t element) const {
         assert(element*mN*sizeof(T)<mNBytes);
         return mData + element*mN; }
@@ -121,12 +123,11 @@ public:
         return ss.str();
     }
 
-    ~TensorWrap2d() { if (mPrivateTensor) delete mT; }
+    ~TensorWrap2d() { }
 private:
-    tensorflow::DataType mDataType;
+    InputTensorItem::DataType mDataType;
 
-    bool mPrivateTensor;
-    tensorflow::Tensor *mT;
+    std::unique_ptr<AlignedBuffer> mBuffer; ///< memory (if owned by the tensor)
     T *mData;
     size_t mBatchSize;
     size_t mN;
@@ -137,36 +138,25 @@ template<typename T>
 class TensorWrap3d : public TensorWrapper
 {
 public:
+    /// create a tensor (batch_size x nx x ny) with its own memory
     TensorWrap3d(size_t batch_size, size_t nx, size_t ny) {
         mBatchSize = batch_size; mRows=nx; mCols=ny;
-        tensorflow::DataType dt = tensorflow::DT_FLOAT;
-        if (typeid(T)==typeid(float)) dt=tensorflow::DT_FLOAT;
-        if (typeid(T)==typeid(int64_t)) dt=tensorflow::DT_INT64;
-        if (typeid(T)==typeid(int32_t)) dt=tensorflow::DT_INT32;
-        if (typeid(T)==typeid(unsigned short)) dt=tensorflow::DT_UINT16;
-        if (typeid(T)==typeid(short int)) dt=tensorflow::DT_INT16;
-        if (typeid(T)==typeid(bool)) dt=tensorflow::DT_BOOL;
-
-        mDataType = dt;
-
-        mT = new tensorflow::Tensor(dt, tensorflow::TensorShape({ static_cast<int>(mBatchSize), static_cast<int>(mRows), static_cast<int>(mCols)}));
-        mData = TensorConversion<T,3>::AccessDataPointer(*mT);
-        mPrivateTensor = true;
+        mDataType = tensorDataType<T>();
         mNBytes = sizeof(T) * mBatchSize * mRows * mCols;
+        mBuffer.reset(new AlignedBuffer(mNBytes));
+        mData = static_cast<T*>(mBuffer->data());
     }
-    TensorWrap3d(tensorflow::Tensor &tensor) {
-        mBatchSize = tensor.dim_size(0);
-        mRows = tensor.dim_size(1);
-        mCols = tensor.dim_size(2);
-        mT = &tensor;
-        mData = TensorConversion<T,3>::AccessDataPointer(tensor);
-        mPrivateTensor=false;
+    /// wrap existing memory; the memory is not owned
+    TensorWrap3d(T *data, size_t batch_size, size_t nx, size_t ny) {
+        mBatchSize = batch_size; mRows=nx; mCols=ny;
+        mDataType = tensorDataType<T>();
         mNBytes = sizeof(T) * mBatchSize * mRows * mCols;
+        mData = data;
     }
 
-     ~TensorWrap3d() { if (mPrivateTensor)
-            delete mT; }
-    tensorflow::Tensor &tensor()  { return *mT; }
+    ~TensorWrap3d() { }
+    void *data() const { return mData; }
+    std::vector<int64_t> shape() const { return { static_cast<int64_t>(mBatchSize), static_cast<int64_t>(mRows), static_cast<int64_t>(mCols) }; }
     size_t rows() const { return mRows; }
     size_t cols() const {return mCols; }
     T *example(size_t element) {
@@ -178,7 +168,7 @@ public:
 
     int ndim() const { return 3; }
     size_t batchSize() const { return mBatchSize; }
-    tensorflow::DataType dataType() const  { return mDataType; }
+    InputTensorItem::DataType dataType() const  { return mDataType; }
     std::string asString(size_t example) const {
         std::stringstream ss;
         for (size_t r=0;r<rows(); ++r) {
@@ -191,10 +181,9 @@ public:
 
 
 private:
-    tensorflow::DataType mDataType;
-    bool mPrivateTensor;
+    InputTensorItem::DataType mDataType;
+    std::unique_ptr<AlignedBuffer> mBuffer; ///< memory (if owned by the tensor)
 
-    tensorflow::Tensor *mT;
     T *mData;
     size_t mBatchSize;
     size_t mRows;
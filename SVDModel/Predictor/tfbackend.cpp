@@ -0,0 +1,187 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "tfbackend.h"
+
+#include <stdexcept>
+#include "spdlog/spdlog.h"
+
+#ifdef COMPILER_MSVC
+#pragma warning(push, 0)
+#endif
+
+#include "tensorflow/cc/ops/const_op.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/graph_def_builder.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/public/session.h"
+
+#ifdef COMPILER_MSVC
+#pragma warning(pop)
+#endif
+
+using tensorflow::Tensor;
+using tensorflow::Status;
+
+namespace {
+/// TensorBuffer that points to memory owned by SVD (see AlignedBuffer): no copy of the input data.
+class WrappedBuffer : public tensorflow::TensorBuffer {
+public:
+    WrappedBuffer(void *data, size_t n_bytes): tensorflow::TensorBuffer(data), mBytes(n_bytes) {}
+    size_t size() const override { return mBytes; }
+    tensorflow::TensorBuffer *root_buffer() override { return this; }
+    void FillAllocationDescription(tensorflow::AllocationDescription *proto) const override {
+        proto->set_requested_bytes(static_cast<int64_t>(mBytes));
+        proto->set_allocator_name("svd");
+    }
+    bool OwnsMemory() const override { return false; }
+private:
+    size_t mBytes;
+};
+
+/// the results of Session::Run()
+class TFOutput : public InferenceOutput {
+public:
+    size_t size() const { return tensors.size(); }
+    TensorView output(size_t i) const {
+        const Tensor &t = tensors.at(i);
+        std::vector<int64_t> shape;
+        for (int d=0; d<t.dims(); ++d)
+            shape.push_back(static_cast<int64_t>(t.dim_size(d)));
+        // the data types of InputTensorItem use the same values as TensorFlow
+        return TensorView(std::string(), static_cast<InputTensorItem::DataType>(t.dtype()), shape,
+                          const_cast<char*>(t.tensor_data().data()));
+    }
+    std::vector<Tensor> tensors;
+};
+} // end namespace
+
+TFBackend::TFBackend()
+{
+    mSession = nullptr;
+    mTopKSession = nullptr;
+}
+
+TFBackend::~TFBackend()
+{
+    if (mSession) {
+        mSession->Close();
+        delete mSession;
+    }
+    if (mTopKSession) {
+        mTopKSession->Close();
+        delete mTopKSession;
+    }
+}
+
+void TFBackend::load(const std::string &file_name, const std::vector<std::string> &output_names)
+{
+    auto lg = spdlog::get("setup");
+    mOutputNames = output_names;
+    if (mSession) {
+        lg->info("Session is already open... closing.");
+        mSession->Close();
+        delete mSession;
+        mSession = nullptr;
+    }
+
+    tensorflow::SessionOptions opts;
+    // log of device placement if log level debug is on
+    if (lg->should_log(spdlog::level::debug))
+        opts.config.set_log_device_placement(true);
+
+    lg->debug("Available GPUs: '{}'", opts.config.gpu_options().visible_device_list());
+    opts.config.mutable_gpu_options()->set_allow_growth(true); // do not allocate all the RAM
+
+    tensorflow::GraphDef graph_def;
+    Status status = ReadBinaryProto(tensorflow::Env::Default(), file_name, &graph_def);
+    if (!status.ok())
+        throw std::logic_error("Failed to load the compute graph from '" + file_name + "': " + std::string(status.error_message()));
+
+    mSession = tensorflow::NewSession(opts);
+    lg->trace("attempting to load the graph...");
+    status = mSession->Create(graph_def);
+    if (!status.ok())
+        throw std::logic_error("Error loading the graph: " + std::string(status.error_message()));
+    lg->trace("Successfully loaded graph!");
+}
+
+bool TFBackend::setupTopK(size_t n_top, size_t n_classes)
+{
+    auto lg = spdlog::get("setup");
+    lg->trace("build the top-k graph...");
+    // the input is fed at runtime (with the actual number of rows)
+    Tensor top_k_tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({1, static_cast<int>(n_classes)}));
+
+    auto root = tensorflow::Scope::NewRootScope();
+    tensorflow::ops::TopK tk(root.WithOpName("top_k"), top_k_tensor, static_cast<int>(n_top));
+
+    tensorflow::GraphDef graph;
+    Status status = root.ToGraphDef(&graph);
+    if (!status.ok()) {
+        lg->error("Error building top-k graph definition: {}", status.error_message());
+        return false;
+    }
+
+    mTopKSession = tensorflow::NewSession(tensorflow::SessionOptions());
+    status = mTopKSession->Create(graph);
+    if (!status.ok()) {
+        lg->error("Error creating top-k graph: {}", status.error_message());
+        delete mTopKSession;
+        mTopKSession = nullptr;
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<InferenceOutput> TFBackend::run(const std::vector<TensorView> &inputs, size_t n_rows)
+{
+    if (!mSession)
+        throw std::logic_error("TFBackend: no network loaded.");
+
+    std::vector<std::pair<std::string, Tensor> > feeds;
+    for (const auto &in : inputs) {
+        tensorflow::DataType dt = static_cast<tensorflow::DataType>(in.type);
+        tensorflow::TensorShape shape;
+        for (size_t d=0; d<in.shape.size(); ++d)
+            shape.AddDim(d==0 ? static_cast<int64_t>(n_rows) : in.shape[d]); // only the used rows
+        size_t n_bytes = static_cast<size_t>(shape.num_elements()) * tensorflow::DataTypeSize(dt);
+        WrappedBuffer *buffer = new WrappedBuffer(in.data, n_bytes);
+        feeds.push_back(std::pair<std::string, Tensor>(in.name, Tensor(dt, shape, buffer)));
+        buffer->Unref(); // the tensor holds a reference
+    }
+
+    std::unique_ptr<TFOutput> result(new TFOutput());
+    Status status = mSession->Run(feeds, mOutputNames, {}, &result->tensors);
+    if (!status.ok())
+        throw std::logic_error("Tensorflow error (run main network): " + std::string(status.error_message()));
+
+    if (mTopKSession && !result->tensors.empty()) {
+        std::vector<Tensor> topk_output;
+        status = mTopKSession->Run({ {"Const/Const" , result->tensors[0]} }, {"top_k:0", "top_k:1"}, {}, &topk_output);
+        if (!status.ok())
+            throw std::logic_error("Tensorflow error (run top-k): " + std::string(status.error_message()));
+        result->tensors.push_back(topk_output[0]);
+        result->tensors.push_back(topk_output[1]);
+    }
+    return std::unique_ptr<InferenceOutput>(result.release());
+}
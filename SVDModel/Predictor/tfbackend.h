@@ -0,0 +1,49 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef TFBACKEND_H
+#define TFBACKEND_H
+
+#include "inferencebackend.h"
+
+namespace tensorflow { // forward declarations...
+class Session;
+}
+
+/**
+ * @brief The TFBackend class runs the DNN with TensorFlow (a frozen graph, `dnn.file`).
+ *
+ * Input buffers are passed to TensorFlow without copying (wrapped in a TensorBuffer).
+ * Top-k classes can be computed by a separate TensorFlow graph (e.g. on the GPU, `dnn.topKGPU`).
+ */
+class TFBackend : public InferenceBackend
+{
+public:
+    TFBackend();
+    ~TFBackend();
+    std::string name() const { return "tensorflow"; }
+    void load(const std::string &file_name, const std::vector<std::string> &output_names);
+    bool setupTopK(size_t n_top, size_t n_classes);
+    std::unique_ptr<InferenceOutput> run(const std::vector<TensorView> &inputs, size_t n_rows);
+private:
+    tensorflow::Session *mSession;
+    tensorflow::Session *mTopKSession;
+    std::vector<std::string> mOutputNames;
+};
+
+#endif // TFBACKEND_H
@@ -0,0 +1,101 @@
+QT -= gui
+QT += core concurrent
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+# The following define makes your compiler emit warnings if you use
+# any Qt feature that has been marked deprecated (the exact warnings
+# depend on your compiler). Please consult the documentation of the
+# deprecated API in order to know how to port your code away from it.
+DEFINES += QT_DEPRECATED_WARNINGS
+
+
+# You can also make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+# You can also select to disable deprecated APIs only up to a certain version of Qt.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+INCLUDEPATH += ../SVDCore ../SVDCore/third_party ../SVDCore/tools ../SVDCore/core ../SVDCore/outputs
+
+include(../config.pri)
+
+
+INCLUDEPATH += ../Predictor
+
+SOURCES += \
+    main.cpp
+
+win32 {
+
+*msvc*: {
+    CONFIG (release, debug|release): {
+        LIBS += -L../Predictor/release -lPredictor
+        PRE_TARGETDEPS += ../Predictor/release/Predictor.lib
+        LIBS += -L../SVDCore/release -lSVDCore
+        PRE_TARGETDEPS += ../SVDCore/release/SVDCore.lib
+    } else {
+        LIBS += -L../Predictor/debug -lPredictor
+        PRE_TARGETDEPS += ../Predictor/debug/Predictor.lib
+        LIBS += -L../SVDCore/debug -lSVDCore
+        PRE_TARGETDEPS += ../SVDCore/debug/SVDCore.lib
+    }
+    contains(DEFINES, USE_TENSORFLOW): LIBS += -L../../tensorflow/lib14cpu -ltensorflow
+    LIBS += -L../../../SVDCore/third_party/FreeImage -lFreeImage
+
+
+} else {
+# for example, llvm
+    CONFIG (release, debug|release): {
+        LIBS += -L../Predictor/release -lPredictor
+        PRE_TARGETDEPS += ../Predictor/release/libPredictor.a
+        LIBS += -L../SVDCore/release -lSVDCore
+        PRE_TARGETDEPS += ../SVDCore/release/libSVDCore.a
+    } else {
+        LIBS += -L../Predictor/debug -lPredictor
+        PRE_TARGETDEPS += ../Predictor/debug/libPredictor.a
+        LIBS += -L../SVDCore/debug -lSVDCore
+        PRE_TARGETDEPS += ../SVDCore/debug/libSVDCore.a
+    }
+    contains(DEFINES, USE_TENSORFLOW): LIBS += -L"..\..\..\..\tensorflow\lib14cpu" -ltensorflow
+    LIBS += -L"..\..\..\SVDCore\third_party\FreeImage" -lFreeImage
+
+}
+
+
+
+LIBS += -L../../../../../tensorflow\tensorflow\contrib\cmake\build\protobuf\src\protobuf\RelWithDebInfo -llibprotobuf
+
+# for profiling only:
+# LIBS += -L"C:/Program Files/NVIDIA GPU Computing Toolkit/CUDA/v8.0/lib/x64" -lcudart
+}
+
+
+linux-g++ {
+PRE_TARGETDEPS += ../SVDCore/libSVDCore.a
+PRE_TARGETDEPS += ../Predictor/libPredictor.a
+
+# pre-compiled (local)
+# PRE_TARGETDEPS += /usr/lib/tensorflow-cpp/libtensorflow_cc.so
+# PRE_TARGETDEPS += /usr/local/lib/libtensorflow_cc.so
+# PRE_TARGETDEPS += /home/werner/dev/tensorflow/libtensorflow_cc2.11/usr/local/lib/libtensorflow_cc.so
+#PRE_TARGETDEPS += /usr/local/lib/libtensorflow_framework.so
+
+LIBS += -L../SVDCore -lSVDCore
+LIBS += -L../Predictor -lPredictor
+#LIBS += -L/usr/lib/tensorflow-cpp/ -libtensorflow_cc.so
+LIBS += -L/usr/lib/x86_64-linux-gnu -lfreeimage
+LIBS += -Lusr/local/lib -ltensorflow_cc -lprotobuf -ltensorflow_framework
+
+}
+
+# standard linux location
+# unix:!macx: LIBS += -L/usr/lib/tensorflow-cpp/ -ltensorflow_cc
+
+# INCLUDEPATH += $$PWD/../../../../../../usr/lib/tensorflow-cpp
+# DEPENDPATH += $$PWD/../../../../../../usr/lib/tensorflow-cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
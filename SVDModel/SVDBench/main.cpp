@@ -0,0 +1,196 @@
+#include <locale.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <memory>
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_sinks.h"
+
+#include "../Predictor/batchrecorder.h"
+#include "../Predictor/inferencebackend.h"
+
+// SVDBench replays the DNN inputs recorded by SVD (dnn.record.file) through an inference backend
+// and reports the throughput and the latency of the inference for different batch sizes and numbers of threads.
+
+static std::vector<size_t> parseList(const std::string &s)
+{
+    std::vector<size_t> result;
+    size_t start = 0;
+    while (start < s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos)
+            end = s.size();
+        if (end > start)
+            result.push_back(static_cast<size_t>(std::strtoul(s.substr(start, end - start).c_str(), nullptr, 10)));
+        start = end + 1;
+    }
+    result.erase(std::remove(result.begin(), result.end(), size_t(0)), result.end());
+    return result;
+}
+
+/// the value at the percentile `p` (0..1) of the sorted `values`
+static double percentile(const std::vector<double> &values, double p)
+{
+    if (values.empty())
+        return 0.;
+    size_t i = static_cast<size_t>(std::max(0., std::ceil(p * static_cast<double>(values.size())) - 1.));
+    return values[std::min(i, values.size() - 1)];
+}
+
+static void usage()
+{
+    printf("Usage: \n");
+    printf("SVDBench <recording> <...options>\n");
+    printf("Replays the inputs of the DNN recorded with 'dnn.record.file' through the inference backend.\n");
+    printf("Options:\n");
+    printf("  --network <file>     the network file (default: the network used for the recording)\n");
+    printf("  --backend <name>     the inference backend: native or tensorflow (default: native)\n");
+    printf("  --precision <p>      float32 or int8 (default: float32)\n");
+    printf("  --maxError <value>   max. difference of int8 and float32 (default: 0.01)\n");
+    printf("  --batch <list>       batch sizes, e.g. 256,1024,4096 (default: 1024)\n");
+    printf("  --threads <list>     number of threads, e.g. 1,2,4 (default: 1)\n");
+    printf("  --instances <n>      number of backend instances (default: 1, the threads share the instances)\n");
+    printf("  --repeat <n>         number of passes over the recording (default: 1)\n");
+    printf("E.g.: SVDBench inputs.bin --backend native --batch 512,2048 --threads 1,4\n");
+}
+
+int main(int argc, char *argv[])
+{
+    setlocale(LC_ALL, "C");
+    printf("SVD inference benchmark\n");
+    if (argc < 2) {
+        usage();
+        return 0;
+    }
+
+    std::string record_file = argv[1];
+    std::string network_file, backend_name = "native", precision = "float32";
+    double max_error = 0.01;
+    std::vector<size_t> batch_sizes = { 1024 }, thread_counts = { 1 };
+    size_t n_instances = 1, n_repeat = 1;
+    for (int i=2; i<argc; ++i) {
+        std::string key = argv[i];
+        if (i + 1 >= argc) {
+            printf("Missing value for option '%s'.\n", key.c_str());
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (key == "--network") network_file = value;
+        else if (key == "--backend") backend_name = value;
+        else if (key == "--precision") precision = value;
+        else if (key == "--maxError") max_error = std::atof(value.c_str());
+        else if (key == "--batch") batch_sizes = parseList(value);
+        else if (key == "--threads") thread_counts = parseList(value);
+        else if (key == "--instances") n_instances = std::max(static_cast<size_t>(std::atoi(value.c_str())), size_t(1));
+        else if (key == "--repeat") n_repeat = std::max(static_cast<size_t>(std::atoi(value.c_str())), size_t(1));
+        else {
+            printf("Invalid option '%s'.\n", key.c_str());
+            usage();
+            return 1;
+        }
+    }
+    if (batch_sizes.empty() || thread_counts.empty()) {
+        printf("Invalid list of batch sizes or threads.\n");
+        return 1;
+    }
+
+    // the backends log to the 'setup' and 'dnn' loggers
+    auto sink = std::make_shared<spdlog::sinks::stdout_sink_mt>();
+    spdlog::create("setup", sink)->set_level(spdlog::level::info);
+    spdlog::create("dnn", sink)->set_level(spdlog::level::info);
+
+    try {
+        BatchRecorder::Recording rec = BatchRecorder::read(record_file);
+        if (network_file.empty())
+            network_file = rec.networkFile;
+        printf("Recording '%s': %zu batches, %zu examples, %zu input tensors.\n", record_file.c_str(), rec.batchSizes.size(), rec.nRows, rec.tensors.size());
+        for (const auto &t : rec.tensors) {
+            std::string shape;
+            for (auto d : t.shape)
+                shape += (shape.empty() ? "" : "x") + std::to_string(d);
+            printf("  %s (%s, %s): %s\n", t.name.c_str(), InputTensorItem::datatypeString(t.type).c_str(),
+                   InputTensorItem::contentString(t.content).c_str(), shape.empty() ? "scalar" : shape.c_str());
+        }
+        if (rec.nRows == 0) {
+            printf("The recording contains no examples.\n");
+            return 1;
+        }
+
+        // set up the backend(s)
+        const size_t calibration_rows = std::min(rec.nRows, size_t(4096));
+        std::vector< std::unique_ptr<InferenceBackend> > backends;
+        for (size_t i=0; i<n_instances; ++i) {
+            backends.push_back(InferenceBackend::create(backend_name));
+            backends.back()->load(network_file, rec.outputNames);
+            if (!backends.back()->setupPrecision(precision, calibration_rows, max_error))
+                throw std::logic_error("The precision '" + precision + "' is not supported by the backend '" + backend_name + "'.");
+            // warm up (and calibration for reduced precision)
+            for (size_t first=0; first<calibration_rows; first+=1024) {
+                size_t n = std::min(size_t(1024), calibration_rows - first);
+                backends.back()->run(rec.views(first, n), n);
+            }
+        }
+        printf("Backend: '%s', network: '%s', precision: %s, instances: %zu\n\n", backend_name.c_str(), network_file.c_str(), precision.c_str(), n_instances);
+
+        printf("%8s %8s %8s %12s %10s %10s %10s %10s\n", "batch", "threads", "batches", "cells/sec", "p50 (ms)", "p90 (ms)", "p99 (ms)", "max (ms)");
+        for (size_t batch_size : batch_sizes) {
+            const size_t n_chunks = (rec.nRows + batch_size - 1) / batch_size;
+            const size_t n_batches = n_chunks * n_repeat;
+            for (size_t n_threads : thread_counts) {
+                std::atomic<size_t> next(0);
+                std::atomic<size_t> n_cells(0);
+                std::vector< std::vector<double> > latencies(n_threads);
+                std::vector<std::thread> threads;
+                std::string error;
+                std::atomic<bool> failed(false);
+                auto t_start = std::chrono::steady_clock::now();
+                for (size_t t=0; t<n_threads; ++t) {
+                    threads.push_back(std::thread([&, t]() {
+                        InferenceBackend *backend = backends[t % backends.size()].get();
+                        size_t i;
+                        while (!failed && (i = next++) < n_batches) {
+                            const size_t first = (i % n_chunks) * batch_size;
+                            const size_t n = std::min(batch_size, rec.nRows - first);
+                            std::vector<TensorView> inputs = rec.views(first, n);
+                            auto t0 = std::chrono::steady_clock::now();
+                            try {
+                                backend->run(inputs, n);
+                            } catch (const std::exception &e) {
+                                if (!failed.exchange(true))
+                                    error = e.what();
+                                return;
+                            }
+                            latencies[t].push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1000.);
+                            n_cells += n;
+                        }
+                    }));
+                }
+                for (auto &t : threads)
+                    t.join();
+                if (failed)
+                    throw std::logic_error(error);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+                std::vector<double> all;
+                for (const auto &l : latencies)
+                    all.insert(all.end(), l.begin(), l.end());
+                std::sort(all.begin(), all.end());
+                printf("%8zu %8zu %8zu %12.0f %10.2f %10.2f %10.2f %10.2f\n", batch_size, n_threads, all.size(),
+                       seconds > 0. ? static_cast<double>(n_cells.load()) / seconds : 0.,
+                       percentile(all, 0.5), percentile(all, 0.9), percentile(all, 0.99), all.empty() ? 0. : all.back());
+            }
+        }
+    } catch (const std::exception &e) {
+        printf("Error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -35,15 +35,22 @@ SOURCES += \
     modules/wind/windout.cpp \
     outputs/statehistout.cpp \
     outputs/statematrixout.cpp \
+    outputs/performanceout.cpp \
     tools/geotiff.cpp \
     tools/grid.cpp \
     tools/strtools.cpp \
     tools/filereader.cpp \
     tools/settings.cpp \
     tools/randomgen.cpp \
+    tools/perfstats.cpp \
+    tools/tracerecorder.cpp \
     core/model.cpp \
     core/landscape.cpp \
     core/cell.cpp \
+    core/cellstore.cpp \
+    core/cellcalendar.cpp \
+    core/speciesneighbors.cpp \
+    core/distancefields.cpp \
     core/states.cpp \
     core/climate.cpp \
     tools/tools.cpp \
@@ -74,15 +81,22 @@ HEADERS += \
     modules/wind/windout.h \
     outputs/statehistout.h \
     outputs/statematrixout.h \
+    outputs/performanceout.h \
     tools/geotiff.h \
     tools/grid.h \
     tools/strtools.h \
     tools/filereader.h \
     tools/settings.h \
     tools/randomgen.h \
+    tools/perfstats.h \
+    tools/tracerecorder.h \
     core/model.h \
     core/landscape.h \
     core/cell.h \
+    core/cellstore.h \
+    core/cellcalendar.h \
+    core/speciesneighbors.h \
+    core/distancefields.h \
     core/states.h \
     core/climate.h \
     tools/tools.h \
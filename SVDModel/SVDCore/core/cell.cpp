@@ -22,6 +22,9 @@
 
 // static decl
 StateMatrixOut *Cell::mSMOut = nullptr;
+CellStore *Cell::mStore = nullptr;
+std::vector<int> Cell::mLocalDeltas;
+std::vector<int> Cell::mMediumDeltas;
 
 
 
@@ -53,6 +56,11 @@ void Cell::setup()
     if (mSMOut && !mSMOut->enabled())
         mSMOut = nullptr;
 
+    // neighbor offsets as linear index deltas of the padded landscape grid
+    const auto &halo_grid = Model::instance()->landscape()->haloGrid();
+    mLocalDeltas = halo_grid.offsets(mLocalNeighbors);
+    mMediumDeltas = halo_grid.offsets(mMediumNeighbors);
+
 }
 
 float Cell::elevation() const
@@ -62,12 +70,17 @@ float Cell::elevation() const
 
 bool Cell::needsUpdate() const
 {
-    if (Model::instance()->year() >= mNextUpdateTime)
+    if (Model::instance()->year() >= nextUpdate())
         return true;
     return false;
 }
 
-void Cell::update()
+void Cell::scheduleUpdate()
+{
+    Model::instance()->landscape()->calendar().schedule(this);
+}
+
+void Cell::update(StateMatrixOut::TransitionMap *transitions)
 {
     // is called at the end of the year: the state changes
     // already now so that we will have the correct state at the
@@ -75,30 +88,36 @@ void Cell::update()
     // conceptually, this happens on the 31st of December.
     // Outputs are written *after* that, i.e. will have already increased residence time / new state
     int year = Model::instance()->year();
-    if (year+1 >= mNextUpdateTime) {
+    const size_t p = pos();
+    if (year+1 >= mStore->nextUpdateTime[p]) {
         // change the state of the current cell
-        if (mNextStateId != stateId()) {
+        const state_t next_state = mStore->nextStateId[p];
+        if (next_state != stateId()) {
             // save to history: since the residence time here does not include the current year (yet), we'll add it here
             // i.e., the minimum residence time in the history is 1.
-            mHistory.saveHistory(mNextStateId, mResidenceTime + 1);
+            mStore->saveHistory(p, next_state, mStore->residenceTime[p] + 1);
 
             // save to output?
-            if (mSMOut)
-                mSMOut->add(mStateId, mNextStateId);
+            if (mSMOut) {
+                if (transitions)
+                    (*transitions)[std::pair<state_t, state_t>(stateId(), next_state)]++;
+                else
+                    mSMOut->add(stateId(), next_state);
+            }
 
             // the actual update:
-            setState( mNextStateId );
+            setState( next_state );
             setResidenceTime( 0 );
         } else {
             // the state is not changed;
             // nonetheless, the cell will be re-evaluated in the next year
-            mResidenceTime++; // TODO: check if this messes up something with the DNN?
+            mStore->residenceTime[p]++; // TODO: check if this messes up something with the DNN?
         }
     } else {
         // no update. The residence time changes.
-        mResidenceTime++;
+        mStore->residenceTime[p]++;
     }
-    mIsUpdated = false; // reset flag at the end of the year
+    mStore->isUpdated[p] = 0; // reset flag at the end of the year
 
 }
 
@@ -110,11 +129,11 @@ void Cell::setState(state_t new_state)
 //        dumpDebugData();
 //        return;
 //    }
-    mStateId = new_state;
+    mStore->stateId[pos()] = new_state;
     if (new_state<0)
-        mState=nullptr;
+        mStore->state[pos()] = nullptr;
     else {
-        mState = &Model::instance()->states()->stateById(new_state);
+        mStore->state[pos()] = &Model::instance()->states()->stateById(new_state);
     }
 }
 
@@ -124,27 +143,28 @@ void Cell::setNewState(state_t new_state)
     // any predictions done by DNN earlier will be ignored
     setNextUpdateTime(Model::instance()->year());
     setNextStateId(new_state);
-    mIsUpdated = true;
+    mStore->isUpdated[pos()] = 1;
 }
 
 void Cell::setExternalState(state_t state)
 {
     // external seed cells have a state ptr, but stateId=-1
-    mState = &Model::instance()->states()->stateById(state);
-    mStateId = -1;
+    mStore->state[pos()] = &Model::instance()->states()->stateById(state);
+    mStore->stateId[pos()] = -1;
 }
 
 std::vector<double> Cell::neighborSpecies() const
 {
-    auto &grid =  Model::instance()->landscape()->grid();
+    // neighbors are read from the padded grid (no bounds checks, cells in the border are null)
+    const auto &halo_grid = Model::instance()->landscape()->haloGrid();
+    const GridCell *center = halo_grid.ptr(halo_grid.index(cellIndex()));
     size_t n_species = Model::instance()->species().size();
-    Point center = grid.indexOf(cellIndex());
     std::vector<double> result(n_species*2, 0.);
     // local neighbors
     double n_local = 0.;
-    for (const auto &p : mLocalNeighbors) {
-        if (grid.isIndexValid(center + p) && !grid.valueAtIndex(center + p).isNull()) {
-            Cell &cell = grid.valueAtIndex(center + p).cell();
+    for (int delta : mLocalDeltas) {
+        if (!center[delta].isNull()) {
+            Cell &cell = center[delta].cell();
             if ((cell.state() && cell.state()->type()==State::Forest) || cell.externalSeedType()>=0) {
                 // note for external seeds:
                 // if the cell is in 'species-shares' mode, then state() is null
@@ -162,9 +182,9 @@ std::vector<double> Cell::neighborSpecies() const
 
     // mid-range neighbors
     double n_mid = 0.;
-    for (const auto &p : mMediumNeighbors) {
-        if (grid.isIndexValid(center + p) && !grid.valueAtIndex(center + p).isNull()) {
-            Cell &cell = grid.valueAtIndex(center + p).cell();
+    for (int delta : mMediumDeltas) {
+        if (!center[delta].isNull()) {
+            Cell &cell = center[delta].cell();
             if ((cell.state() && cell.state()->type()==State::Forest) || cell.externalSeedType()>=0) {
                 const auto &shares = cell.state()? cell.state()->speciesProportion() : Model::instance()->externalSeeds().speciesShares(cell.externalSeedType());
                 for (size_t i=0; i<n_species;++i)
@@ -182,91 +202,49 @@ std::vector<double> Cell::neighborSpecies() const
 
 double Cell::stateFrequencyLocal(state_t stateId) const
 {
-    auto &grid =  Model::instance()->landscape()->grid();
-    Point center = grid.indexOf(cellIndex());
-    int n_local = 0;
-    int n = 0;
-    for (const auto &p : mLocalNeighbors) {
-        if (grid.isIndexValid(center + p) && !grid.valueAtIndex(center + p).isNull()) {
-            Cell &cell = grid.valueAtIndex(center + p).cell();
-            if (cell.stateId() == stateId)
-                ++n_local;
-            }
-            ++n;
-        }
-
-    return n>0 ? n_local / static_cast<double>(n) : 0.;
+    return stateFrequency(mLocalDeltas, stateId);
 }
 
 double Cell::stateFrequencyIntermediate(state_t stateId) const
 {
-    auto &grid =  Model::instance()->landscape()->grid();
-    Point center = grid.indexOf(cellIndex());
+    return stateFrequency(mMediumDeltas, stateId);
+}
+
+double Cell::stateFrequency(const std::vector<int> &deltas, state_t stateId) const
+{
+    // neighbors are read from the padded grid (no bounds checks, cells in the border are null).
+    // Note that all neighbors count (also neighbors outside of the project area)
+    const auto &halo_grid = Model::instance()->landscape()->haloGrid();
+    const GridCell *center = halo_grid.ptr(halo_grid.index(cellIndex()));
+    const state_t *state_ids = mStore->stateId.data();
     int n_local = 0;
-    int n = 0;
-    for (const auto &p : mMediumNeighbors) {
-        if (grid.isIndexValid(center + p) && !grid.valueAtIndex(center + p).isNull()) {
-            Cell &cell = grid.valueAtIndex(center + p).cell();
-            if (cell.stateId() == stateId)
-                ++n_local;
-            }
-            ++n;
-        }
+    for (int delta : deltas) {
+        int index = center[delta].index;
+        n_local += (index >= 0 && state_ids[index] == stateId) ? 1 : 0;
+    }
 
-    return n>0 ? n_local / static_cast<double>(n) : 0.;
+    return deltas.empty() ? 0. : n_local / static_cast<double>(deltas.size());
 }
 
 
-// distances from center point (X)
-// 4 4 3 4 4
-// 4 2 1 2 4
-// 3 1 X 1 3
-// 4 2 1 2 4
-// 4 4 3 4 4
-// 1..4: distance classes (50m, 100m, 150m, 200m)
-static std::vector<std::pair<Point, float> > dist2state = {
-    {{1,0},0.5f }, {{0,1},0.5f }, {{-1,0},0.5f }, {{0,-1},0.5f },  // distances 1
-    {{-1,-1},1.f }, {{1,-1},1.f }, {{-1,1},1.f }, {{1,1},1.f }, // distances 2
-    {{2,0},1.5f }, {{0,2},1.5f }, {{-2,0},1.5f }, {{0, -2},1.50f }, // distances 3
-    {{-2,-2},2.f }, {{-1,-2},2.f }, {{1,-2},2.f }, {{2,-2},2.f }, {{-2,-1},2.f }, {{2,-1},2.f }, // distances 4 (upper half)
-    {{-2, 2},2.f }, {{-1, 2},2.f }, {{1, 2},2.f }, {{2, 2},2.f }, {{-2, 1},2.f }, {{2, 1},2.f } // distances 4 (lower half)
-};
-
 double Cell::minimumDistanceTo(state_t stateId) const
 {
-    auto &grid =  Model::instance()->landscape()->grid();
-    Point center = grid.indexOf(cellIndex());
-    // TODO
-    for (const auto &p : dist2state) {
-        if (grid.isIndexValid(center + p.first) && !grid.valueAtIndex(center + p.first).isNull()) {
-            Cell &c = grid.valueAtIndex(center + p.first).cell();
-            if (!c.isNull() && c.state()!=nullptr)
-                if (c.stateId() == stateId) {
-                    // found a distance
-                    return p.second;
-                }
-        }
+    // distances (cells) are limited to `max_distance` cells
+    const float max_distance = 10.f;
+    // lookup in the distance raster of the state (see DistanceFields); states without a raster (yet) are treated as not present
+    DistanceFields &fields = Model::instance()->landscape()->distanceFields();
+    const DistanceFields::Layer *layer = fields.stateLayer(stateId);
+    if (!layer)
+        return max_distance;
+
+    float min_dist = DistanceFields::distance(layer, cellIndex());
+    if (min_dist <= DistanceFields::nearDistance()) {
+        // cells in the immediate neighborhood: fixed distances per distance class (0.5, 1, 1.5, 2)
+        int near_class = fields.nearSourceClass(layer, cellIndex());
+        if (near_class > 0)
+            return near_class * 0.5;
     }
-
-    // brute force
-    const int max_n = 10;
-    float min_dist_sq = max_n*max_n;
-    for (int y=-max_n; y<=max_n; ++y)
-        for (int x=-max_n; x<=max_n; ++x)
-            // look in a circle
-            if (x*x + y*y <= max_n*max_n) {
-                if (grid.isIndexValid(center + Point(x,y)) && !grid.valueAtIndex(center + Point(x,y)).isNull()) {
-                    Cell &c = grid.valueAtIndex(center + Point(x,y)).cell();
-                    if (!c.isNull() && c.state()!=nullptr)
-                        if (c.stateId() == stateId) {
-                            // found a  pixel: (x-0.5)*(x-0.5)=x^2-x+0.25
-                            min_dist_sq = std::min(min_dist_sq, x*x-x+0.25f + y*y-y+0.25f);
-                        }
-                }
-            }
-    float min_dist = sqrt(min_dist_sq); // training data goes to 1250m distance, unit here is 100m steps
-    return min_dist; // value in "cells"
-
+    return std::min(min_dist, max_distance); // value in "cells"
 }
 
 
@@ -277,9 +255,9 @@ void Cell::dumpDebugData()
     auto lg = spdlog::get("main");
     PointF coord =  Model::instance()->landscape()->grid().cellCenterPoint( Model::instance()->landscape()->grid().indexOf(cellIndex()) );
     lg->info("Cell {} at {:f}/{:f}m:", static_cast<void*>(this), coord.x(), coord.y());
-    lg->info("Current state ID: {}, {}, residence time: {}", mStateId, mState ? mState->asString() : "Invalid State", mResidenceTime);
-    lg->info("external seed type: {}", mExternalSeedType);
-    lg->info("Next state-id: {},  update time: {}", mNextStateId, mNextUpdateTime);
+    lg->info("Current state ID: {}, {}, residence time: {}", stateId(), state() ? state()->asString() : "Invalid State", residenceTime());
+    lg->info("external seed type: {}", externalSeedType());
+    lg->info("Next state-id: {},  update time: {}", nextStateId(), nextUpdate());
 
 }
 
@@ -294,28 +272,30 @@ double Cell::heightIncrement() const
     double max_height = -1.;
     int n_years = 1;
     double delta_h = 0.;
-    if (mNextStateId > -1 && mNextUpdateTime>0) {
+    if (nextStateId() > -1 && nextUpdate()>0) {
         // there is a change projected
-        const auto &next_state = Model::instance()->states()->stateById(mNextStateId);
+        const auto &next_state = Model::instance()->states()->stateById(nextStateId());
         max_height = next_state.topHeight();
         // for height reduction return unlimited growth
         if (max_height < state()->topHeight())
             return maximum_increment;
 
         // time until next state change + years until last state change
-        n_years = (mNextUpdateTime - Model::instance()->year()) + mResidenceTime + 1;
+        n_years = (nextUpdate() - Model::instance()->year()) + residenceTime() + 1;
     } else {
         // no future change yet
         max_height = state()->topHeight(); // current height
-        n_years = mResidenceTime + 1 ; // residence time is 0 in the first year
+        n_years = residenceTime() + 1 ; // residence time is 0 in the first year
     }
     if (max_height <= 0.)
         return 0.;
 
     // calculate height increment based on the last saved state changes
-    for (int i=0;i<History::NSteps;++i) {
-        if (mHistory.state[i] != 0) {
-            const auto &history_state = Model::instance()->states()->stateById(mHistory.state[i]);
+    const state_t *history_states = stateHistory();
+    const restime_t *history_restimes = resTimeHistory();
+    for (int i=0;i<CellStore::NHistory;++i) {
+        if (history_states[i] != 0) {
+            const auto &history_state = Model::instance()->states()->stateById(history_states[i]);
             double h_history = history_state.topHeight();
             // if we had disturbance/management already in the history, return upper bound
             if (h_history > max_height)
@@ -329,7 +309,7 @@ double Cell::heightIncrement() const
                 return std::min(delta_h / double(n_years), maximum_increment);
             }
             // note: residence time includes already the increment by one
-            n_years += mHistory.restime[i];
+            n_years += history_restimes[i];
         }
     }
     const double min_delta_h = 2.; // we have 2m steps right now
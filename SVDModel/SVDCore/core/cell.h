@@ -20,45 +20,49 @@
 #define CELL_H
 #include "grid.h"
 #include "states.h"
+#include "cellstore.h"
+#include "outputs/statematrixout.h"
 
-class StateMatrixOut; // forward
 class EnvironmentCell; // forward
 
+/**
+ * @brief The Cell class is the interface to a single cell of the landscape.
+ *
+ * A Cell is a light-weight view (4 bytes): the data of the cell is stored in the columns
+ * of the CellStore of the landscape at the position of the cell (see CellStore).
+ */
 class Cell
 {
 public:
     // constructors
-    Cell() : mCellIndex(-1), mStateId(-1), mResidenceTime(-1), mNextUpdateTime(-1),
-        mNextStateId(-1),  mExternalSeedType(-1), mIsUpdated(false),
-        mState(nullptr), mEnvCell(nullptr) {}
-
-    Cell(state_t state, restime_t res_time=0): mCellIndex(-1), mStateId(state), mResidenceTime(res_time), mNextUpdateTime(0),
-        mNextStateId(-1), mExternalSeedType(-1), mIsUpdated(false),
-        mEnvCell(nullptr) { setState(state); }
+    /// create the view of the cell at position `store_pos` of the CellStore
+    explicit Cell(int store_pos): mPos(store_pos) {}
+    /// set the store which contains the data of all cells (see Landscape)
+    static void setStore(CellStore *store) { mStore = store; }
     /// establish the link to the environment cell
-    void setEnvironmentCell(const EnvironmentCell *ec) { mEnvCell = ec; }
-    void setCellIndex(int cell_index) { mCellIndex = cell_index; }
+    void setEnvironmentCell(const EnvironmentCell *ec) { mStore->envCell[pos()] = ec; }
+    void setCellIndex(int cell_index) { mStore->cellIndex[pos()] = cell_index; }
     static void setup(); ///< static setup function, only called once
 
     // access
     /// isNull() returns true if the cell is not an actively simulated cell
-    bool isNull() const { return mStateId==-1; }
+    bool isNull() const { return stateId()==-1; }
     /// the numeric ID of the state the cell is in
-    state_t stateId() const { return mStateId; }
+    state_t stateId() const { return mStore->stateId[pos()]; }
     /// get the State object the cell is in;
     /// do not use to check if the cell is part of the simulated landscape! (use isNull() instead)
-    const State *state() const { return mState; }
+    const State *state() const { return mStore->state[pos()]; }
     /// the time (number of years) the cell is already in the current state
-    restime_t residenceTime() const { return mResidenceTime; }
+    restime_t residenceTime() const { return mStore->residenceTime[pos()]; }
     /// get the year for which the next update is scheduled
-    int nextUpdate() const {return mNextUpdateTime; }
+    int nextUpdate() const {return mStore->nextUpdateTime[pos()]; }
     /// the index is the position of the cell within the landscape
-    int cellIndex() const { return mCellIndex; }
+    int cellIndex() const { return mStore->cellIndex[pos()]; }
     /// elevation (m) of the cell (from a elevation model)
     float elevation() const;
 
     /// ptr of the environment cell
-    const EnvironmentCell *environment() const { return mEnvCell; }
+    const EnvironmentCell *environment() const { return mStore->envCell[pos()]; }
 
     /// returns true if the cell should be updated in the current year (i.e. if the DNN should be executed)
     bool needsUpdate() const;
@@ -66,32 +70,43 @@ public:
     // actions
     /// check if update is scheduled (i.e. a state change should happen) and in case apply the update;
     /// after update(), the cell is in the final state of the current year ("31st of december")
-    void update();
+    /// State transitions are counted in `transitions` if provided (otherwise directly in the StateMatrix output)
+    void update(StateMatrixOut::TransitionMap *transitions=nullptr);
     void setState(state_t new_state);
-    void setResidenceTime(restime_t res_time) { mResidenceTime = res_time; }
+    void setResidenceTime(restime_t res_time) { mStore->residenceTime[pos()] = res_time; }
 
     /// set a future state update. This is used by both DNN and modules.
-    void setNextStateId(state_t new_state) { if(!mIsUpdated) mNextStateId = new_state; }
+    void setNextStateId(state_t new_state) { if(!isUpdated()) mStore->nextStateId[pos()] = new_state; }
     /// set a future time. This is used by both DNN and modules.
-    void setNextUpdateTime(int next_year) { if(!mIsUpdated) mNextUpdateTime = next_year; }
+    void setNextUpdateTime(int next_year) { if(!isUpdated() && nextUpdate() != next_year) { mStore->nextUpdateTime[pos()] = next_year; scheduleUpdate(); } }
     /// sets a new state immediately (later updates from DNN are blocked)
     void setNewState(state_t new_state);
-    void setInvalid() { mStateId=0; mResidenceTime=0; mState=nullptr; }
+    void setInvalid() { mStore->stateId[pos()]=0; mStore->residenceTime[pos()]=0; mStore->state[pos()]=nullptr; }
 
-    bool hasExternalSeed() const { return mExternalSeedType>0 || (state()!=nullptr && !isNull()); }
+    bool hasExternalSeed() const { return externalSeedType()>0 || (state()!=nullptr && !isNull()); }
     /// set external forest type:
-    void setExternalSeedType(int new_type) { mExternalSeedType = new_type; }
+    void setExternalSeedType(int new_type) { mStore->externalSeedType[pos()] = new_type; }
     /// get external seed type
-    int externalSeedType() const { return mExternalSeedType; }
+    int externalSeedType() const { return mStore->externalSeedType[pos()]; }
     void setExternalState(state_t state);
 
     /// get a vector with species shares (local, mid-range) for the current cell
+    /// (see also SpeciesNeighbors, which provides the values for all cells that are due in a year)
     std::vector<double> neighborSpecies() const;
+    /// offsets of the local (Moore neighborhood) and the medium-range neighbors
+    static const std::vector<Point> &localNeighbors() { return mLocalNeighbors; }
+    static const std::vector<Point> &mediumNeighbors() { return mMediumNeighbors; }
 
     /// get frequency of neighbor cells with a specific state
     double stateFrequencyLocal(state_t stateId) const;
     double stateFrequencyIntermediate(state_t stateId) const;
     double stateFrequencyGlobal(state_t stateId) const;
+    /// distance (cells) to the nearest cell in the state `stateId`: 0.5 for direct neighbors, 1 for diagonal neighbors,
+    /// 1.5 for cells 2 cells away in a straight line, 2 for the rest of the 5x5 neighborhood, and sqrt((x-0.5)^2+(y-0.5)^2)
+    /// for a cell at the offset (x,y) beyond; the distance is limited to 10 cells (also if no cell with the state exists).
+    /// Note that the distances are the values at the start of the year (see DistanceFields). The distance layers of states used
+    /// in expressions (`distance()` with constant arguments) are created during setup; other states get a layer with the
+    /// next update and are treated as not present (10 cells) until then.
     double minimumDistanceTo(state_t stateId) const;
 
     /// retrieve mean height increment over the last years (m)
@@ -99,44 +114,29 @@ public:
     double heightIncrement() const;
 
     /// get history for state/residence time
-    const state_t *stateHistory() const { return mHistory.state; }
-    const restime_t *resTimeHistory() const { return mHistory.restime; }
+    const state_t *stateHistory() const { return &mStore->historyState[pos()*CellStore::NHistory]; }
+    const restime_t *resTimeHistory() const { return &mStore->historyResTime[pos()*CellStore::NHistory]; }
     /// the number of elements the state / restime history stores
-    static size_t historySize() { return History::NSteps; }
+    static size_t historySize() { return CellStore::NHistory; }
 
 private:
+    size_t pos() const { return static_cast<size_t>(mPos); }
+    state_t nextStateId() const { return mStore->nextStateId[pos()]; }
+    bool isUpdated() const { return mStore->isUpdated[pos()] != 0; }
+    /// share of the neighbors (linear index `deltas`, see HaloGrid) in the state `stateId`
+    double stateFrequency(const std::vector<int> &deltas, state_t stateId) const;
     void dumpDebugData();
-    int mCellIndex; ///< index of the grid cell within the landscape grid
-    state_t mStateId; ///< the numeric ID of the state the cell is in
-    restime_t mResidenceTime;
-    int mNextUpdateTime; ///< the year (see Model::year()) when the next update of this cell is scheduled
-    state_t mNextStateId; ///< the new state scheduled at mNextUpdateTime
-    int mExternalSeedType; ///< if the cell is outside of the project area, this type refers to the forest type
-    bool mIsUpdated; ///< flag indicating that the state is already updated (e.g. by management)
-
-    const State *mState; ///< ptr to the State the cell currently is in
-    const EnvironmentCell *mEnvCell; ///< ptr to the environment
-
-    // state history
-
-    struct History {
-        enum {NSteps=3};
-        state_t state[NSteps];
-        restime_t restime[NSteps];
-        History() {for (int i=0;i<NSteps;++i) { state[i]=0; restime[i]=0; }}
-        void saveHistory(state_t newstate, restime_t newtime) {
-            for (int i=NSteps-2;i>=0;--i) {
-                restime[i+1] = restime[i];
-                state[i+1] = state[i];
-            }
-            restime[0] = newtime;
-            state[0] = newstate;
-        }
-
-    } mHistory;
+    /// notify the calendar of the landscape about a changed update time
+    void scheduleUpdate();
+    int mPos; ///< position of the cell in the CellStore (and in Landscape::cells())
+
+    static CellStore *mStore; ///< the storage of the cell data
 
     static const std::vector<Point> mLocalNeighbors;
     static const std::vector<Point> mMediumNeighbors;
+    /// the neighbors as linear index deltas of Landscape::haloGrid()
+    static std::vector<int> mLocalDeltas;
+    static std::vector<int> mMediumDeltas;
 
     /// link to state matrix output
     static StateMatrixOut *mSMOut;
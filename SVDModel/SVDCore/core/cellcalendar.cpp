@@ -0,0 +1,128 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "cellcalendar.h"
+
+#include <atomic>
+#include <algorithm>
+#include <climits>
+
+#include "cell.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+/// the buffer of the current thread, and the id of the calendar that owns the buffer
+struct CalendarBuffer {
+    size_t calendar_id;
+    std::vector<int> *buffer;
+};
+thread_local CalendarBuffer tl_calendar_buffer {0, nullptr};
+std::atomic<size_t> calendar_ids(0);
+}
+
+CellCalendar::CellCalendar()
+{
+    mCells = nullptr;
+    mId = ++calendar_ids;
+}
+
+CellCalendar::~CellCalendar()
+{
+}
+
+void CellCalendar::setup(std::vector<Cell> &cells, int year)
+{
+    mCells = &cells;
+    mBucket.assign(cells.size(), INT_MIN);
+    mBuckets.clear();
+    mDue.clear();
+    mBuffers.clear();
+    mId = ++calendar_ids; // invalidate existing thread local buffers
+    for (size_t i=0;i<cells.size();++i)
+        if (!cells[i].isNull())
+            reschedule(static_cast<int>(i), year + 1);
+
+    if (auto lg = spdlog::get("setup"))
+        lg->debug("Cell calendar: {} cells scheduled in {} time buckets.", cells.size(), mBuckets.size());
+}
+
+void CellCalendar::schedule(const Cell *cell)
+{
+    if (!mCells)
+        return; // not set up yet: all cells are added during setup()
+    std::vector<int> *buffer = threadBuffer();
+    buffer->push_back(static_cast<int>(cell - mCells->data()));
+}
+
+void CellCalendar::advance(int year)
+{
+    if (!mCells)
+        return;
+    // cells that were due last year stay due when they were not re-scheduled
+    for (int pos : mDue)
+        reschedule(pos, year);
+    // cells with changed update times
+    for (auto &buffer : mBuffers) {
+        for (int pos : *buffer)
+            reschedule(pos, year);
+        buffer->clear();
+    }
+
+    // collect the cells of all buckets up to the current year.
+    // A bucket can contain a cell more than once (a cell that is re-scheduled back to a bucket with a
+    // stale entry): collected cells are marked with INT_MIN (which is never a bucket), so every cell is due only once.
+    mDue.clear();
+    while (!mBuckets.empty() && mBuckets.begin()->first <= year) {
+        auto bucket = mBuckets.begin();
+        for (int pos : bucket->second)
+            if (mBucket[pos] == bucket->first) {
+                mDue.push_back(pos);
+                mBucket[pos] = INT_MIN;
+            }
+        mBuckets.erase(bucket);
+    }
+    for (int pos : mDue)
+        mBucket[pos] = year;
+    // process the cells in the order of the landscape
+    std::sort(mDue.begin(), mDue.end());
+
+    if (auto lg = spdlog::get("main"))
+        lg->debug("Cell calendar: {} cells due in year {} ({} buckets pending).", mDue.size(), year, mBuckets.size());
+}
+
+std::vector<int> *CellCalendar::threadBuffer()
+{
+    if (tl_calendar_buffer.calendar_id != mId) {
+        // first access of this thread: register a new buffer
+        std::lock_guard<std::mutex> guard(mBufferMutex);
+        mBuffers.push_back(std::unique_ptr<std::vector<int> >(new std::vector<int>()));
+        tl_calendar_buffer.buffer = mBuffers.back().get();
+        tl_calendar_buffer.calendar_id = mId;
+    }
+    return tl_calendar_buffer.buffer;
+}
+
+void CellCalendar::reschedule(int pos, int year)
+{
+    // cells are never scheduled for the past
+    int bucket = std::max((*mCells)[static_cast<size_t>(pos)].nextUpdate(), year);
+    if (mBucket[static_cast<size_t>(pos)] != bucket) {
+        mBucket[static_cast<size_t>(pos)] = bucket;
+        mBuckets[bucket].push_back(pos);
+    }
+}
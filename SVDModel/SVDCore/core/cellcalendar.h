@@ -0,0 +1,68 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef CELLCALENDAR_H
+#define CELLCALENDAR_H
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+class Cell; // forward
+
+/**
+ * @brief The CellCalendar class keeps track of the year in which cells need to be updated.
+ *
+ * Cells are stored in time buckets (one bucket per year), keyed by Cell::nextUpdate(). A cell with
+ * a `nextUpdate` in the past is kept in the bucket of the next year, i.e. a cell is due in year `y`
+ * if `nextUpdate <= y` (see Cell::needsUpdate()). Each year, only the due cells need to be visited.
+ * Changes of the update time (Cell::setNextUpdateTime()) are collected in thread local buffers
+ * (schedule() is thread safe) and merged at the start of the next year (advance()).
+ * Outdated entries in buckets are not removed, but skipped (the current bucket of each cell is stored).
+ */
+class CellCalendar
+{
+public:
+    CellCalendar();
+    ~CellCalendar();
+    /// build the calendar for all cells (after the initial state of the landscape is set)
+    void setup(std::vector<Cell> &cells, int year);
+    /// notify the calendar that the update time of `cell` has changed (thread safe)
+    void schedule(const Cell *cell);
+    /// start the year `year`: merge the changes of the last year and build the list of due cells
+    void advance(int year);
+    /// cells that are due in the current year (indices into Landscape::cells(), sorted)
+    const std::vector<int> &dueCells() const { return mDue; }
+    /// number of time buckets that are currently in use
+    size_t bucketCount() const { return mBuckets.size(); }
+
+private:
+    std::vector<int> *threadBuffer();
+    void reschedule(int pos, int year);
+    std::vector<Cell> *mCells; ///< the cell container of the landscape
+    std::vector<int> mBucket; ///< the year (bucket) each cell is currently scheduled for
+    std::map<int, std::vector<int> > mBuckets; ///< time buckets: year -> list of cells
+    std::vector<int> mDue; ///< cells due in the current year
+    // thread local buffers of changed cells
+    std::mutex mBufferMutex;
+    std::vector<std::unique_ptr<std::vector<int> > > mBuffers;
+    size_t mId; ///< unique id of the calendar (used to validate thread local buffers)
+};
+
+#endif // CELLCALENDAR_H
@@ -0,0 +1,35 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "cellstore.h"
+
+void CellStore::setup(size_t n_cells)
+{
+    // default values (see Cell): an invalid cell outside of the project area
+    cellIndex.assign(n_cells, -1);
+    stateId.assign(n_cells, -1);
+    residenceTime.assign(n_cells, -1);
+    nextUpdateTime.assign(n_cells, -1);
+    nextStateId.assign(n_cells, -1);
+    externalSeedType.assign(n_cells, -1);
+    isUpdated.assign(n_cells, 0);
+    state.assign(n_cells, nullptr);
+    envCell.assign(n_cells, nullptr);
+    historyState.assign(n_cells * NHistory, 0);
+    historyResTime.assign(n_cells * NHistory, 0);
+}
@@ -0,0 +1,75 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef CELLSTORE_H
+#define CELLSTORE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "states.h"
+
+class EnvironmentCell; // forward
+
+/**
+ * @brief The CellStore class holds the state of all cells of the landscape in columns.
+ *
+ * Every field of a cell is stored in a separate contiguous array (structure of arrays), and the position
+ * of a cell is the same in all arrays (and equal to the position in Landscape::cells()). The Cell objects
+ * are light-weight views (see Cell), i.e. modules and expressions use the Cell interface as before, while
+ * loops over all cells (e.g. the year end in Model::finalizeYear(), the state histogram, outputs)
+ * read only the arrays they need.
+ * The history of a cell is stored as a block of `NHistory` values at `position * NHistory`.
+ */
+class CellStore
+{
+public:
+    enum { NHistory=3 };
+    /// allocate the arrays for `n_cells` cells (with default values)
+    void setup(size_t n_cells);
+    /// number of cells
+    size_t size() const { return cellIndex.size(); }
+
+    // the columns
+    std::vector<int> cellIndex; ///< index of the grid cell within the landscape grid
+    std::vector<state_t> stateId; ///< the numeric ID of the state the cell is in
+    std::vector<restime_t> residenceTime; ///< the time (years) the cell is already in the current state
+    std::vector<int> nextUpdateTime; ///< the year (see Model::year()) when the next update of the cell is scheduled
+    std::vector<state_t> nextStateId; ///< the new state scheduled at nextUpdateTime
+    std::vector<int> externalSeedType; ///< if the cell is outside of the project area, this type refers to the forest type
+    std::vector<uint8_t> isUpdated; ///< flag indicating that the state is already updated (e.g. by management); not a vector<bool> (concurrent writes)
+    std::vector<const State*> state; ///< ptr to the State the cell currently is in
+    std::vector<const EnvironmentCell*> envCell; ///< ptr to the environment
+    std::vector<state_t> historyState; ///< the last NHistory states (most recent first)
+    std::vector<restime_t> historyResTime; ///< residence time in the last NHistory states
+
+    /// push a state change to the history of the cell at `pos`
+    void saveHistory(size_t pos, state_t new_state, restime_t new_time) {
+        state_t *s = &historyState[pos*NHistory];
+        restime_t *r = &historyResTime[pos*NHistory];
+        for (int i=NHistory-2;i>=0;--i) {
+            r[i+1] = r[i];
+            s[i+1] = s[i];
+        }
+        r[0] = new_time;
+        s[0] = new_state;
+    }
+};
+
+#endif // CELLSTORE_H
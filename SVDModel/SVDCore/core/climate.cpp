@@ -28,6 +28,7 @@
 
 Climate::Climate()
 {
+    mNBlocks = 0;
 
 }
 
@@ -180,6 +181,13 @@ void Climate::setup()
         lg->debug("climate sequence disabled, using the sequence from the data ({}-{}).", mSequence.front(), mSequence.back());
 
     }
+
+    // position of each climateId in the blocks of climate data (see seriesBlock())
+    mIdIndex.clear();
+    mNBlocks = 0;
+    size_t id_index = 0;
+    for (int id : mAllIds)
+        mIdIndex[id] = id_index++;
     if (lg->should_log(spdlog::level::trace)) {
         // print the first and last elements...
         //std::vector<float> &vec = mData[*mAllYears.begin()][*mAllIds.begin()];
@@ -207,6 +215,61 @@ std::vector<const std::vector<float> *> Climate::series(int start_year, size_t s
     return set;
 }
 
+const float *Climate::seriesBlock(int start_year, size_t series_length, int climateId)
+{
+    SeriesBlock *block = nullptr;
+    const size_t n_blocks = mNBlocks.load(std::memory_order_acquire);
+    for (size_t i=0; i<n_blocks; ++i)
+        if (mBlocks[i].length == series_length && mBlocks[i].year.load(std::memory_order_acquire) == start_year) {
+            block = &mBlocks[i];
+            break;
+        }
+    if (!block)
+        block = &buildBlock(start_year, series_length);
+
+    auto it = mIdIndex.find(climateId);
+    if (it == mIdIndex.end())
+        throw logic_error_fmt("Climate data not found: climateId: {}, year: {}!", climateId, start_year);
+    return block->data.data() + it->second * series_length * mNColumns;
+}
+
+Climate::SeriesBlock &Climate::buildBlock(int start_year, size_t series_length)
+{
+    std::lock_guard<std::mutex> guard(mBlockLock);
+    // the block of a length is reused for the next year (all cells of the previous year are processed)
+    SeriesBlock *block = nullptr;
+    const size_t n_blocks = mNBlocks.load();
+    for (size_t i=0; i<n_blocks; ++i)
+        if (mBlocks[i].length == series_length) {
+            block = &mBlocks[i];
+            break;
+        }
+    if (!block) {
+        if (n_blocks == MaxBlocks)
+            throw std::logic_error("Climate: too many different lengths of climate series.");
+        block = &mBlocks[n_blocks];
+        block->year = 0;
+        block->length = series_length;
+        mNBlocks.store(n_blocks + 1, std::memory_order_release);
+    }
+    if (block->year.load() == start_year)
+        return *block; // built by another thread
+
+    block->data.resize(mIdIndex.size() * series_length * mNColumns);
+    for (const auto &id : mIdIndex) {
+        auto climate_series = series(start_year, series_length, id.first);
+        float *p = block->data.data() + id.second * series_length * mNColumns;
+        for (const std::vector<float> *s : climate_series) {
+            if (s->size() < mNColumns)
+                throw logic_error_fmt("Climate: inconsistent climate variables. Number of values for DNN: {}, total number of values {}.", mNColumns, s->size());
+            std::copy(s->begin(), s->begin() + static_cast<long>(mNColumns), p);
+            p += mNColumns;
+        }
+    }
+    block->year.store(start_year, std::memory_order_release);
+    return *block;
+}
+
 int Climate::indexOfVariable(const std::string &var_name) const
 {
     return index_of(mColNames, var_name );
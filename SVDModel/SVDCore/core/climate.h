@@ -24,6 +24,8 @@
 #include <vector>
 #include <unordered_map>
 #include <set>
+#include <mutex>
+#include <atomic>
 
 
 class Climate
@@ -38,6 +40,10 @@ public:
     /// retrieve a list of climate series, starting from 'start_year' (first year: 1, ...)
     /// and with the given length ('series_length').
     std::vector< const std::vector<float>* > series(int start_year, size_t series_length, int climateId) const;
+    /// the climate series of 'series_length' years (starting from 'start_year') for 'climateId' as a contiguous block
+    /// (series_length x nDNNcolumns() values). The blocks of all climateIds are assembled once per year
+    /// (on first access, thread safe) and shared by all cells with the same climateId.
+    const float *seriesBlock(int start_year, size_t series_length, int climateId);
     const std::vector<float> &singleSeries(const int year, const int climateId) const { return mData.at(year).at(climateId); }
     bool hasSeries(const int year, const int climateId) const { auto y=mData.find(year); if(y==mData.end()) return false;
                                                                 auto s= y->second.find(climateId); if (s==(*y).second.end()) return false;
@@ -64,6 +70,19 @@ private:
     /// names of climate variables
     std::vector<std::string> mColNames;
 
+    /// contiguous climate data of all climateIds for a year and a length of the series (see seriesBlock())
+    struct SeriesBlock {
+        std::atomic<int> year; ///< start year of the block (0: not built)
+        size_t length; ///< number of years
+        std::vector<float> data; ///< climateIds x years x values
+    };
+    static const size_t MaxBlocks = 4;
+    SeriesBlock mBlocks[MaxBlocks]; ///< a block for each series length in use
+    std::atomic<size_t> mNBlocks; ///< number of blocks in use
+    std::mutex mBlockLock;
+    std::unordered_map<int, size_t> mIdIndex; ///< climateId -> position in the blocks
+    SeriesBlock &buildBlock(int start_year, size_t series_length);
+
     bool mVarsInExpressions {false};
 };
 
@@ -0,0 +1,228 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "distancefields.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include "landscape.h"
+#include "tools.h"
+#include "spdlog/spdlog.h"
+
+void DistanceFields::setup(Landscape *landscape, size_t n_state_ids)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    mLandscape = landscape;
+    mLayers.clear();
+    mStateLayers = std::vector< std::atomic<const Layer*> >(n_state_ids);
+    for (auto &l : mStateLayers)
+        l.store(nullptr);
+    mStateRequested = std::vector< std::atomic<bool> >(n_state_ids);
+    for (auto &r : mStateRequested)
+        r.store(false);
+    mRequestsPending = false;
+}
+
+const DistanceFields::Layer *DistanceFields::addLayer(const std::string &name, SourceFunction is_source)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    return createLayer(name, is_source, true);
+}
+
+const DistanceFields::Layer *DistanceFields::addStateLayer(state_t state_id)
+{
+    if (state_id < 0 || static_cast<size_t>(state_id) >= mStateLayers.size())
+        return nullptr;
+    std::lock_guard<std::mutex> guard(mMutex);
+    return createStateLayer(state_id, true);
+}
+
+const DistanceFields::Layer *DistanceFields::stateLayer(state_t state_id)
+{
+    if (state_id < 0 || static_cast<size_t>(state_id) >= mStateLayers.size())
+        return nullptr;
+    const Layer *layer = mStateLayers[static_cast<size_t>(state_id)].load(std::memory_order_acquire);
+    if (!layer && !mStateRequested[static_cast<size_t>(state_id)].exchange(true))
+        mRequestsPending = true; // the layer is created with the next update()
+    return layer;
+}
+
+const DistanceFields::Layer *DistanceFields::createStateLayer(state_t state_id, bool calculate_now)
+{
+    std::atomic<const Layer*> &entry = mStateLayers[static_cast<size_t>(state_id)];
+    const Layer *layer = entry.load(std::memory_order_acquire);
+    if (!layer) {
+        layer = createLayer("state " + to_string(state_id), [state_id](const Cell &cell) {
+            return cell.state()!=nullptr && cell.stateId()==state_id;
+        }, calculate_now);
+        entry.store(layer, std::memory_order_release);
+    }
+    return layer;
+}
+
+const DistanceFields::Layer *DistanceFields::createLayer(const std::string &name, SourceFunction is_source, bool calculate_now)
+{
+    mLayers.push_back(Layer());
+    Layer &layer = mLayers.back();
+    layer.name = name;
+    layer.isSource = is_source;
+    if (calculate_now)
+        calculate(layer);
+    if (auto lg = spdlog::get("main"))
+        lg->debug("DistanceFields: added layer '{}'.", name);
+    return &layer;
+}
+
+void DistanceFields::update()
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    // layers of states that were queried (stateLayer()) since the last update
+    if (mRequestsPending.exchange(false)) {
+        for (size_t i=0;i<mStateRequested.size();++i)
+            if (mStateRequested[i])
+                createStateLayer(static_cast<state_t>(i), false);
+    }
+    for (auto &layer : mLayers)
+        calculate(layer);
+}
+
+int DistanceFields::nearSourceClass(const Layer *layer, int grid_index) const
+{
+    // the offsets of the 5x5 neighborhood, ordered by distance class
+    static const std::vector<std::pair<Point, int> > near_offsets = {
+        {{1,0},1 }, {{0,1},1 }, {{-1,0},1 }, {{0,-1},1 },  // distances 1
+        {{-1,-1},2 }, {{1,-1},2 }, {{-1,1},2 }, {{1,1},2 }, // distances 2
+        {{2,0},3 }, {{0,2},3 }, {{-2,0},3 }, {{0, -2},3 }, // distances 3
+        {{-2,-2},4 }, {{-1,-2},4 }, {{1,-2},4 }, {{2,-2},4 }, {{-2,-1},4 }, {{2,-1},4 }, // distances 4 (upper half)
+        {{-2, 2},4 }, {{-1, 2},4 }, {{1, 2},4 }, {{2, 2},4 }, {{-2, 1},4 }, {{2, 1},4 } // distances 4 (lower half)
+    };
+    auto &grid = mLandscape->grid();
+    Point center = grid.indexOf(grid_index);
+    for (const auto &p : near_offsets) {
+        Point pos = center + p.first;
+        if (grid.isIndexValid(pos) && !grid.valueAtIndex(pos).isNull() && layer->isSource(grid.valueAtIndex(pos).cell()))
+            return p.second;
+    }
+    return 0;
+}
+
+void DistanceFields::calculate(Layer &layer)
+{
+    auto &grid = mLandscape->grid();
+    const int size_x = grid.sizeX();
+    const int size_y = grid.sizeY();
+    const size_t n = static_cast<size_t>(size_x) * static_cast<size_t>(size_y);
+    const int none = size_x + size_y + 1; // larger than any distance
+    const int none2 = 2 * none + 1; // no source in the column (doubled distances, see below)
+    mColumnDistance.resize(n);
+    layer.distance.resize(n);
+    int *col = mColumnDistance.data();
+
+    // Distances are calculated in units of half cells: the corner point of cell (x,y) is at (2x+1, 2y+1),
+    // and the center of a source cell (qx,qy) at (2qx, 2qy).
+    // (1) the distance to the nearest source within the same column
+    // (blocks of columns, processed row by row for contiguous memory access)
+    const int block_width = 64;
+    std::vector<int> blocks;
+    for (int x=0; x<size_x; x+=block_width)
+        blocks.push_back(x);
+    QtConcurrent::blockingMap(blocks, [&](int &x_start) {
+        const int x_end = std::min(x_start + block_width, size_x);
+        // forward: distance (cells) to the nearest source in the same row or above
+        for (int x=x_start; x<x_end; ++x) {
+            const GridCell &gc = grid.valueAtIndex(x, 0);
+            col[x] = (!gc.isNull() && layer.isSource(gc.cell())) ? 0 : none;
+        }
+        for (int y=1; y<size_y; ++y) {
+            int *row = col + static_cast<size_t>(y) * static_cast<size_t>(size_x);
+            const int *prev = row - size_x;
+            for (int x=x_start; x<x_end; ++x) {
+                const GridCell &gc = grid.valueAtIndex(x, y);
+                row[x] = (!gc.isNull() && layer.isSource(gc.cell())) ? 0 : std::min(prev[x] + 1, none);
+            }
+        }
+        // backward: combine with the distance of the next row to the nearest source in the next row or below;
+        // the result is the doubled distance from the corner point (y+0.5) to the nearest source
+        int below[block_width];
+        std::fill(below, below + block_width, none);
+        for (int y=size_y-1; y>=0; --y) {
+            int *row = col + static_cast<size_t>(y) * static_cast<size_t>(size_x);
+            for (int x=x_start; x<x_end; ++x) {
+                const int above = row[x];
+                int &b = below[x - x_start];
+                const int d = std::min(above, b);
+                row[x] = d >= none ? none2 : 2 * d + 1;
+                b = above == 0 ? 0 : std::min(b + 1, none);
+            }
+        }
+    });
+
+    // (2) along the rows: lower envelope of the parabolas (X-2q)^2 + col(q)^2, evaluated at X=2x+1
+    std::vector<int> rows(static_cast<size_t>(size_y));
+    for (int y=0; y<size_y; ++y)
+        rows[static_cast<size_t>(y)] = y;
+    const float infinity = std::numeric_limits<float>::infinity();
+    QtConcurrent::blockingMap(rows, [&](int &y) {
+        const int *f = col + static_cast<size_t>(y) * static_cast<size_t>(size_x);
+        float *out = layer.distance.data() + static_cast<size_t>(y) * static_cast<size_t>(size_x);
+        // scratch buffers of the thread (reused for all rows and layers)
+        static thread_local std::vector<int> v; // locations of the parabolas of the envelope
+        static thread_local std::vector<double> z; // boundaries between the parabolas
+        v.resize(static_cast<size_t>(size_x));
+        z.resize(static_cast<size_t>(size_x) + 1);
+        auto fq = [f](int q) { return static_cast<double>(f[q]) * f[q] + 4. * q * q; };
+        int k = -1;
+        for (int q=0; q<size_x; ++q) {
+            if (f[q] >= none2)
+                continue; // no source in the column
+            if (k < 0) {
+                k = 0;
+                v[0] = q;
+                z[0] = -std::numeric_limits<double>::infinity();
+                z[1] = std::numeric_limits<double>::infinity();
+                continue;
+            }
+            double s = (fq(q) - fq(v[static_cast<size_t>(k)])) / (4. * (q - v[static_cast<size_t>(k)]));
+            while (s <= z[static_cast<size_t>(k)]) {
+                --k;
+                s = (fq(q) - fq(v[static_cast<size_t>(k)])) / (4. * (q - v[static_cast<size_t>(k)]));
+            }
+            ++k;
+            v[static_cast<size_t>(k)] = q;
+            z[static_cast<size_t>(k)] = s;
+            z[static_cast<size_t>(k) + 1] = std::numeric_limits<double>::infinity();
+        }
+        if (k < 0) {
+            std::fill(out, out + size_x, infinity);
+            return;
+        }
+        k = 0;
+        for (int x=0; x<size_x; ++x) {
+            const int X = 2 * x + 1;
+            while (z[static_cast<size_t>(k) + 1] < X)
+                ++k;
+            const int dx = X - 2 * v[static_cast<size_t>(k)];
+            const double fy = f[v[static_cast<size_t>(k)]];
+            out[x] = static_cast<float>(std::sqrt(static_cast<double>(dx) * dx + fy * fy) / 2.);
+        }
+    });
+}
@@ -0,0 +1,102 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef DISTANCEFIELDS_H
+#define DISTANCEFIELDS_H
+
+#include <vector>
+#include <list>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <functional>
+
+#include "states.h"
+
+class Cell; // forward
+class Landscape; // forward
+
+/**
+ * @brief The DistanceFields class provides the distance of every cell on the landscape to the
+ * nearest source cell, where the source cells are a set of cells (e.g. all cells in a given state).
+ *
+ * Each layer is defined by a function that selects the source cells. The distances are calculated once per
+ * year (update()) with an exact Euclidean distance transform (Felzenszwalb & Huttenlocher): a pass along the columns
+ * finds the nearest source within each column, and a pass along the rows finds the lower envelope of the
+ * resulting parabolas. Both passes are executed in parallel (columns / rows). A query is a single lookup,
+ * and distances are not limited by a search radius.
+ * Distances are in cells and measured from the corner point (x+0.5, y+0.5) of a cell to the center of the
+ * nearest source cell (this is the metric of the neighborhood search used by the distance predictors, i.e. the
+ * sqrt((x-0.5)^2 + (y-0.5)^2) for a source at the offset (x,y)); if no source cell exists, the distance is infinity.
+ * nearSourceClass() provides the lookup table of the immediate neighborhood (5x5 cells) that is used for short distances.
+ * The layers of states (stateLayer()) are created in update() (i.e. at the start of a year), and never while
+ * cells are evaluated: a state queried for the first time has no layer until the next update().
+ */
+class DistanceFields
+{
+public:
+    typedef std::function<bool(const Cell &)> SourceFunction;
+    /// a single distance raster
+    struct Layer {
+        std::string name;
+        SourceFunction isSource;
+        std::vector<float> distance; ///< distance (cells) for each cell of the grid (from the corner point of the cell)
+    };
+
+    DistanceFields() {}
+    /// set up for the `landscape`; `n_state_ids` is the size of the state id lookup (see States::stateIdLookupLength())
+    void setup(Landscape *landscape, size_t n_state_ids);
+
+    /// add a layer with the source cells selected by `is_source`. The distances are calculated immediately,
+    /// and updated every year. Layers are never removed, i.e. the pointer stays valid.
+    const Layer *addLayer(const std::string &name, SourceFunction is_source);
+    /// add the layer with all cells in the state `state_id` as source (e.g. during setup), distances are calculated immediately
+    const Layer *addStateLayer(state_t state_id);
+    /// the layer with all cells in the state `state_id` as source, or nullptr if the layer does not exist (yet).
+    /// A missing layer is created with the next update() (thread safe, no calculation is done here).
+    const Layer *stateLayer(state_t state_id);
+
+    /// create the requested state layers and recalculate all layers with the current state of the landscape
+    void update();
+    /// true if there are no layers (and no requested state layers)
+    bool isEmpty() const { return mLayers.empty() && !mRequestsPending; }
+
+    /// distance (cells) of the cell with the grid index `grid_index` to the nearest source cell of `layer`
+    static float distance(const Layer *layer, int grid_index) { return layer->distance[static_cast<size_t>(grid_index)]; }
+    /// distance class (1-4) of the nearest source cell of `layer` in the 5x5 neighborhood of the cell `grid_index`:
+    /// 1: direct neighbors, 2: diagonal neighbors, 3: straight 2 cells away, 4: the rest of the 5x5 ring; 0: no source.
+    int nearSourceClass(const Layer *layer, int grid_index) const;
+    /// upper limit of distance() for a source within the 5x5 neighborhood (sqrt(2.5^2 + 2.5^2)), i.e. nearSourceClass() is 0 for larger distances
+    static float nearDistance() { return 3.54f; }
+
+private:
+    /// add a layer and calculate the distances if `calculate_now` is true (mMutex is locked)
+    const Layer *createLayer(const std::string &name, SourceFunction is_source, bool calculate_now);
+    /// add the layer of a state (if not already present, mMutex is locked)
+    const Layer *createStateLayer(state_t state_id, bool calculate_now);
+    void calculate(Layer &layer);
+    Landscape *mLandscape {nullptr};
+    std::list<Layer> mLayers; ///< all layers (a list: the address of a layer never changes)
+    std::vector< std::atomic<const Layer*> > mStateLayers; ///< lookup of layers by state id (nullptr: not created)
+    std::vector< std::atomic<bool> > mStateRequested; ///< states that were queried (layers are created in update())
+    std::atomic<bool> mRequestsPending {false}; ///< true if there are new requested state layers
+    std::mutex mMutex; ///< protects the creation of layers
+    std::vector<int> mColumnDistance; ///< buffer for the distance within columns
+};
+
+#endif // DISTANCEFIELDS_H
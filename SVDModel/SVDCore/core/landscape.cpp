@@ -25,12 +25,16 @@
 #include "strtools.h"
 #include "randomgen.h"
 
+#include <algorithm>
+#include <cstdint>
+
 // pointer to container for
 std::vector<Cell> *GridCell::mCellVector = nullptr;
 
 Landscape::Landscape()
 {
     GridCell::mCellVector = &mCells;
+    Cell::setStore(&mCellStore);
 }
 
 void Landscape::setup()
@@ -141,42 +145,117 @@ void Landscape::setup()
     // default for GridCell is an index of -1, i.e. isNull() == true
     mGrid.setup(mEnvironmentGrid.metricRect(), mEnvironmentGrid.cellsize());
     // actual storage of the cells. Since we now already how many cells we'll have, we can instantiate the cells.
+    // The data is stored in the columns of the cell store, and the Cell objects are views with the position in the store.
+    mCellStore.setup(n_cells_valid);
     mCells.clear();
-    mCells.resize(n_cells_valid);
-
+    mCells.reserve(n_cells_valid);
+    for (size_t i=0;i<n_cells_valid;++i)
+        mCells.emplace_back(static_cast<int>(i));
 
-    GridCell *a=mGrid.begin();
+    // the grid indices of all valid cells, in the order the cells are stored (see landscape.cellOrder)
+    std::vector<int> grid_indices;
+    grid_indices.reserve(n_cells_valid);
     int grid_cell_index = 0; // index on the spatial grid
+    for (EnvironmentCell **ec=mEnvironmentGrid.begin(); ec!=mEnvironmentGrid.end(); ++ec, ++grid_cell_index)
+        if (*ec)
+            grid_indices.push_back(grid_cell_index);
+    sortCellOrder(grid_indices);
+
     int cell_index = 0; // index in mCells array
     mNCells = 0;
-    for (EnvironmentCell **ec=mEnvironmentGrid.begin(); ec!=mEnvironmentGrid.end(); ++ec, ++a, ++grid_cell_index)
-        if (*ec) {
-            // setting the index makes a cell valid (index is the index in the mCells array)
-            a->index = cell_index++;
-            // a call to cell() returns mCells[a->index]
-            Cell &cp = a->cell();
-            cp.setCellIndex(grid_cell_index);
-            // set to invalid state (different from NULL which is outside of the project area)
-            cp.setInvalid();
-            // establish link to the environment
-            cp.setEnvironmentCell(*ec);
-            if (!mDEM.isEmpty()) {
-                PointF p = mGrid.cellCenterPoint(grid_cell_index);
-                if (!mDEM.coordValid(p))
-                    throw logic_error_fmt("The digital elevation model '{}' is not valid for the point {:f}/{:f} (which is within the project area)!", filename, p.x(), p.y());
+    for (int grid_index : grid_indices) {
+        GridCell *a = &mGrid[grid_index];
+        // setting the index makes a cell valid (index is the index in the mCells array)
+        a->index = cell_index++;
+        // a call to cell() returns mCells[a->index]
+        Cell &cp = a->cell();
+        cp.setCellIndex(grid_index);
+        // set to invalid state (different from NULL which is outside of the project area)
+        cp.setInvalid();
+        // establish link to the environment
+        cp.setEnvironmentCell(mEnvironmentGrid[grid_index]);
+        if (!mDEM.isEmpty()) {
+            PointF p = mGrid.cellCenterPoint(grid_index);
+            if (!mDEM.coordValid(p))
+                throw logic_error_fmt("The digital elevation model '{}' is not valid for the point {:f}/{:f} (which is within the project area)!", filename, p.x(), p.y());
 
-            }
-            ++mNCells;
         }
+        ++mNCells;
+    }
 
+    // the padded grid for neighborhood queries: the indices of the cells do not change after the setup
+    int halo = 0;
+    for (const auto &p : Cell::mediumNeighbors())
+        halo = std::max(halo, std::max(std::abs(p.x()), std::abs(p.y())));
+    for (const auto &p : Cell::localNeighbors())
+        halo = std::max(halo, std::max(std::abs(p.x()), std::abs(p.y())));
+    mHaloGrid.setup(mGrid, halo, GridCell());
 
     setupInitialState();
     Cell::setup(); // static setup
 
+    mCalendar.setup(mCells, 0);
+    mDistanceFields.setup(this, static_cast<size_t>(Model::instance()->states()->stateIdLookupLength()));
+
     lg->info("Landscape successfully set up.");
 }
 
 
+void Landscape::sortCellOrder(std::vector<int> &grid_indices)
+{
+    // the order of the cells in memory: with 'tile' or 'zorder', cells that are close on the landscape
+    // are also close in the cell vector (and the cell store), i.e., neighborhood queries touch fewer cache lines.
+    // The due cells of a year are processed in the order of the cell vector, so batches are filled in the same order.
+    // The grid itself stays row major (GridCell::index and Cell::cellIndex() translate between the two).
+    auto settings = Model::instance()->settings();
+    std::string mode = settings.valueString("landscape.cellOrder", "row");
+    std::vector<std::string> valid_modes = {"row", "tile", "zorder"};
+    if (!contains(valid_modes, mode))
+        throw std::logic_error("Key 'landscape.cellOrder': '" + mode + "' is invalid. Valid values are: " + join(valid_modes));
+
+    if (mode == "row")
+        return; // the grid indices are already in row order
+
+    std::vector<std::pair<uint64_t, int> > keys;
+    keys.reserve(grid_indices.size());
+    if (mode == "tile") {
+        int tile_size = settings.valueInt("landscape.tileSize", 16);
+        if (tile_size < 1)
+            throw std::logic_error("Key 'landscape.tileSize': the value must be > 0.");
+        uint64_t n_tiles_x = static_cast<uint64_t>((mGrid.sizeX() + tile_size - 1) / tile_size);
+        uint64_t ts = static_cast<uint64_t>(tile_size);
+        for (int grid_index : grid_indices) {
+            Point p = mGrid.indexOf(grid_index);
+            uint64_t x = static_cast<uint64_t>(p.x()), y = static_cast<uint64_t>(p.y());
+            // tiles in row order, and cells within a tile in row order
+            uint64_t key = ((y / ts) * n_tiles_x + x / ts) * ts * ts + (y % ts) * ts + x % ts;
+            keys.push_back(std::make_pair(key, grid_index));
+        }
+    } else {
+        // z-order (Morton code): interleave the bits of x and y
+        auto spread_bits = [](uint64_t v) {
+            v &= 0xffffffff;
+            v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+            v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+            v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+            v = (v | (v << 2)) & 0x3333333333333333ULL;
+            v = (v | (v << 1)) & 0x5555555555555555ULL;
+            return v;
+        };
+        for (int grid_index : grid_indices) {
+            Point p = mGrid.indexOf(grid_index);
+            uint64_t key = spread_bits(static_cast<uint64_t>(p.x())) | (spread_bits(static_cast<uint64_t>(p.y())) << 1);
+            keys.push_back(std::make_pair(key, grid_index));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    for (size_t i=0;i<keys.size();++i)
+        grid_indices[i] = keys[i].second;
+
+    if (auto lg = spdlog::get("setup"))
+        lg->debug("Landscape: cells are stored in '{}' order.", mode);
+}
+
 void Landscape::setupInitialState()
 {
     auto settings = Model::instance()->settings();
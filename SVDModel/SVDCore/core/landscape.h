@@ -24,6 +24,9 @@
 #include "grid.h"
 #include "cell.h"
 #include "environmentcell.h"
+#include "cellcalendar.h"
+#include "speciesneighbors.h"
+#include "distancefields.h"
 
 /// GridCell is a light-weight proxy (4 bytes)
 /// for convenient access to Cell values
@@ -66,10 +69,21 @@ public:
     /// get the spatial. Cells outside the project area are marked
     /// by cells where isNull() is true.
     Grid<GridCell> &grid() { return mGrid; }
+    /// copy of grid() with a border of null cells (wide enough for the neighborhoods of Cell),
+    /// i.e. neighbors can be accessed without bounds checks (see HaloGrid)
+    const HaloGrid<GridCell> &haloGrid() const { return mHaloGrid; }
 
     /// access the actual grid cells
     /// the vector contains all valid cells on the landscape
     std::vector<Cell> &cells() { return mCells; }
+    /// the data of the cells as columns (same order as cells())
+    CellStore &cellStore() { return mCellStore; }
+    /// the calendar of scheduled cell updates
+    CellCalendar &calendar() { return mCalendar; }
+    /// species shares in the neighborhood of the cells that are due in the current year
+    SpeciesNeighbors &speciesNeighbors() { return mSpeciesNeighbors; }
+    /// distance rasters (e.g. distance to the nearest cell of a state)
+    DistanceFields &distanceFields() { return mDistanceFields; }
     /// environment-grid: pointer to EnvironmentCell, nullptr if invalid.
     Grid<EnvironmentCell*> &environment()  { return mEnvironmentGrid; }
 
@@ -82,10 +96,16 @@ public:
     /// get elevation of given cell with cellIndex() index
     float elevationAt(const PointF &coord) { if(mDEM.isEmpty()) return 0.F; return mDEM.valueAt( coord ); }
 private:
+    void sortCellOrder(std::vector<int> &grid_indices);
     void setupInitialState();
     // Grid<Cell> mGrid; ///< main container for the landscape
     Grid<GridCell> mGrid; ///< spatial grid, stores indices to mCells
-    std::vector<Cell> mCells; ///< container for cells
+    HaloGrid<GridCell> mHaloGrid; ///< padded copy of mGrid
+    std::vector<Cell> mCells; ///< container for cells (views on the cell store)
+    CellStore mCellStore; ///< the data of all cells, one array per field
+    CellCalendar mCalendar; ///< index of cells by the year of the next update
+    SpeciesNeighbors mSpeciesNeighbors; ///< neighborhood (species shares) of due cells
+    DistanceFields mDistanceFields; ///< distance to the nearest source cells (updated every year)
 
     Grid<EnvironmentCell*> mEnvironmentGrid; ///< the grid covers the full landscape, and each value points to a cell with the actual env. values
     std::vector<EnvironmentCell> mEnvironmentCells; ///< each EnvironmentCell defines a region
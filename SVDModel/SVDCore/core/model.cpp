@@ -23,8 +23,12 @@
 #include "modules/module.h"
 #include "expressionwrapper.h"
 #include "expression.h"
+#include "randomgen.h"
+#include "perfstats.h"
+#include "tracerecorder.h"
 
 #include <QThreadPool>
+#include <QtConcurrent>
 
 Model *Model::mInstance = nullptr;
 
@@ -55,6 +59,7 @@ Model::Model(const std::string &fileName, Settings *externalSettings)
 
 Model::~Model()
 {
+    TraceRecorder::stop();
     shutdownLogging();
     mInstance = nullptr;
 }
@@ -74,6 +79,28 @@ bool Model::setup()
         lg_setup->info("Disabled multithreading for the model.");
     }
 
+    // random numbers: use a fixed seed for reproducible runs
+    int seed = settings().valueInt("model.seed", 0);
+    if (seed != 0)
+        RandomGenerator::setSeed(static_cast<uint64_t>(seed));
+    else
+        RandomGenerator::setRandomSeed();
+    RandomGenerator::setYear(0);
+    RandomGenerator::setStream(0, RandomGenerator::Setup);
+    lg_setup->info("Random seed: {}.", RandomGenerator::seed());
+
+    // timeline of the processing chain (Chrome trace format)
+    if (settings().valueBool("logging.trace.enabled", "false")) {
+        mTraceFile = Tools::path(settings().valueString("logging.trace.file", "trace_$year$.json"));
+        size_t n_events = settings().valueUInt("logging.trace.bufferSize", 1000000);
+        TraceRecorder::start(n_events);
+        TraceRecorder::setThreadName("model");
+        lg_setup->info("Tracing enabled (buffer: {} events), file: '{}'.", n_events, mTraceFile);
+    } else {
+        TraceRecorder::stop();
+        mTraceFile.clear();
+    }
+
     // set up outputs
     mOutputManager = std::shared_ptr<OutputManager>(new OutputManager());
     mOutputManager->setup();
@@ -95,6 +122,12 @@ bool Model::setup()
 
     setupExpressionWrapper();
 
+    // distance rasters of the states used in expressions (distance(), see Cell::minimumDistanceTo())
+    for (int state_id : Expression::distanceStates()) {
+        if (mLandscape->distanceFields().addStateLayer(static_cast<state_t>(state_id)))
+            lg_setup->debug("Created the distance layer for state {}.", state_id);
+    }
+
     mStates->updateStateHistogram();
 
     lg_setup->info("************************************************************");
@@ -108,13 +141,48 @@ bool Model::setup()
 
 void Model::finalizeYear()
 {
+    PerfTimer timer(PerfStats::FinalizeYear);
+    TraceScope trace("finalize year", "model");
     // increment residence time for all pixels (updated pixels go from 0 -> 1)
-    // and update to a new state if changes should happen
-    for (Cell &c : landscape()->cells())
-        c.update();
+    // and update to a new state if changes should happen.
+    // This is done in parallel for chunks of cells; every chunk counts the states (histogram) and
+    // state transitions, which are merged afterwards.
+    struct YearEndChunk {
+        size_t begin, end;
+        std::vector<int> histogram;
+        StateMatrixOut::TransitionMap transitions;
+    };
+    std::vector<Cell> &cells = landscape()->cells();
+    const size_t n_states = mStates->stateHistogram().size();
+    const size_t min_chunk_size = 10000;
+    size_t n_chunks = static_cast<size_t>(std::max(QThreadPool::globalInstance()->maxThreadCount(), 1)) * 4;
+    n_chunks = std::max(std::min(n_chunks, cells.size() / min_chunk_size), size_t(1));
+    std::vector<YearEndChunk> chunks(n_chunks);
+    for (size_t i=0;i<n_chunks;++i) {
+        chunks[i].begin = cells.size() * i / n_chunks;
+        chunks[i].end = cells.size() * (i+1) / n_chunks;
+    }
 
+    const state_t *state_ids = landscape()->cellStore().stateId.data();
+    QtConcurrent::blockingMap(chunks, [&cells, state_ids, n_states](YearEndChunk &chunk) {
+        chunk.histogram.assign(n_states, 0);
+        for (size_t i=chunk.begin; i<chunk.end; ++i)
+            cells[i].update(&chunk.transitions);
+        // the histogram reads only the (updated) state column of the chunk
+        for (size_t i=chunk.begin; i<chunk.end; ++i)
+            chunk.histogram[static_cast<size_t>(state_ids[i])]++;
+    });
 
-    mStates->updateStateHistogram();
+    // merge the results of the chunks
+    std::vector<int> histogram(n_states, 0);
+    StateMatrixOut *sm_out = dynamic_cast<StateMatrixOut*>( outputManager()->find("StateMatrix") );
+    for (const auto &chunk : chunks) {
+        for (size_t i=0;i<n_states;++i)
+            histogram[i] += chunk.histogram[i];
+        if (sm_out)
+            sm_out->merge(chunk.transitions);
+    }
+    mStates->setStateHistogram(std::move(histogram));
 
     outputManager()->yearEnd();
 
@@ -122,6 +190,18 @@ void Model::finalizeYear()
     stats.NPackagesTotalDNN += stats.NPackagesDNN;
 }
 
+void Model::writeTrace()
+{
+    if (mTraceFile.empty())
+        return;
+    // with $year$ a file per year, otherwise a single file (rewritten every year) for the whole run
+    std::string file_name = mTraceFile;
+    bool per_year = file_name.find("$year$") != std::string::npos;
+    find_and_replace(file_name, "$year$", to_string(year()));
+    size_t n = TraceRecorder::dump(file_name, per_year);
+    lg_main->debug("Trace: wrote {} events to '{}'.", n, file_name);
+}
+
 void Model::runModules()
 {
     auto lg = spdlog::get("main");
@@ -129,6 +209,10 @@ void Model::runModules()
     for (auto &module : mModules) {
         STimer tmr(lg, "Module " + module->name() );
         lg->debug("Run module '{}'", module->name());
+        // every module has its own random stream
+        RandomGenerator::setStream(RandomGenerator::streamKey(module->name()), RandomGenerator::Module);
+        PerfTimer timer(PerfStats::ModuleRun);
+        TraceScope trace("module run", "model");
         module->run();
     }
 }
@@ -159,6 +243,21 @@ void Model::newYear()
     stats.NPackagesSent = stats.NPackagesDNN = 0;
     // increment the counter
     mYear = mYear + 1;
+    RandomGenerator::setYear(mYear);
+    // find the cells that need to be updated in this year
+    mLandscape->calendar().advance(mYear);
+    // distance rasters (if used)
+    if (!mLandscape->distanceFields().isEmpty()) {
+        PerfTimer timer(PerfStats::YearSetup);
+        TraceScope trace("distance fields", "model");
+        mLandscape->distanceFields().update();
+    }
+    // species shares in the neighborhood of the due cells (if used by the DNN)
+    if (mLandscape->speciesNeighbors().enabled()) {
+        PerfTimer timer(PerfStats::YearSetup);
+        TraceScope trace("neighbor species", "model");
+        mLandscape->speciesNeighbors().update(mLandscape.get(), mLandscape->calendar().dueCells());
+    }
     // other initialization ....
     BatchManager::instance()->newYear();
 }
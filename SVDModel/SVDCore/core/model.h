@@ -20,6 +20,7 @@
 #define MODEL_H
 // system
 #include <memory>
+#include <atomic>
 #include <functional>
 
 #include "spdlog/spdlog.h"
@@ -47,6 +48,8 @@ public:
     void finalizeYear();
 
     void runModules();
+    /// write the timeline of the year to a file (if enabled with `logging.trace.enabled`)
+    void writeTrace();
 
     // callbacks
     void setProcessEventsCallback( std::function<void()> event) { mProcessEvents = event; }
@@ -85,8 +88,8 @@ public:
     const Settings &settings() const { return mSettings; }
     struct SystemStats {
         SystemStats(): NPackagesSent(0),  NPackagesDNN(0), NPackagesTotalSent(0), NPackagesTotalDNN(0)  {}
-        size_t NPackagesSent;
-        size_t NPackagesDNN;
+        std::atomic<size_t> NPackagesSent;
+        std::atomic<size_t> NPackagesDNN;
         size_t NPackagesTotalSent;
         size_t NPackagesTotalDNN;
     } stats;
@@ -117,6 +120,7 @@ private:
     std::shared_ptr<Landscape> mLandscape;
     ExternalSeeds mExternalSeeds;
     std::shared_ptr<OutputManager> mOutputManager;
+    std::string mTraceFile; ///< file name for the trace (empty: tracing disabled)
     // modules
     std::vector< std::shared_ptr<Module> > mModules;
     // loggers
@@ -0,0 +1,176 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "speciesneighbors.h"
+
+#include <algorithm>
+#include <map>
+#include <cstdlib>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include "model.h"
+#include "landscape.h"
+
+void SpeciesNeighbors::update(Landscape *landscape, const std::vector<int> &due)
+{
+    if (!mEnabled)
+        return;
+    if (mSegments.empty())
+        setupSegments();
+
+    std::vector<Cell> &cells = landscape->cells();
+    auto &grid = landscape->grid();
+    mNSpecies = Model::instance()->species().size();
+    mNValues = mNSpecies * 2;
+    mFirstCell = cells.data();
+    mRow.assign(cells.size(), -1);
+    mGridRows.assign(static_cast<size_t>(grid.sizeY()), 0);
+
+    // the cells that are updated by the DNN in this year (states without a module)
+    int n = 0;
+    for (int pos : due) {
+        const Cell &cell = cells[static_cast<size_t>(pos)];
+        if (cell.isNull() || !cell.state() || cell.state()->module())
+            continue;
+        mRow[static_cast<size_t>(pos)] = n++;
+        mGridRows[static_cast<size_t>(grid.indexOf(cell.cellIndex()).y())] = 1;
+    }
+    mValues.resize(static_cast<size_t>(n) * mNValues);
+    if (n == 0)
+        return;
+
+    // process bands of rows in parallel
+    const int size_y = grid.sizeY();
+    int n_bands = std::max(QThreadPool::globalInstance()->maxThreadCount(), 1) * 4;
+    n_bands = std::max(std::min(n_bands, size_y / 16), 1);
+    std::vector<int> bands(static_cast<size_t>(n_bands));
+    for (int i=0;i<n_bands;++i)
+        bands[static_cast<size_t>(i)] = i;
+    QtConcurrent::blockingMap(bands, [this, landscape, size_y, n_bands](int &band) {
+        updateRows(landscape, size_y * band / n_bands, size_y * (band + 1) / n_bands);
+    });
+}
+
+void SpeciesNeighbors::setupSegments()
+{
+    // split the neighborhoods into runs of consecutive cells within a row
+    mSegments.clear();
+    mRadius = 0;
+    auto add_segments = [this](const std::vector<Point> &offsets, bool local) {
+        std::map<int, std::vector<int> > rows;
+        for (const auto &p : offsets)
+            rows[p.y()].push_back(p.x());
+        for (auto &r : rows) {
+            std::vector<int> &xs = r.second;
+            std::sort(xs.begin(), xs.end());
+            size_t start = 0;
+            for (size_t i=1; i<=xs.size(); ++i) {
+                if (i == xs.size() || xs[i] != xs[i-1] + 1) {
+                    mSegments.push_back(Segment{r.first, xs[start], xs[i-1], local});
+                    start = i;
+                }
+            }
+            mRadius = std::max(mRadius, std::abs(r.first));
+        }
+    };
+    add_segments(Cell::localNeighbors(), true);
+    add_segments(Cell::mediumNeighbors(), false);
+}
+
+void SpeciesNeighbors::updateRows(Landscape *landscape, int y_from, int y_to)
+{
+    auto &grid = landscape->grid();
+    const ExternalSeeds &seeds = Model::instance()->externalSeeds();
+    const int size_x = grid.sizeX();
+    const int size_y = grid.sizeY();
+    const size_t n_species = mNSpecies;
+    const size_t stride = n_species + 1; // the shares of all species and the number of forested cells
+    const size_t n_ring = static_cast<size_t>(2 * mRadius + 1);
+    const size_t row_size = static_cast<size_t>(size_x + 1) * stride;
+
+    // running sums along rows, for the rows y-radius .. y+radius (ring buffer).
+    // The sum of the cells x1..x2 is sums[(x2+1)*stride] - sums[x1*stride].
+    std::vector<double> sums(n_ring * row_size, 0.);
+    std::vector<int> ring_row(n_ring, -1);
+    auto row_sums = [&](int y) -> const double * {
+        size_t slot = static_cast<size_t>(y) % n_ring;
+        double *s = sums.data() + slot * row_size;
+        if (ring_row[slot] == y)
+            return s;
+        ring_row[slot] = y;
+        std::fill(s, s + stride, 0.);
+        for (int x=0; x<size_x; ++x) {
+            const double *prev = s + static_cast<size_t>(x) * stride;
+            double *cur = s + static_cast<size_t>(x + 1) * stride;
+            const GridCell &gc = grid.valueAtIndex(x, y);
+            const std::vector<double> *shares = nullptr;
+            if (!gc.isNull()) {
+                const Cell &cell = gc.cell();
+                // see Cell::neighborSpecies(): forested cells and external seeds (with a state, or with species shares)
+                if ((cell.state() && cell.state()->type()==State::Forest) || cell.externalSeedType()>=0)
+                    shares = cell.state() ? &cell.state()->speciesProportion() : &seeds.speciesShares(cell.externalSeedType());
+            }
+            if (shares) {
+                for (size_t i=0; i<n_species; ++i)
+                    cur[i] = prev[i] + (*shares)[i];
+                cur[n_species] = prev[n_species] + 1.;
+            } else {
+                std::copy(prev, prev + stride, cur);
+            }
+        }
+        return s;
+    };
+
+    std::vector<double> local(stride), mid(stride);
+    std::vector<const double*> segment_rows(mSegments.size());
+    for (int y=y_from; y<y_to; ++y) {
+        if (!mGridRows[static_cast<size_t>(y)])
+            continue;
+        for (size_t s=0; s<mSegments.size(); ++s) {
+            int yy = y + mSegments[s].dy;
+            segment_rows[s] = (yy>=0 && yy<size_y) ? row_sums(yy) : nullptr;
+        }
+        for (int x=0; x<size_x; ++x) {
+            const GridCell &gc = grid.valueAtIndex(x, y);
+            if (gc.isNull() || mRow[static_cast<size_t>(gc.index)] < 0)
+                continue;
+            std::fill(local.begin(), local.end(), 0.);
+            std::fill(mid.begin(), mid.end(), 0.);
+            for (size_t s=0; s<mSegments.size(); ++s) {
+                if (!segment_rows[s])
+                    continue;
+                const Segment &seg = mSegments[s];
+                int x1 = std::max(x + seg.x1, 0);
+                int x2 = std::min(x + seg.x2, size_x - 1);
+                if (x1 > x2)
+                    continue;
+                const double *hi = segment_rows[s] + static_cast<size_t>(x2 + 1) * stride;
+                const double *lo = segment_rows[s] + static_cast<size_t>(x1) * stride;
+                double *acc = seg.local ? local.data() : mid.data();
+                for (size_t i=0; i<stride; ++i)
+                    acc[i] += hi[i] - lo[i];
+            }
+            float *out = mValues.data() + static_cast<size_t>(mRow[static_cast<size_t>(gc.index)]) * mNValues;
+            for (size_t i=0; i<n_species; ++i) {
+                out[i*2] = local[n_species] > 0. ? static_cast<float>(local[i] / local[n_species]) : 0.f;
+                out[i*2+1] = mid[n_species] > 0. ? static_cast<float>(mid[i] / mid[n_species]) : 0.f;
+            }
+        }
+    }
+}
@@ -0,0 +1,80 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef SPECIESNEIGHBORS_H
+#define SPECIESNEIGHBORS_H
+
+#include <vector>
+#include <cstddef>
+
+#include "cell.h"
+
+class Landscape; // forward
+
+/**
+ * @brief The SpeciesNeighbors class provides the species shares in the neighborhood of cells (see Cell::neighborSpecies()).
+ *
+ * The shares are calculated once per year (update()) for all cells that are due in the year and are
+ * updated by the DNN. The neighborhoods (Cell::localNeighbors(), Cell::mediumNeighbors()) are split into
+ * horizontal segments (up to 7 rows), and the sum of species shares (and the number of forested cells) of a
+ * segment is the difference of two running sums along the row of the landscape. The landscape is processed in parallel
+ * in bands of rows, and each band keeps the running sums of only the rows that are currently needed.
+ * The values of a cell are stored as 2 x number of species floats (local and mid-range share for each species),
+ * i.e., in the same layout as Cell::neighborSpecies().
+ */
+class SpeciesNeighbors
+{
+public:
+    SpeciesNeighbors() {}
+    /// the calculation is enabled only if the data is used (by the DNN)
+    void setEnabled(bool enabled) { mEnabled = enabled; }
+    bool enabled() const { return mEnabled; }
+
+    /// calculate the neighborhood of the cells `due` (indices into Landscape::cells()) with the current state of the landscape
+    void update(Landscape *landscape, const std::vector<int> &due);
+
+    /// number of values per cell (2 x number of species)
+    size_t valuesPerCell() const { return mNValues; }
+    /// the values of `cell`, or nullptr if the cell is not included in the last update()
+    const float *values(const Cell *cell) const {
+        size_t pos = static_cast<size_t>(cell - mFirstCell);
+        if (pos >= mRow.size() || mRow[pos] < 0)
+            return nullptr;
+        return mValues.data() + static_cast<size_t>(mRow[pos]) * mNValues;
+    }
+
+private:
+    /// a horizontal segment (x offsets `x1`..`x2`) in the row with the offset `dy` of a neighborhood
+    struct Segment {
+        int dy, x1, x2;
+        bool local; ///< true: local neighborhood, false: medium-range neighborhood
+    };
+    void setupSegments();
+    void updateRows(Landscape *landscape, int y_from, int y_to);
+    bool mEnabled {false};
+    std::vector<Segment> mSegments;
+    int mRadius {0}; ///< maximum row offset of the segments
+    size_t mNSpecies {0};
+    size_t mNValues {0};
+    const Cell *mFirstCell {nullptr};
+    std::vector<int> mRow; ///< row in mValues for each cell (-1: not calculated)
+    std::vector<char> mGridRows; ///< 1 for rows of the grid with at least one calculated cell
+    std::vector<float> mValues;
+};
+
+#endif // SPECIESNEIGHBORS_H
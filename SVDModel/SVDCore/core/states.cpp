@@ -122,8 +122,8 @@ void States::updateStateHistogram()
     std::fill(mStateHistogram.begin(), mStateHistogram.end(), 0);
 
     // count every state on the landscape
-    for (auto &c : Model::instance()->landscape()->cells())
-        mStateHistogram[static_cast<size_t>(c.stateId())]++;
+    for (state_t id : Model::instance()->landscape()->cellStore().stateId)
+        mStateHistogram[static_cast<size_t>(id)]++;
 }
 
 const State &States::randomState() const
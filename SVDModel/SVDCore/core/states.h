@@ -107,6 +107,8 @@ public:
     void updateStateHistogram();
     /// frequencies of states in the landscape. use stateId as index for vector.
     const std::vector<int> &stateHistogram() const { return mStateHistogram; }
+    /// set the frequencies of states (e.g. when counted during the update of cells, see Model::finalizeYear())
+    void setStateHistogram(std::vector<int> &&histogram) { mStateHistogram = std::move(histogram); }
 
     // members
     bool isValid(state_t state) const { return mStateSet.find(state) != mStateSet.end(); }
@@ -21,6 +21,7 @@
 
 #include "../Predictor/inferencedata.h"
 #include "../Predictor/batchdnn.h"
+#include "../Predictor/inferencepipeline.h"
 #include "grid.h"
 #include "outputs/outputmanager.h"
 
@@ -28,6 +29,9 @@
 #include "modules/fire/firemodule.h"
 #include "modules/module.h"
 #include "tools.h"
+#include "randomgen.h"
+#include "perfstats.h"
+#include "tracerecorder.h"
 
 #include <QThread>
 #include <QCoreApplication>
@@ -45,15 +49,14 @@ ModelShell::ModelShell(QObject *parent)
 
     mModel = nullptr;
     mPackagesBuilt = 0;
+    mPackagesProcessed = 0;
+    mPackagesSubmitted = 0;
+    mPackagesReturned = 0;
     mPackageId = 0;
+    mCellsProcesssed = 0;
 
     qRegisterMetaType<Batch*>();
 
-
-    connect(&packageWatcher, SIGNAL(finished()), this, SLOT(allPackagesBuilt()));
-    //packageWatcher.setFuture(packageFuture);
-
-
 }
 
 ModelShell::~ModelShell()
@@ -63,6 +66,8 @@ ModelShell::~ModelShell()
 
 void ModelShell::destroyModel()
 {
+    // results that are still processed refer to the model
+    mResultPool.waitForDone();
     if (!mModel && Model::hasInstance())
         mModel = Model::instance(); // hackish way to make sure the global model is deleted
 
@@ -189,6 +194,20 @@ void ModelShell::setup()
                 QThread::msleep(50);
                 QCoreApplication::processEvents();
             }
+            // batches that are sent early (adaptive batching) go through the same path as full batches
+            if (BatchManager::hasInstance())
+                BatchManager::instance()->setSendBatchCallback( std::bind(&ModelShell::sendBatch, this, std::placeholders::_1) );
+
+            // the results of DNN batches are processed by a separate pool of threads (not the global pool:
+            // the threads of the global pool may wait for a free batch, which is only released after processing the results)
+            int n_result_threads = model()->settings().valueInt("model.resultThreads", -1);
+            if (n_result_threads < 0)
+                n_result_threads = std::max(QThreadPool::globalInstance()->maxThreadCount() / 2, 1);
+            mParallelResults = n_result_threads > 0;
+            if (mParallelResults)
+                mResultPool.setMaxThreadCount(n_result_threads);
+            lg->info("Results of the DNN are processed {} (model.resultThreads={}).", mParallelResults ? "in parallel" : "in the model thread", n_result_threads);
+
             setState( ModelRunState::ReadyToRun );
             mTimer = new STimer(lg, "run year", false);
         }
@@ -259,20 +278,21 @@ void ModelShell::setState(ModelRunState::State new_state, QString msg)
 
 
 
-static QMutex lock_processed_package;
+/// process the results of a batch (DNN or module), and release the batch.
+/// Called from the result threads or the model thread (DNN batches), or from worker threads (other batches);
+/// batches are processed in parallel, the cells of different batches do not overlap.
 void ModelShell::processedPackage(Batch *batch)
 {
     mModel->stats.NPackagesDNN++;
     if (RunState::instance()->cancel() || batch->hasError()) {
+        lg->debug("error/cancel packages: all built: {}, #built: {}, #processed: {}, batch-id: {}", mAllPackagesBuilt, mPackagesBuilt.load(), mPackagesProcessed.load(), batch->packageId());
         mPackagesProcessed++;
-        lg->debug("error/cancel packages: all built: {}, #built: {}, #processed: {}, batch-id: {}", mAllPackagesBuilt, mPackagesBuilt, mPackagesProcessed, batch->packageId());
-        if (mPackagesBuilt==mPackagesProcessed) {
-            finalizeCycle();
-        }
         return;
     }
 
+    TraceRecorder::TimePoint t_start = TraceRecorder::now();
     try {
+        PerfTimer timer(PerfStats::ProcessResults);
 
         // TODO: this is a bit too much: some handling in derived batch types (DNN), some in modules (handlers)
         lg->debug("ModelShell: now process batch {}.", batch->packageId() );
@@ -288,25 +308,22 @@ void ModelShell::processedPackage(Batch *batch)
         RunState::instance()->setError("An error occured while processing the batch", RunState::instance()->modelState());
         lg->error("An error occured while processing the batch: {}", e.what());
     }
+    if (TraceRecorder::isEnabled()) {
+        auto t_end = TraceRecorder::now();
+        TraceRecorder::span("process results", "model", t_start, t_end, batch->packageId(), static_cast<int>(batch->usedSlots()));
+        TraceRecorder::batchSpan("results", t_start, t_end, batch->packageId(), static_cast<int>(batch->usedSlots()));
+    }
 
 
 
 
-    batch->changeState(Batch::Fill);
+    // the batch can be filled again; this wakes up threads waiting for a free batch
+    BatchManager::instance()->releaseBatch(batch);
 
     // now the data can be freed:
-    {
-        QMutexLocker locker(&lock_processed_package);
-        mPackagesProcessed++;
-
-    }
+    mPackagesProcessed++;
 
-    if (mAllPackagesBuilt && mPackagesBuilt==mPackagesProcessed) {
-        lg->debug( "Model: processsed Last Package (no packages pending in DNN)! [NSent: {} NReceived: {}]", mModel->stats.NPackagesSent, mModel->stats.NPackagesDNN );
-        finalizeCycle();
-    } else {
-        lg->debug( "Model: #packages: {} sent, {} processed [total: NSent: {} NReceived: {}]", mPackagesBuilt, mPackagesProcessed, mModel->stats.NPackagesSent, mModel->stats.NPackagesDNN);
-    }
+    lg->debug( "Model: #packages: {} sent, {} processed [total: NSent: {} NReceived: {}]", mPackagesBuilt.load(), mPackagesProcessed.load(), mModel->stats.NPackagesSent.load(), mModel->stats.NPackagesDNN.load());
 
 }
 
@@ -314,23 +331,50 @@ void ModelShell::allPackagesBuilt()
 {
     try{
 
-        if (!BatchManager::instance()->slotsRequested()) {
+        if (!BatchManager::instance()->slotsRequested())
             lg->debug("No pixel was updated this year.");
-            finalizeCycle();
-        }
+
         //lg->debug("** all packages built, starting the last package");
         sendPendingBatches(); // start last batch (even if < than batch size)
         mAllPackagesBuilt = true;
-        if (mPackagesBuilt==mPackagesProcessed && mPackagesProcessed>0) {
-            lg->debug( "Model: processsed Last Package! [NSent: {} NReceived: {}]", mModel->stats.NPackagesSent, mModel->stats.NPackagesDNN );
-            finalizeCycle();
-        }
     } catch (const std::exception &e) {
         RunState::instance()->setError("Error: " + to_string(e.what()), RunState::instance()->modelState());
     }
 
 }
 
+/// collect the batches that come back from the inference pipeline in the model thread,
+/// until all cells are evaluated and all packages are processed. The results are processed
+/// by the result threads (or in the model thread, see `model.resultThreads`).
+void ModelShell::waitForPackages()
+{
+    Batch *batch;
+    // batches that are not sent to the DNN are processed before all packages are built (see sendBatch()).
+    // Batches that are flushed by idle DNN threads are sealed before they are submitted (see BatchManager::flushOnIdle()),
+    // so they need to be counted separately (the order of the checks matters).
+    while (!mAllPackagesBuilt || BatchManager::instance()->flushesInFlight() > 0 || mPackagesReturned != mPackagesSubmitted) {
+        if (!InferencePipeline::instance()->waitForResult(batch)) {
+            lg->error("Inference pipeline stopped while waiting for results.");
+            mResultPool.waitForDone();
+            return;
+        }
+        if (batch) {
+            ++mPackagesReturned;
+            if (mParallelResults)
+                QtConcurrent::run(&mResultPool, [this, batch]() { processedPackage(batch); });
+            else
+                processedPackage(batch);
+        } else if (!mAllPackagesBuilt && mCellsEvaluated) {
+            allPackagesBuilt(); // wake up signal: all cells are evaluated (see internalRun())
+        }
+    }
+    mResultPool.waitForDone();
+    if (mPackagesBuilt != mPackagesProcessed)
+        lg->warn("Model: not all packages processed (built: {}, processed: {}).", mPackagesBuilt.load(), mPackagesProcessed.load());
+    lg->debug( "Model: processsed Last Package! [NSent: {} NReceived: {}]", mModel->stats.NPackagesSent.load(), mModel->stats.NPackagesDNN.load() );
+    finalizeCycle();
+}
+
 void ModelShell::internalRun()
 {
 
@@ -338,16 +382,32 @@ void ModelShell::internalRun()
         // increment the time step of the model
         mModel->newYear();
         mAllPackagesBuilt=false;
+        mCellsEvaluated=false;
         mPackagesBuilt=0;
         mPackagesProcessed=0;
+        mPackagesSubmitted=0;
+        mPackagesReturned=0;
         mTimer->reset();
 
         // check for each cell if we need to do something; if yes, then
         // fill a InferenceData item within a batch of data
-        // allPackagesBuilt() is called when completed
+        // the model thread is woken up when all cells are evaluated (allPackagesBuilt())
         setState(ModelRunState::Running, "update cells");
-        packageFuture = QtConcurrent::map(mModel->landscape()->cells(), [this](Cell &cell){ this->evaluateCell(&cell); });
-        packageWatcher.setFuture(packageFuture);
+        // only the cells that are due in the current year are visited (see CellCalendar)
+        packageFuture = QtConcurrent::run([this]() {
+            TraceScope trace("evaluate cells", "model");
+            const std::vector<int> &due = mModel->landscape()->calendar().dueCells();
+            // the cells are evaluated in parallel in chunks (see evaluateCells())
+            const size_t chunk_size = 256;
+            std::vector<size_t> chunks;
+            for (size_t i=0; i<due.size(); i+=chunk_size)
+                chunks.push_back(i);
+            QtConcurrent::blockingMap(chunks, [this, &due, chunk_size](size_t &first) {
+                this->evaluateCells(due.data() + first, due.data() + std::min(first + chunk_size, due.size()));
+            });
+            mCellsEvaluated = true;
+            InferencePipeline::instance()->wakeUp();
+        });
 
         // run the modules
         setState(ModelRunState::Running, "running modules");
@@ -360,12 +420,29 @@ void ModelShell::internalRun()
         mModel->outputManager()->run("StateHist");
         mModel->outputManager()->run("StateMatrix");
 
+        // process the results of the DNN
         setState(ModelRunState::Running, "update cells");
+        waitForPackages();
+}
+
+/// evaluate the cells with the indices `begin`..`end` (a chunk of the due cells).
+/// This function is called in parallel for chunks of cells. Cells in states that are handled by
+/// modules with simple batches (e.g. MatrixModule) are collected in batches that belong to the chunk,
+/// and are processed directly, i.e. without the BatchManager and the inference pipeline.
+void ModelShell::evaluateCells(const int *begin, const int *end)
+{
+    std::vector<Cell> &cells = mModel->landscape()->cells();
+    DirectBatches direct;
+    for (const int *p = begin; p != end; ++p)
+        evaluateCell(&cells[static_cast<size_t>(*p)], direct);
+
+    for (auto &batch : direct)
+        processDirectBatch(batch.get());
 }
 
 /// Main processing function for a single cell on the landscape
 /// this function is called in parallel.
-void ModelShell::evaluateCell(Cell *cell)
+void ModelShell::evaluateCell(Cell *cell, DirectBatches &direct)
 {
     if (RunState::instance()->cancel())
         return;
@@ -378,6 +455,10 @@ void ModelShell::evaluateCell(Cell *cell)
     if (cell->stateId() == 0) // TODO: Check: WR2023-04-25: nur um fehlermeldung zu silencen
         return;
 
+    // random numbers used for the cell do not depend on the thread
+    RandomGenerator::setStream(static_cast<uint64_t>(cell->cellIndex()), RandomGenerator::CellEvaluation);
+    PerfTimer timer(PerfStats::CellEvaluation);
+
     try {
 
         if (cell->state()==nullptr) {
@@ -385,6 +466,11 @@ void ModelShell::evaluateCell(Cell *cell)
         }
 
         if( Module *module = cell->state()->module() ) {
+            if (module->batchType()==Batch::Simple) {
+                // the module processes the cell directly (in the current thread)
+                addDirectCell(cell, module, direct);
+                return;
+            }
             // extra module handles this state:
             // get a suitable slot in a batch for the given type
             std::pair<Batch*, size_t> slot = getSlot(cell, module);
@@ -403,6 +489,48 @@ void ModelShell::evaluateCell(Cell *cell)
 
 }
 
+/// add the `cell` to the direct batch of `module`; a full batch is processed immediately.
+void ModelShell::addDirectCell(Cell *cell, Module *module, DirectBatches &direct)
+{
+    Batch *batch = nullptr;
+    for (auto &b : direct)
+        if (b->module() == module) {
+            batch = b.get();
+            break;
+        }
+    if (!batch) {
+        direct.push_back(std::unique_ptr<Batch>(new Batch(256)));
+        batch = direct.back().get();
+        batch->setModule(module);
+        batch->open(batch->batchSize());
+    }
+
+    batch->setCell(cell, batch->acquireSlot());
+    module->prepareCell(cell);
+    if (batch->freeSlots() == 0)
+        processDirectBatch(batch);
+}
+
+/// run the module of a direct batch (see evaluateCells()), and reset the batch.
+void ModelShell::processDirectBatch(Batch *batch)
+{
+    if (batch->usedSlots() == 0)
+        return;
+    if (!RunState::instance()->cancel()) {
+        PerfTimer timer(PerfStats::ProcessResults);
+        try {
+            batch->module()->processBatch(batch);
+            mCellsProcesssed += batch->usedSlots();
+        } catch (const std::exception &e) {
+            RunState::instance()->setError("An error occured while processing the batch", RunState::instance()->modelState());
+            lg->error("An error occured in module '{}' while processing cells: {}", batch->module()->name(), e.what());
+        }
+    }
+    // the batch can be filled again
+    batch->changeState(Batch::Fill);
+    batch->open(batch->batchSize());
+}
+
 // this function is executed for each cell on the landscape
 // if a cell needs an update, the data is collected and the cell
 // is stored within a batch.
@@ -422,13 +550,8 @@ void ModelShell::buildInferenceDataDNN(Cell *cell)
             }
         }
 
-        // populate the batch with data for this particular cell
-        batch->fetchPredictors(cell, newslot.second);
-
-//        InferenceData &id = batch->inferenceData(newslot.second);
-
-//        // populate the InferenceData with the required data
-//        id.fetchData(cell, batch, newslot.second);
+        // register the cell in the batch; the data of all cells is fetched when the batch is sent
+        batch->setCell(cell, newslot.second);
 
         // check if batch is finished and send if this is the case
         if (checkBatch(batch))
@@ -457,8 +580,8 @@ std::pair<Batch*, size_t> ModelShell::getSlot(Cell *cell, Module *module)
 }
 
 
-static QMutex _check_batch;
 /// sends a package to the Inference process when all slots are filled.
+/// The function is lock-free: only the thread that fills the last slot of a batch sends the batch.
 bool ModelShell::checkBatch(Batch *batch)
 {
     if (RunState::instance()->cancel()) {
@@ -466,15 +589,10 @@ bool ModelShell::checkBatch(Batch *batch)
         return false;
     }
 
-    bool all_processed;
-    {
-    QMutexLocker lock(&_check_batch);
-    batch->finishedCellProcessing();
-    all_processed = batch->allCellsProcessed();
-    }
-    if (all_processed) {
-        if (batch->state()!=Batch::Fill) {
-            lg->warn("Package [{}] already sent!", static_cast<void*>(batch));
+    if (batch->finishedCellProcessing()) {
+        if (!batch->seal()) {
+            // the batch was closed and sent by an idle DNN thread in the meantime (see BatchManager::flushOnIdle())
+            lg->trace("Package [{}] already sent.", static_cast<void*>(batch));
             return false;
         }
 
@@ -486,19 +604,32 @@ bool ModelShell::checkBatch(Batch *batch)
     return false;
 }
 
-static QMutex _lock_package_built;
 void ModelShell::sendBatch(Batch *batch)
 {
     batch->setPackageId(++mPackageId);
     mModel->stats.NPackagesSent ++;
-    {
-        QMutexLocker lock(&_lock_package_built);
-        ++mPackagesBuilt;
-    }
-    // send via signal/slot for DNN packages
+    ++mPackagesBuilt;
+    // DNN packages are queued in the inference pipeline
     if (batch->type()==Batch::DNN) {
-        lg->debug("sending package {} [{}] to Inference (built total: {})", mPackageId, static_cast<void*>(batch), mPackagesBuilt);
-        emit newPackage(batch);
+        // populate the tensors with the data of all cells of the batch
+        try {
+            static_cast<BatchDNN*>(batch)->fetchBatch();
+        } catch (const std::exception &e) {
+            RunState::instance()->setError("Error: " + to_string(e.what()), RunState::instance()->modelState());
+            batch->setError(true);
+            // the batch never reaches the pipeline: return it to the pool of batches
+            BatchManager::instance()->releaseBatch(batch);
+            ++mPackagesProcessed;
+            return;
+        }
+        lg->debug("sending package {} [{}] to Inference (built total: {})", batch->packageId(), static_cast<void*>(batch), mPackagesBuilt.load());
+        ++mPackagesSubmitted;
+        if (!InferencePipeline::instance()->submit(batch)) {
+            // the pipeline is stopped: the package will never come back
+            --mPackagesSubmitted;
+            batch->setError(true);
+            ++mPackagesProcessed;
+        }
     } else {
         // directly call the function (in a thread)
         processedPackage(batch);
@@ -516,18 +647,17 @@ void ModelShell::sendBatch(Batch *batch)
 }
 
 
-/// sendInferencePackage() takes the next batch of items and emits a signal
-/// to the DNN thread that a new batch is ready to process
-/// Note that this code is still protected by the 'lock_inference_list' mutex
+/// sends the partially filled batches (e.g. at the end of the cell evaluation):
+/// each batch is sealed (i.e. sent only once, see Batch::seal()) and submitted to the InferencePipeline (see sendBatch()).
 void ModelShell::sendPendingBatches()
 {
     if (RunState::instance()->cancel())
         return;
 
     for (auto e : BatchManager::instance()->batches()) {
-        if (e->state()==Batch::Fill && e->usedSlots()>0) {
+        if (e->state()==Batch::Fill && e->usedSlots()>0 && e->seal()) {
             sendBatch(e);
-            lg->debug("sending pending package {} [{}] to Inference. (total. {}, size queue: {})", mPackageId, static_cast<void*>(e), mPackagesBuilt, BatchManager::instance()->batches().size());
+            lg->debug("sending pending package {} [{}] to Inference. (total. {}, size queue: {})", mPackageId.load(), static_cast<void*>(e), mPackagesBuilt.load(), BatchManager::instance()->batches().size());
 
         }
     }
@@ -542,6 +672,9 @@ void ModelShell::finalizeCycle()
     }
     // everything is
     mModel->finalizeYear();
+    // timings of the year (including finalizeYear())
+    mModel->outputManager()->run("Performance");
+    mModel->writeTrace();
     lg->info("Year {} finished (total runtime: {}).", mModel->year(), mTimer->elapsedStr());
 
     setState(ModelRunState::ReadyToRun);
@@ -21,8 +21,8 @@
 
 #include <QObject>
 #include <QFuture>
-#include <QFutureWatcher>
 #include <QtConcurrent>
+#include <atomic>
 
 #include "modelrunstate.h"
 #include "spdlog/spdlog.h"
@@ -60,9 +60,6 @@ signals:
     void log(QString s);
 
 
-    void newPackage(Batch *batch);
-
-
 public slots:
     void createModel(QString fileName, Settings *settings=nullptr);
     void setup();
@@ -71,12 +68,17 @@ public slots:
     void abort();
     //ModelRunState state() { return *mState; }
 
+private:
     void processedPackage(Batch *batch);
     void allPackagesBuilt();
-
-private:
+    void waitForPackages();
     void internalRun();
-    void evaluateCell(Cell *cell);
+    /// batches of cells that are processed directly by modules (one per module, local to a chunk of cells)
+    typedef std::vector< std::unique_ptr<Batch> > DirectBatches;
+    void evaluateCells(const int *begin, const int *end);
+    void evaluateCell(Cell *cell, DirectBatches &direct);
+    void addDirectCell(Cell *cell, Module *module, DirectBatches &direct);
+    void processDirectBatch(Batch *batch);
     void buildInferenceDataDNN(Cell *cell);
     std::pair<Batch *, size_t> getSlot(Cell *cell, Module *module);
     bool checkBatch(Batch *batch);
@@ -92,16 +94,21 @@ private:
     bool mAbort;
     Model *mModel;
 
-    int mPackagesBuilt;
-    int mPackagesProcessed;
+    std::atomic<int> mPackagesBuilt;
+    std::atomic<int> mPackagesProcessed;
+    std::atomic<int> mPackagesSubmitted; ///< packages sent to the inference pipeline
+    int mPackagesReturned; ///< packages received from the inference pipeline (model thread only)
     bool mAllPackagesBuilt;
-    int mPackageId;
-    size_t mCellsProcesssed; // cells that are processed in the model (not via DNN)
+    std::atomic<bool> mCellsEvaluated {false}; ///< all cells of the year are evaluated (other wake ups of the model thread are ignored)
+    std::atomic<int> mPackageId;
+    std::atomic<size_t> mCellsProcesssed; // cells that are processed in the model (not via DNN)
 
 
 
-    QFutureWatcher<void> packageWatcher;
     QFuture<void> packageFuture;
+    /// threads that process the results of DNN batches (if empty, the results are processed in the model thread)
+    QThreadPool mResultPool;
+    bool mParallelResults {false};
 
     // loggers
     std::shared_ptr<spdlog::logger> lg;
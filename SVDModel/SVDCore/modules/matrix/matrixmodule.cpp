@@ -18,6 +18,7 @@
 ********************************************************************************************/
 #include "model.h"
 #include "matrixmodule.h"
+#include "randomgen.h"
 #include "tools.h"
 #include "filereader.h"
 #include "expressionwrapper.h"
@@ -77,6 +78,9 @@ void MatrixModule::processBatch(Batch *batch)
     state_t new_state;
     for (size_t i=0;i<batch->usedSlots();++i) {
         Cell *cell = batch->cells()[i];
+        if (!cell)
+            continue; // empty slot
+        RandomGenerator::setStream(static_cast<uint64_t>(cell->cellIndex()), RandomGenerator::ModuleCell);
         if (mHasKeyFormula) {
             cw.setData(cell);
             key = static_cast<int>(mKeyFormula.calculate(cw));
@@ -22,6 +22,8 @@
 #include "tools.h"
 #include "strtools.h"
 #include "filereader.h"
+#include "perfstats.h"
+#include "tracerecorder.h"
 
 // the individual outputs
 #include "stategridout.h"
@@ -29,6 +31,7 @@
 #include "statechangeout.h"
 #include "statehistout.h"
 #include "statematrixout.h"
+#include "performanceout.h"
 #include "modules/fire/fireout.h"
 #include "modules/wind/windout.h"
 #include "modules/automanagement/automanagementout.h"
@@ -42,6 +45,7 @@ OutputManager::OutputManager()
     mOutputs.push_back(new StateChangeOut());
     mOutputs.push_back(new StateHistOut());
     mOutputs.push_back(new StateMatrixOut());
+    mOutputs.push_back(new PerformanceOut());
     mOutputs.push_back(new FireOut());
     mOutputs.push_back(new WindOut());
     mOutputs.push_back(new AutoManagementOut());
@@ -96,7 +100,11 @@ bool OutputManager::run(const std::string &output_name)
         throw std::logic_error("Output Manager: invalid output '"+output_name+"' in run().");
     if (o->enabled()) {
         spdlog::get("main")->trace("Starting execution of output '{}'", o->name());
-        o->execute();
+        {
+            PerfTimer timer(PerfStats::Outputs);
+            TraceScope trace("output", "model");
+            o->execute();
+        }
         spdlog::get("main")->trace("Execution of output '{}' finished.", o->name());
     }
     return o->enabled();
@@ -104,6 +112,7 @@ bool OutputManager::run(const std::string &output_name)
 
 void OutputManager::yearEnd()
 {
+    PerfTimer timer(PerfStats::Outputs);
     for (auto o : mOutputs)
         o->flush();
 }
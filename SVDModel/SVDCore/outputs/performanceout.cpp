@@ -0,0 +1,52 @@
+#include "performanceout.h"
+
+#include "model.h"
+#include "perfstats.h"
+
+PerformanceOut::PerformanceOut()
+{
+    setName("Performance");
+    setDescription("Timings of the stages of the model (e.g. the evaluation of cells, or the DNN) for each year. " \
+                   "Stages are `cellEvaluation`, `fetchPredictors`, `slotWait` (waiting for a free slot in a batch), " \
+                   "`queueWait` (batches waiting for the DNN), `dnnRun`, `topK` (top-k and selection of the next state), `processResults`, `moduleRun`, `outputs` and `finalizeYear`. " \
+                   "Percentiles are derived from histograms (accuracy about 20%). Timings are collected only if the output is enabled.\n\n" \
+                   "### Parameters\n" \
+                   " * none");
+    // define the columns
+    columns() = {
+    {"year", "simulation year", DataType::Int},
+    {"stage", "name of the stage", DataType::String},
+    {"count", "number of events (e.g. cells, batches) of the stage in the year", DataType::Int},
+    {"total", "total time (ms), summed over all threads", DataType::Double},
+    {"mean", "mean time per event (ms)", DataType::Double},
+    {"p50", "median time per event (ms)", DataType::Double},
+    {"p90", "90th percentile of the time per event (ms)", DataType::Double},
+    {"p99", "99th percentile of the time per event (ms)", DataType::Double},
+    {"max", "maximum time per event (ms)", DataType::Double}   };
+
+}
+
+PerformanceOut::~PerformanceOut()
+{
+    PerfStats::setEnabled(false);
+}
+
+void PerformanceOut::setup()
+{
+    openOutputFile();
+    PerfStats::setEnabled(true);
+    // discard timings of the setup
+    PerfStats::collect();
+}
+
+void PerformanceOut::execute()
+{
+    int year = Model::instance()->year();
+    for (const auto &s : PerfStats::collect()) {
+        if (s.count == 0)
+            continue;
+        out() << year << PerfStats::stageName(s.stage) << s.count << s.total_ms << s.total_ms / s.count
+              << s.p50_ms << s.p90_ms << s.p99_ms << s.max_ms;
+        out().write();
+    }
+}
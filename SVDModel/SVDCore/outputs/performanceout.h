@@ -0,0 +1,16 @@
+#ifndef PERFORMANCEOUT_H
+#define PERFORMANCEOUT_H
+#include "output.h"
+
+
+class PerformanceOut: public Output
+{
+public:
+    PerformanceOut();
+    ~PerformanceOut();
+    void setup();
+    void execute();
+
+};
+
+#endif // PERFORMANCEOUT_H
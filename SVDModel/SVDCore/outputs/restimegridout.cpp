@@ -51,10 +51,11 @@ void ResTimeGridOut::execute()
     std::string file_name = mPath;
     find_and_replace(file_name, "$year$", to_string(year));
     auto &grid = Model::instance()->landscape()->grid();
+    const auto &res_times = Model::instance()->landscape()->cellStore().residenceTime;
     if (!gridToFile<GridCell, restime_t>( grid, file_name, GeoTIFF::DTSINT16,
-                                            [](const GridCell &c) -> restime_t {if(c.isNull())
+                                            [&res_times](const GridCell &c) -> restime_t {if(c.isNull())
                                                                             return std::numeric_limits<restime_t>::lowest();
-                                                                         return c.cell().residenceTime(); }) )
+                                                                         return res_times[static_cast<size_t>(c.index)]; }) )
         throw std::logic_error("ResTimeGridOut: couldn't write output file: " + file_name);
 
 
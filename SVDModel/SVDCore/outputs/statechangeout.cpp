@@ -99,3 +99,14 @@ void StateChangeOut::writeLine(std::string content)
     out() << content;
     out().write();
 }
+
+void StateChangeOut::writeLines(const std::vector<std::string> &lines)
+{
+    if (lines.empty())
+        return;
+    std::lock_guard<std::mutex> guard(output_mutex);
+    for (const auto &line : lines) {
+        out() << line;
+        out().write();
+    }
+}
@@ -33,6 +33,8 @@ public:
     bool shouldWriteOutput(const InferenceData &id);
 
     void writeLine(std::string content);
+    /// write the lines of a batch at once (thread safe)
+    void writeLines(const std::vector<std::string> &lines);
 private:
     int mInterval;
     int mCellId;
@@ -50,11 +50,12 @@ void StateGridOut::execute()
     std::string file_name = mPath;
     find_and_replace(file_name, "$year$", to_string(year));
     auto &grid = Model::instance()->landscape()->grid();
+    const auto &state_ids = Model::instance()->landscape()->cellStore().stateId;
 
     if (!gridToFile<GridCell, short>( grid, file_name, GeoTIFF::DTSINT16,
-                                   [](const GridCell &c) -> short {if(c.isNull())
+                                   [&state_ids](const GridCell &c) -> short {if(c.isNull())
                                                                      return std::numeric_limits<short>::lowest();
-                                                                  return static_cast<short>(c.cell().state()->id()); }))
+                                                                  return static_cast<short>(state_ids[static_cast<size_t>(c.index)]); }))
         throw std::logic_error("StateGridOut: couldn't write output file: " + file_name);
 
 
@@ -13,11 +13,16 @@ public:
     void setup();
     void execute();
 
+    /// number of transitions between two states (from, to)
+    typedef std::map< std::pair<state_t, state_t>, int> TransitionMap;
+
     // add a single state transition to the matrix
     void add(state_t from, state_t to) { mSparseMatrix[std::pair<state_t, state_t>(from, to)]++; }
+    /// add the transitions collected elsewhere (e.g. by a thread) to the matrix
+    void merge(const TransitionMap &transitions) { for (const auto &t : transitions) mSparseMatrix[t.first] += t.second; }
 
 private:
-    std::map< std::pair<state_t, state_t>, int> mSparseMatrix;
+    TransitionMap mSparseMatrix;
     int mInterval {1};
 };
 
@@ -25,6 +25,9 @@
 #include <algorithm>
 #include <cassert>
 #include <mutex>
+#include <set>
+#include <cctype>
+#include <cstdlib>
 #include "randomgen.h"
 
 /** @class Expression
@@ -209,9 +212,56 @@ void Expression::setAndParse(const std::string &expr)
 
 /// set the current expression.
 /// do some preprocessing (e.g. handle the different use of ",", ".", ";")
+// the state ids used in 'distance()' (see distanceStates())
+static std::set<int> distance_states;
+static std::mutex distance_states_mutex;
+
+// scan the expression text for calls of 'distance()' and collect the arguments that are numeric constants
+static void collectDistanceStates(const std::string &expr)
+{
+    const std::string fn = "distance";
+    size_t pos = expr.find(fn);
+    while (pos != std::string::npos) {
+        size_t i = pos + fn.size();
+        bool is_call = pos==0 || !(isalnum(expr[pos-1]) || expr[pos-1]=='_');
+        while (i<expr.size() && isspace(expr[i]))
+            ++i;
+        if (is_call && i<expr.size() && expr[i]=='(') {
+            // split the arguments (at the top level of parentheses)
+            int depth = 0;
+            size_t arg_start = i + 1;
+            for (++i; i<expr.size(); ++i) {
+                char c = expr[i];
+                if (c=='(') { ++depth; continue; }
+                if (c==')' && depth>0) { --depth; continue; }
+                if ((c==',' && depth==0) || c==')') {
+                    std::string arg = trimmed(expr.substr(arg_start, i - arg_start));
+                    char *end = nullptr;
+                    double value = arg.empty() ? -1. : strtod(arg.c_str(), &end);
+                    if (!arg.empty() && *end=='\0' && value >= 0.) {
+                        std::lock_guard<std::mutex> guard(distance_states_mutex);
+                        distance_states.insert(static_cast<int>(value));
+                    }
+                    arg_start = i + 1;
+                    if (c==')')
+                        break;
+                }
+            }
+        }
+        pos = expr.find(fn, pos + fn.size());
+    }
+}
+
+std::vector<int> Expression::distanceStates()
+{
+    std::lock_guard<std::mutex> guard(distance_states_mutex);
+    return std::vector<int>(distance_states.begin(), distance_states.end());
+}
+
 void Expression::setExpression(const std::string& aExpression)
 {
     m_expression=trimmed(aExpression);
+    collectDistanceStates(m_expression);
 
     m_expr=const_cast<char*>(m_expression.c_str());
 
@@ -94,6 +94,8 @@ public:
         void enableIncSum();
 
         static void setConstants(const std::vector<std::string> &consts);
+        /// state ids that are used as constant arguments of `distance()` in any expression (see Cell::minimumDistanceTo())
+        static std::vector<int> distanceStates();
 
 private:
         enum ETokType {etNumber, etOperator, etVariable, etFunction, etLogical, etCompare, etStop, etUnknown, etDelimeter};
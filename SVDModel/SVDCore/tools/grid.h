@@ -25,6 +25,7 @@
 #include <set>
 #include <algorithm>
 #include <functional>
+#include <cstdlib>
 
 #include <stdexcept>
 #include <limits>
@@ -354,6 +355,71 @@ private:
     int mCurrentCol;
 };
 
+/** @class HaloGrid is a copy of a Grid with an additional border (halo) of `halo` cells on each side.
+  The border is filled with a sentinel value. Neighbors of a cell within the distance of the halo
+  can be accessed with (precomputed) linear index deltas (see offsets()) without checking the bounds of the grid.
+  Note: the HaloGrid is a copy, i.e., changes of the source grid need to be copied (copyFrom()).
+*/
+template <class T>
+class HaloGrid {
+public:
+    HaloGrid(): mHalo(0), mStride(0), mSourceSizeX(0) {}
+    /// set up the padded copy of `source` with a border of `halo` cells filled with `sentinel`
+    void setup(const Grid<T> &source, const int halo, const T &sentinel);
+    /// copy the values of `source` (which has the same size as the grid used in setup())
+    void copyFrom(const Grid<T> &source);
+    bool isEmpty() const { return mGrid.isEmpty(); }
+    /// the width of the border (cells)
+    int halo() const { return mHalo; }
+    /// the linear index (padded grid) of the cell with the indices ix and iy of the source grid
+    int index(const int ix, const int iy) const { return (iy + mHalo) * mStride + ix + mHalo; }
+    /// the linear index (padded grid) of the cell with the (linear) index `source_index` of the source grid
+    int index(const int source_index) const { return index(source_index % mSourceSizeX, source_index / mSourceSizeX); }
+    /// linear index deltas (padded grid) of the offsets `points`. Throws an exception if an offset is beyond the halo.
+    std::vector<int> offsets(const std::vector<Point> &points) const;
+    /// access by linear index of the padded grid
+    const T &operator[](const int padded_index) const { return mGrid.constValueAtIndex(padded_index); }
+    /// pointer to the element with the linear index `padded_index`
+    const T *ptr(const int padded_index) const { return mGrid.begin() + padded_index; }
+private:
+    Grid<T> mGrid; ///< the padded grid
+    int mHalo; ///< width of the border
+    int mStride; ///< number of cells in x-direction (including the border)
+    int mSourceSizeX; ///< number of cells in x-direction of the source grid
+};
+
+template <class T>
+void HaloGrid<T>::setup(const Grid<T> &source, const int halo, const T &sentinel)
+{
+    mHalo = halo;
+    mSourceSizeX = source.sizeX();
+    mStride = source.sizeX() + 2*halo;
+    mGrid.setup(source.cellsize(), mStride, source.sizeY() + 2*halo);
+    mGrid.initialize(sentinel);
+    copyFrom(source);
+}
+
+template <class T>
+void HaloGrid<T>::copyFrom(const Grid<T> &source)
+{
+    for (int iy=0; iy<source.sizeY(); ++iy)
+        std::copy(source.begin() + iy*source.sizeX(), source.begin() + (iy+1)*source.sizeX(),
+                  mGrid.begin() + index(0, iy));
+}
+
+template <class T>
+std::vector<int> HaloGrid<T>::offsets(const std::vector<Point> &points) const
+{
+    std::vector<int> result;
+    result.reserve(points.size());
+    for (const auto &p : points) {
+        if (std::abs(p.x()) > mHalo || std::abs(p.y()) > mHalo)
+            throw std::logic_error("HaloGrid: the offset " + to_string(p.x()) + "/" + to_string(p.y()) + " is beyond the halo (" + to_string(mHalo) + " cells).");
+        result.push_back(p.y() * mStride + p.x());
+    }
+    return result;
+}
+
 /** @class Vector3D is a simple 3d vector.
   QVector3D (from Qt) is in QtGui so we needed a replacement.
 */
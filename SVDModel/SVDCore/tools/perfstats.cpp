@@ -0,0 +1,183 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "perfstats.h"
+
+#include <mutex>
+#include <cmath>
+#include <algorithm>
+
+std::atomic<bool> PerfStats::mEnabled(false);
+
+namespace {
+/// the counters of a single thread. Written only by the owning thread, read (and reset) by collect().
+struct PerfThreadData {
+    std::atomic<uint64_t> count[PerfStats::StageCount];
+    std::atomic<uint64_t> total_ns[PerfStats::StageCount];
+    std::atomic<uint64_t> max_ns[PerfStats::StageCount];
+    std::atomic<uint64_t> hist[PerfStats::StageCount][PerfStats::NBins];
+    PerfThreadData() {
+        for (int s=0;s<PerfStats::StageCount;++s) {
+            count[s] = 0; total_ns[s] = 0; max_ns[s] = 0;
+            for (int i=0;i<PerfStats::NBins;++i)
+                hist[s][i] = 0;
+        }
+    }
+    /// add the data of `other` to this object and reset `other`
+    void take(PerfThreadData &other) {
+        for (int s=0;s<PerfStats::StageCount;++s) {
+            count[s] += other.count[s].exchange(0);
+            total_ns[s] += other.total_ns[s].exchange(0);
+            max_ns[s] = std::max(max_ns[s].load(), other.max_ns[s].exchange(0));
+            for (int i=0;i<PerfStats::NBins;++i)
+                hist[s][i] += other.hist[s][i].exchange(0);
+        }
+    }
+};
+
+struct PerfRegistry {
+    std::mutex mutex;
+    std::vector<PerfThreadData*> threads;
+    PerfThreadData retired; ///< data of threads that already finished
+};
+PerfRegistry &registry() {
+    static PerfRegistry reg;
+    return reg;
+}
+
+/// thread local handle: registers the data of the thread, and keeps the data when the thread ends
+struct PerfThreadSlot {
+    PerfThreadData *data {nullptr};
+    ~PerfThreadSlot() {
+        if (!data)
+            return;
+        PerfRegistry &reg = registry();
+        std::lock_guard<std::mutex> guard(reg.mutex);
+        reg.retired.take(*data);
+        reg.threads.erase(std::remove(reg.threads.begin(), reg.threads.end(), data), reg.threads.end());
+        delete data;
+    }
+};
+thread_local PerfThreadSlot tl_perf;
+
+PerfThreadData *threadData()
+{
+    if (!tl_perf.data) {
+        tl_perf.data = new PerfThreadData();
+        PerfRegistry &reg = registry();
+        std::lock_guard<std::mutex> guard(reg.mutex);
+        reg.threads.push_back(tl_perf.data);
+    }
+    return tl_perf.data;
+}
+
+} // end namespace
+
+const char *PerfStats::stageName(PerfStats::Stage stage)
+{
+    switch (stage) {
+    case YearSetup: return "yearSetup";
+    case CellEvaluation: return "cellEvaluation";
+    case FetchPredictors: return "fetchPredictors";
+    case SlotWait: return "slotWait";
+    case QueueWait: return "queueWait";
+    case DNNRun: return "dnnRun";
+    case TopK: return "topK";
+    case ProcessResults: return "processResults";
+    case ModuleRun: return "moduleRun";
+    case Outputs: return "outputs";
+    case FinalizeYear: return "finalizeYear";
+    default: return "invalid";
+    }
+}
+
+void PerfStats::record(PerfStats::Stage stage, uint64_t ns)
+{
+    PerfThreadData *d = threadData();
+    d->count[stage].fetch_add(1, std::memory_order_relaxed);
+    d->total_ns[stage].fetch_add(ns, std::memory_order_relaxed);
+    if (ns > d->max_ns[stage].load(std::memory_order_relaxed))
+        d->max_ns[stage].store(ns, std::memory_order_relaxed);
+    d->hist[stage][binIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<PerfStats::Summary> PerfStats::collect()
+{
+    PerfThreadData sum;
+    {
+        PerfRegistry &reg = registry();
+        std::lock_guard<std::mutex> guard(reg.mutex);
+        sum.take(reg.retired);
+        for (auto d : reg.threads)
+            sum.take(*d);
+    }
+
+    std::vector<Summary> result;
+    for (int s=0;s<StageCount;++s) {
+        Summary r;
+        r.stage = static_cast<Stage>(s);
+        r.count = sum.count[s];
+        r.total_ms = sum.total_ns[s] / 1e6;
+        r.max_ms = sum.max_ns[s] / 1e6;
+        // percentiles from the histogram (upper limit of the bin, but not more than the maximum)
+        double *targets[3] = { &r.p50_ms, &r.p90_ms, &r.p99_ms };
+        const double quantiles[3] = { 0.5, 0.9, 0.99 };
+        uint64_t n_hist = 0;
+        for (int i=0;i<NBins;++i)
+            n_hist += sum.hist[s][i];
+        for (int q=0;q<3;++q) {
+            *targets[q] = 0.;
+            if (n_hist == 0)
+                continue;
+            uint64_t rank = static_cast<uint64_t>(std::ceil(quantiles[q] * n_hist));
+            uint64_t cumulative = 0;
+            for (int i=0;i<NBins;++i) {
+                cumulative += sum.hist[s][i];
+                if (cumulative >= rank) {
+                    *targets[q] = std::min(binUpperLimit(i) / 1e6, r.max_ms);
+                    break;
+                }
+            }
+        }
+        result.push_back(r);
+    }
+    return result;
+}
+
+int PerfStats::binIndex(uint64_t ns)
+{
+    if (ns < 4)
+        return static_cast<int>(ns);
+    // position of the most significant bit (binary search)
+    int msb = 0;
+    for (int shift=32; shift>0; shift/=2)
+        if (ns >> (msb + shift))
+            msb += shift;
+    // the two bits below the most significant bit select the bin within the octave
+    int sub = static_cast<int>((ns >> (msb - 2)) & 3);
+    return msb * BinsPerOctave + sub;
+}
+
+double PerfStats::binUpperLimit(int bin)
+{
+    if (bin < 4)
+        return bin + 1;
+    int msb = bin / BinsPerOctave;
+    int sub = bin % BinsPerOctave;
+    return std::ldexp(5. + sub, msb - 2);
+}
@@ -0,0 +1,94 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef PERFSTATS_H
+#define PERFSTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The PerfStats class collects timings of the stages of the model (e.g. the evaluation of cells, or the DNN).
+ *
+ * Timings are recorded by each thread into thread local counters and histograms (no locking).
+ * The histograms use four bins per power of two, i.e. percentiles are accurate to about 20%.
+ * collect() merges the data of all threads and resets the counters; it is called once a year
+ * by the `Performance` output. Recording is disabled unless the output is enabled.
+ */
+class PerfStats
+{
+public:
+    /// the stages of the processing chain
+    enum Stage { YearSetup=0, CellEvaluation, FetchPredictors, SlotWait, QueueWait, DNNRun, TopK,
+                 ProcessResults, ModuleRun, Outputs, FinalizeYear, StageCount };
+    /// summary of a single stage (times in milliseconds)
+    struct Summary {
+        Stage stage;
+        uint64_t count;
+        double total_ms;
+        double p50_ms;
+        double p90_ms;
+        double p99_ms;
+        double max_ms;
+    };
+
+    static bool isEnabled() { return mEnabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { mEnabled = enabled; }
+    static const char *stageName(Stage stage);
+
+    /// record a single event of `stage` that took `ns` nanoseconds
+    static void record(Stage stage, uint64_t ns);
+    /// merge the data of all threads, and reset the counters
+    static std::vector<Summary> collect();
+
+    // histogram bins: 4 bins per power of two
+    static const int BinsPerOctave = 4;
+    static const int NBins = 64 * BinsPerOctave;
+    static int binIndex(uint64_t ns);
+    /// upper limit (ns) of the bin with index `bin`
+    static double binUpperLimit(int bin);
+private:
+    static std::atomic<bool> mEnabled;
+};
+
+/// PerfTimer measures the time between construction and destruction,
+/// and records it for a stage (if the performance statistics are enabled).
+class PerfTimer
+{
+public:
+    PerfTimer(PerfStats::Stage stage): mStage(stage), mActive(PerfStats::isEnabled()) {
+        if (mActive)
+            mStart = std::chrono::steady_clock::now();
+    }
+    ~PerfTimer() { stop(); }
+    /// stop the timer (before the end of the scope)
+    void stop() {
+        if (!mActive)
+            return;
+        mActive = false;
+        PerfStats::record(mStage, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart).count()));
+    }
+private:
+    PerfStats::Stage mStage;
+    bool mActive;
+    std::chrono::steady_clock::time_point mStart;
+};
+
+#endif // PERFSTATS_H
@@ -21,15 +21,21 @@
 #include <random>
 #include <chrono>
 
-std::uniform_real_distribution<double> RandomGenerator::dbl_dist = std::uniform_real_distribution<double>(0., 1.);
-std::mt19937_64 RandomGenerator::generator;
+#include <atomic>
 
-// uniform_real_distribution: 1'000'000'000 random numbers: 27 secs (release mode)
+uint64_t RandomGenerator::mSeed = 0;
+int RandomGenerator::mYear = 0;
+thread_local RandomGenerator::StreamState RandomGenerator::mStream = {0, 0};
 
 
 void RandomGenerator::setRandomSeed()
 {
-    size_t seed = static_cast<size_t>(std::chrono::system_clock::now().time_since_epoch().count());
-    generator.seed(seed);
+    mSeed = static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+}
 
+void RandomGenerator::setThreadStream()
+{
+    // every thread gets a distinct default stream
+    static std::atomic<uint64_t> thread_counter(0);
+    setStream(++thread_counter, Default);
 }
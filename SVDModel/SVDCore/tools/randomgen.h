@@ -20,22 +20,64 @@
 #define RANDOMGEN_H
 
 #include <random>
+#include <cstdint>
+#include <string>
 
-
+/**
+ * @brief The RandomGenerator class provides independent streams of random numbers.
+ *
+ * The generator is counter based: a random number is a hash (SplitMix64) of the stream key
+ * and a running counter. Each thread has its own stream (no shared state, no locking).
+ * The stream key is derived from the global seed (`model.seed`), the simulation year and a
+ * user defined key (e.g. the index of a cell) - see setStream(). Therefore the random numbers
+ * used for a cell do not depend on the thread or the order in which cells are processed.
+ */
 class RandomGenerator {
   public:
-    RandomGenerator() { dbl_dist = std::uniform_real_distribution<double>(0., 1.);  setRandomSeed(); }
-    // this is the more "correct" way of doing it, but it is three times slower than the other way
-    //static double rand() { return dbl_dist(generator); }
-    // the faster way
-    static double rand() { return generator() / static_cast<double>(generator.max()); }
+    /// domains of random streams: streams with the same key but different domains are independent
+    enum StreamDomain { Default=0, Setup=1, CellEvaluation=2, DNNSelection=3, Module=4, ModuleCell=5 };
+    /// random number [0,1)
+    static double rand() { return static_cast<double>(next() >> 11) * (1. / 9007199254740992.); }
     static double rand(double range) { return rand()*range; }
-    static int randInt(int range) { int r = static_cast<int>( generator() % static_cast<unsigned long long>(range) ); return r; }
+    static int randInt(int range) { int r = static_cast<int>( next() % static_cast<uint64_t>(range) ); return r; }
+    /// set the global seed
+    static void setSeed(uint64_t seed) { mSeed = seed; }
+    static uint64_t seed() { return mSeed; }
     // random seed....
     static void setRandomSeed();
+    /// set the current year (part of the stream keys)
+    static void setYear(int year) { mYear = year; }
+    /// switch the stream of the current thread to the stream given by `key` and `domain` (and the current year)
+    static void setStream(uint64_t key, StreamDomain domain=Default) {
+        mStream.key = mix(mix(mix(mSeed + 0x9E3779B97F4A7C15ULL) ^ static_cast<uint64_t>(mYear)) ^ (key * 8 + static_cast<uint64_t>(domain))) | 1;
+        mStream.counter = 0;
+    }
+    /// the stream key of a text (e.g. the name of a module)
+    static uint64_t streamKey(const std::string &text) {
+        uint64_t h = 1469598103934665603ULL; // FNV-1a
+        for (char c : text) { h ^= static_cast<unsigned char>(c); h *= 1099511628211ULL; }
+        return h;
+    }
 private:
-    static std::uniform_real_distribution<double> dbl_dist;
-    static std::mt19937_64 generator;
+    struct StreamState {
+        uint64_t key; ///< 0: not yet initialized
+        uint64_t counter;
+    };
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    static uint64_t next() {
+        if (mStream.key == 0)
+            setThreadStream();
+        return mix(mStream.key + (++mStream.counter) * 0x9E3779B97F4A7C15ULL);
+    }
+    /// default stream for threads that did not set a stream explicitly
+    static void setThreadStream();
+    static uint64_t mSeed;
+    static int mYear;
+    static thread_local StreamState mStream;
 };
 
 /// ******************************************
@@ -49,7 +91,7 @@ inline double nrandom(const double& p1, const double& p2)
     return p1 + RandomGenerator::rand(p2-p1);
     //return p1 + (p2-p1)*(rand()/double(RAND_MAX));
 }
-/// returns a random number in [0,1] (i.e.="1" *is* a possible result!)
+/// returns a random number in [0,1)
 inline double drandom()
 {
     return RandomGenerator::rand();
@@ -0,0 +1,193 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#include "tracerecorder.h"
+
+#include <fstream>
+#include <mutex>
+#include <map>
+#include <vector>
+#include <stdexcept>
+
+/// a single event in the ring buffer. The fields are written by a single thread (the one that
+/// obtained the index), `seq` is used to detect events that are incomplete or already overwritten.
+struct TraceRecorder::Event {
+    std::atomic<uint64_t> seq {0}; ///< index + 1 of the stored event (0: currently written)
+    std::atomic<const char*> name {nullptr};
+    std::atomic<const char*> category {nullptr};
+    std::atomic<int64_t> ts {0}; ///< start (ns since start())
+    std::atomic<int64_t> dur {0}; ///< duration (ns)
+    std::atomic<int> tid {0};
+    std::atomic<int> batch {-1};
+    std::atomic<int> slots {-1};
+    std::atomic<bool> async {false};
+};
+
+std::atomic<bool> TraceRecorder::mEnabled(false);
+std::unique_ptr<TraceRecorder::Event[]> TraceRecorder::mEvents;
+size_t TraceRecorder::mMask = 0;
+std::atomic<uint64_t> TraceRecorder::mHead(0);
+uint64_t TraceRecorder::mDumped = 0;
+TraceRecorder::TimePoint TraceRecorder::mOrigin;
+
+namespace {
+std::atomic<int> trace_thread_count(0);
+thread_local int tl_trace_thread_id = -1;
+
+std::mutex &threadNameMutex() { static std::mutex m; return m; }
+std::map<int, std::string> &threadNames() { static std::map<int, std::string> names; return names; }
+
+std::string escapeJson(const std::string &s)
+{
+    std::string r;
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            r += '\\';
+        r += c;
+    }
+    return r;
+}
+} // end namespace
+
+void TraceRecorder::start(size_t capacity)
+{
+    mEnabled = false;
+    size_t n = 1024;
+    while (n < capacity)
+        n *= 2;
+    // the buffer is only replaced if the size changes (threads may still hold references otherwise)
+    if (!mEvents || mMask + 1 != n) {
+        mEvents.reset(new Event[n]);
+        mMask = n - 1;
+    }
+    mHead = 0;
+    mDumped = 0;
+    mOrigin = now();
+    mEnabled = true;
+}
+
+void TraceRecorder::span(const char *name, const char *category, TimePoint start, TimePoint end, int batch, int slots)
+{
+    if (isEnabled())
+        record(name, category, start, end, batch, slots, false);
+}
+
+void TraceRecorder::batchSpan(const char *name, TimePoint start, TimePoint end, int batch, int slots)
+{
+    if (isEnabled())
+        record(name, "batch", start, end, batch, slots, true);
+}
+
+void TraceRecorder::setThreadName(const std::string &name)
+{
+    int tid = threadId();
+    std::lock_guard<std::mutex> guard(threadNameMutex());
+    threadNames()[tid] = name;
+}
+
+void TraceRecorder::record(const char *name, const char *category, TimePoint start, TimePoint end, int batch, int slots, bool async)
+{
+    uint64_t idx = mHead.fetch_add(1, std::memory_order_relaxed);
+    Event &e = mEvents[idx & mMask];
+    e.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.name.store(name, std::memory_order_relaxed);
+    e.category.store(category, std::memory_order_relaxed);
+    e.ts.store(std::chrono::duration_cast<std::chrono::nanoseconds>(start - mOrigin).count(), std::memory_order_relaxed);
+    e.dur.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+    e.tid.store(threadId(), std::memory_order_relaxed);
+    e.batch.store(batch, std::memory_order_relaxed);
+    e.slots.store(slots, std::memory_order_relaxed);
+    e.async.store(async, std::memory_order_relaxed);
+    e.seq.store(idx + 1, std::memory_order_release);
+}
+
+int TraceRecorder::threadId()
+{
+    if (tl_trace_thread_id < 0)
+        tl_trace_thread_id = ++trace_thread_count;
+    return tl_trace_thread_id;
+}
+
+size_t TraceRecorder::dump(const std::string &file_name, bool since_last_dump)
+{
+    if (!mEvents)
+        return 0;
+
+    uint64_t head = mHead.load();
+    uint64_t from = since_last_dump ? mDumped : 0;
+    uint64_t dropped = 0;
+    if (head - from > mMask + 1) {
+        // older events are already overwritten
+        dropped = head - from - (mMask + 1);
+        from = head - (mMask + 1);
+    }
+
+    std::ofstream out(file_name);
+    if (!out.is_open())
+        throw std::logic_error("TraceRecorder: cannot open file '" + file_name + "' for writing.");
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << dropped << "},\n\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"SVD\"}}";
+    {
+        std::lock_guard<std::mutex> guard(threadNameMutex());
+        for (const auto &tn : threadNames())
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tn.first << ",\"args\":{\"name\":\"" << escapeJson(tn.second) << "\"}}";
+    }
+
+    size_t n_written = 0;
+    for (uint64_t idx = from; idx < head; ++idx) {
+        const Event &e = mEvents[idx & mMask];
+        if (e.seq.load(std::memory_order_acquire) != idx + 1)
+            continue; // incomplete or overwritten
+        const char *name = e.name.load(std::memory_order_relaxed);
+        const char *category = e.category.load(std::memory_order_relaxed);
+        double ts = e.ts.load(std::memory_order_relaxed) / 1000.; // microseconds
+        double dur = e.dur.load(std::memory_order_relaxed) / 1000.;
+        int tid = e.tid.load(std::memory_order_relaxed);
+        int batch = e.batch.load(std::memory_order_relaxed);
+        int slots = e.slots.load(std::memory_order_relaxed);
+        bool async = e.async.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (e.seq.load(std::memory_order_relaxed) != idx + 1)
+            continue; // overwritten while reading
+
+        std::string args;
+        if (batch >= 0)
+            args += "\"batch\":" + std::to_string(batch);
+        if (slots >= 0)
+            args += std::string(args.empty() ? "" : ",") + "\"slots\":" + std::to_string(slots);
+
+        if (async) {
+            // an asynchronous span: pair of begin/end events with the batch as id
+            out << ",\n{\"name\":\"" << name << "\",\"cat\":\"" << category << "\",\"ph\":\"b\",\"id\":" << batch
+                << ",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << ts << ",\"args\":{" << args << "}}";
+            out << ",\n{\"name\":\"" << name << "\",\"cat\":\"" << category << "\",\"ph\":\"e\",\"id\":" << batch
+                << ",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << ts + dur << "}";
+        } else {
+            out << ",\n{\"name\":\"" << name << "\",\"cat\":\"" << category << "\",\"ph\":\"X\""
+                << ",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << ts << ",\"dur\":" << dur << ",\"args\":{" << args << "}}";
+        }
+        ++n_written;
+    }
+    out << "\n]}\n";
+    if (since_last_dump)
+        mDumped = head;
+    return n_written;
+}
@@ -0,0 +1,96 @@
+/********************************************************************************************
+**    SVD - the scalable vegetation dynamics model
+**    https://github.com/SVDmodel/SVD
+**    Copyright (C) 2018-  Werner Rammer, Rupert Seidl
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+********************************************************************************************/
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief The TraceRecorder class records a timeline of the processing chain (spans of threads and batches).
+ *
+ * Events are written into a fixed size ring buffer without locking (older events are overwritten
+ * when the buffer is full). The events are written as a Chrome trace (JSON) file (see dump()), which
+ * can be viewed with chrome://tracing or https://ui.perfetto.dev.
+ * Thread spans (e.g. waiting for a slot, running the DNN) are shown per thread, the life cycle
+ * of batches (fill, queue, inference, results) is shown as asynchronous spans (one track per batch).
+ * Tracing is enabled with `logging.trace.enabled`.
+ */
+class TraceRecorder
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    static TimePoint now() { return std::chrono::steady_clock::now(); }
+
+    /// allocate a buffer for `capacity` events (rounded up to a power of 2) and start recording
+    static void start(size_t capacity);
+    /// stop recording (the events remain in the buffer)
+    static void stop() { mEnabled = false; }
+    static bool isEnabled() { return mEnabled.load(std::memory_order_relaxed); }
+
+    /// record a span with the given `name` and `category` (string literals) on the track of the current thread.
+    /// `batch` and `slots` are optional (-1: not used).
+    static void span(const char *name, const char *category, TimePoint start, TimePoint end, int batch=-1, int slots=-1);
+    /// record a span of the life cycle of the batch with id `batch` (a separate track for each batch)
+    static void batchSpan(const char *name, TimePoint start, TimePoint end, int batch, int slots);
+    /// set the name of the current thread (shown in the trace viewer)
+    static void setThreadName(const std::string &name);
+
+    /// write the events to `file_name` (Chrome trace format). If `since_last_dump` is true,
+    /// only events recorded after the last call are written. Returns the number of events written.
+    static size_t dump(const std::string &file_name, bool since_last_dump);
+
+private:
+    struct Event;
+    static void record(const char *name, const char *category, TimePoint start, TimePoint end, int batch, int slots, bool async);
+    static int threadId();
+    static std::atomic<bool> mEnabled;
+    static std::unique_ptr<Event[]> mEvents; ///< the ring buffer
+    static size_t mMask; ///< capacity - 1
+    static std::atomic<uint64_t> mHead; ///< total number of events recorded
+    static uint64_t mDumped; ///< number of events at the last dump()
+    static TimePoint mOrigin; ///< time of start()
+};
+
+/// TraceScope records a span from construction to destruction (if tracing is enabled)
+class TraceScope
+{
+public:
+    TraceScope(const char *name, const char *category, int batch=-1, int slots=-1):
+        mName(name), mCategory(category), mBatch(batch), mSlots(slots), mActive(TraceRecorder::isEnabled()) {
+        if (mActive)
+            mStart = TraceRecorder::now();
+    }
+    ~TraceScope() {
+        if (mActive)
+            TraceRecorder::span(mName, mCategory, mStart, TraceRecorder::now(), mBatch, mSlots);
+    }
+private:
+    const char *mName;
+    const char *mCategory;
+    int mBatch;
+    int mSlots;
+    bool mActive;
+    TraceRecorder::TimePoint mStart;
+};
+
+#endif // TRACERECORDER_H
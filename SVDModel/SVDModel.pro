@@ -4,10 +4,12 @@ SUBDIRS += \
     SVDCore \
     Predictor \
     SVDUI \
-    SVDc
+    SVDc \
+    SVDBench
 
 SVDUI.depends = SVDCore Predictor
 SVDc.depends = SVDCore Predictor
+SVDBench.depends = SVDCore Predictor
 
 RESOURCES += \
     SVDUI/res/resource.qrc
@@ -21,6 +21,8 @@
 #include "model.h"
 #include "../Predictor/batchmanager.h"
 #include "../Predictor/batch.h"
+#include "../Predictor/inferencecache.h"
+#include "../Predictor/inferencepipeline.h"
 
 #include "../Predictor/dnnshell.h"
 
@@ -53,12 +55,7 @@ ModelController::ModelController(QObject *)
 
     connect(dnnThread, &QThread::finished, mDNNShell, &QObject::deleteLater);
 
-    // connection between main model and DNN: [this requires the old way of connect, because there are errors with Batch* otherwise]
-    QObject::connect(mModelShell, SIGNAL(newPackage(Batch*)), mDNNShell, SLOT(doWork(Batch*)), Qt::QueuedConnection);
-    QObject::connect(mDNNShell, SIGNAL(workDone(Batch*)), mModelShell, SLOT(processedPackage(Batch*)), Qt::QueuedConnection);
-    //connect(mModelShell, &ModelShell::newPackage, mModelInterface, &ModelInterface::doWork);
-    //connect(mModelInterface, &ModelInterface::workDone, mModelShell, &ModelShell::processedPackage);
-    //connect(mModelShell, &ModelShell::finished, this, &ModelController::finishedRun, Qt::QueuedConnection);
+    // batches are exchanged between the main model and the DNN via the InferencePipeline (no signals/slots)
 
     // fired after a simulation year ended
     connect(mModelShell, &ModelShell::processedStep, this, &ModelController::finishedStep, Qt::QueuedConnection);
@@ -127,6 +124,28 @@ std::unordered_map<std::string, std::string> ModelController::systemStatus()
     result["batchesDNN"] = to_string(n_dnn);
     result["batchesAvailable"] = to_string(n_fill);
     result["batchCellAvailable"] = to_string(n_open_slots);
+    result["batchBlockedCount"] = to_string( BatchManager::instance()->blockedCount() );
+    result["batchBlockedSeconds"] = to_string( BatchManager::instance()->blockedSeconds() );
+    result["batchBlockedSecondsYear"] = to_string( BatchManager::instance()->blockedSecondsYear() );
+    result["batchSizeEffective"] = to_string( BatchManager::instance()->effectiveBatchSize() );
+    result["batchQueueEffective"] = to_string( BatchManager::instance()->effectiveQueueLength() );
+    if (InferenceCache::instance()) {
+        result["dnnCacheHitRate"] = to_string( InferenceCache::instance()->hitRate() );
+        result["dnnCacheEntries"] = to_string( InferenceCache::instance()->size() );
+    }
+    // statistics per DNN instance (latency in ms)
+    if (InferencePipeline::hasInstance()) {
+        auto stats = InferencePipeline::instance()->instanceStats();
+        for (size_t i=0;i<stats.size();++i) {
+            std::string key = "dnn" + to_string(i);
+            result[key + "Batches"] = to_string(stats[i].batches);
+            result[key + "Queue"] = to_string(stats[i].queued);
+            result[key + "Stolen"] = to_string(stats[i].stolen);
+            result[key + "LatencyMean"] = to_string(stats[i].meanLatency * 1000.);
+            result[key + "LatencyMax"] = to_string(stats[i].maxLatency * 1000.);
+            result[key + "Occupancy"] = to_string(stats[i].occupancy);
+        }
+    }
 
     // main packages...
     result["mainBatchesBuilt"] = to_string( shell()->packagesBuilt() );
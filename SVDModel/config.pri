@@ -4,3 +4,9 @@
 # To enable tensorflow, uncomment line to add to DEFINES:
 
 DEFINES += USE_TENSORFLOW
+
+# The built-in inference engine (dnn.backend=native) uses AVX2 or AVX-512 kernels
+# when the compiler targets these instruction sets (otherwise plain C++ is used).
+# Uncomment one of the lines to enable (the CPU needs to support the instruction set):
+# CONFIG += svd_avx2
+# CONFIG += svd_avx512